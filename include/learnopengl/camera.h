@@ -112,6 +112,20 @@ public:
             Zoom = 45.0f; 
     }
 
+    // pixels that a length of size facing the camera at distance covers on a viewport viewportHeight pixels high
+    float ProjectedSize(float size, float distance, float viewportHeight) const
+    {
+        return size * viewportHeight / (2.0f * distance * tan(glm::radians(Zoom) * 0.5f));
+    }
+
+    // sets the euler angles directly, used by the scripted benchmark camera
+    void SetOrientation(float yaw, float pitch)
+    {
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
 private:
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
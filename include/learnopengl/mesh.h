@@ -5,9 +5,20 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <learnopengl/shader.h>
 
+#include <rg/Bounds.h>
+#include <rg/GeometryPool.h>
+#include <rg/GlStateCache.h>
+#include <rg/InstanceBuffer.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 using namespace std;
@@ -25,6 +36,141 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// a bit per vertex attribute location, as the shaders declare them
+enum VertexAttribute : unsigned int {
+    ATTRIBUTE_POSITION = 1 << 0,
+    ATTRIBUTE_NORMAL = 1 << 1,
+    ATTRIBUTE_TEXCOORDS = 1 << 2,
+    ATTRIBUTE_TANGENT = 1 << 3,
+    ATTRIBUTE_BITANGENT = 1 << 4,
+    ATTRIBUTES_ALL = 31
+};
+
+/* How a mesh keeps its vertices on the GPU: only the attributes in the mask, usually the
+ * Shader::vertexAttributes() of the shaders it is drawn with, interleaved in location order. Normals and
+ * tangents are 10:10:10:2 signed normalized, texture coordinates half floats, positions floats or, with
+ * halfPositions, half floats for meshes small enough around their origin. There is no bitangent: the
+ * tangent's w is its sign and bitangent = cross(normal, tangent.xyz) * w, so asking for one stores the
+ * tangent. The 56 byte Vertex comes down to 8 to 24 bytes. */
+struct VertexFormat {
+    unsigned int attributes;
+    bool halfPositions;
+
+    VertexFormat(unsigned int attributes = ATTRIBUTES_ALL, bool halfPositions = false)
+        : attributes(attributes), halfPositions(halfPositions)
+    {
+    }
+
+    // the attributes that are actually stored, positions always are
+    unsigned int stored() const
+    {
+        unsigned int stored = ATTRIBUTE_POSITION | (attributes & (ATTRIBUTE_NORMAL | ATTRIBUTE_TEXCOORDS | ATTRIBUTE_TANGENT));
+        if (attributes & ATTRIBUTE_BITANGENT)
+            stored |= ATTRIBUTE_TANGENT;
+        return stored;
+    }
+
+    // part of a mesh cache's key
+    uint32_t key() const
+    {
+        return stored() | (halfPositions ? 1u << 8 : 0);
+    }
+
+    unsigned int stride() const
+    {
+        return offset(4);
+    }
+
+    // byte offset of the attribute at location in a vertex
+    unsigned int offset(unsigned int location) const
+    {
+        unsigned int offset = 0;
+        for (unsigned int i = 0; i < location; i++)
+            if (stored() & 1u << i)
+                offset += size(i);
+        return offset;
+    }
+
+    void pack(const Vertex &vertex, unsigned char *out) const
+    {
+        unsigned int attributes = stored();
+        if (attributes & ATTRIBUTE_POSITION)
+        {
+            if (halfPositions)
+            {
+                uint16_t position[4] = {glm::packHalf1x16(vertex.Position.x), glm::packHalf1x16(vertex.Position.y),
+                                        glm::packHalf1x16(vertex.Position.z), glm::packHalf1x16(1.0f)};
+                std::memcpy(out, position, sizeof(position));
+            }
+            else
+                std::memcpy(out, &vertex.Position, sizeof(vertex.Position));
+            out += size(0);
+        }
+        if (attributes & ATTRIBUTE_NORMAL)
+        {
+            uint32_t normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.Normal, 0.0f));
+            std::memcpy(out, &normal, sizeof(normal));
+            out += sizeof(normal);
+        }
+        if (attributes & ATTRIBUTE_TEXCOORDS)
+        {
+            uint16_t texCoords[2] = {glm::packHalf1x16(vertex.TexCoords.x), glm::packHalf1x16(vertex.TexCoords.y)};
+            std::memcpy(out, texCoords, sizeof(texCoords));
+            out += sizeof(texCoords);
+        }
+        if (attributes & ATTRIBUTE_TANGENT)
+        {
+            float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            uint32_t tangent = glm::packSnorm3x10_1x2(glm::vec4(vertex.Tangent, handedness));
+            std::memcpy(out, &tangent, sizeof(tangent));
+        }
+    }
+
+    vector<unsigned char> pack(const Vertex *vertices, size_t count) const
+    {
+        vector<unsigned char> packed(count * stride());
+        for (size_t i = 0; i < count; i++)
+            pack(vertices[i], &packed[i * stride()]);
+        return packed;
+    }
+
+    // attribute pointers into the bound vertex buffer, on the bound VAO
+    void setup() const
+    {
+        unsigned int attributes = stored();
+        GLsizei vertexStride = stride();
+        if (attributes & ATTRIBUTE_POSITION)
+        {
+            glEnableVertexAttribArray(0);
+            if (halfPositions)
+                glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, vertexStride, (void*)(size_t)offset(0));
+            else
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertexStride, (void*)(size_t)offset(0));
+        }
+        if (attributes & ATTRIBUTE_NORMAL)
+        {
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, vertexStride, (void*)(size_t)offset(1));
+        }
+        if (attributes & ATTRIBUTE_TEXCOORDS)
+        {
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, vertexStride, (void*)(size_t)offset(2));
+        }
+        if (attributes & ATTRIBUTE_TANGENT)
+        {
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, vertexStride, (void*)(size_t)offset(3));
+        }
+    }
+
+private:
+    unsigned int size(unsigned int location) const
+    {
+        return location == 0 ? (halfPositions ? 8 : 12) : 4;
+    }
+};
+
 
 
 struct Texture {
@@ -33,37 +179,203 @@ struct Texture {
     string path;
 };
 
+/* The GeometryPool of every vertex format in use, created on first use on the render thread. Meshes in one
+ * format share its VAO and buffers, so drawing one after the other binds nothing new. */
+class GeometryPools
+{
+public:
+    static GeometryPool &get(const VertexFormat &format)
+    {
+        std::unique_ptr<GeometryPool> &pool = pools()[format.key()];
+        if (!pool)
+        {
+            pool.reset(new GeometryPool());
+            pool->create(format.stride(), [format] { format.setup(); });
+        }
+        return *pool;
+    }
+
+    // packs the pools that meshes were freed from, after a batch of loads say
+    static void defragment()
+    {
+        for (auto &pool : pools())
+            if (pool.second->fragmented())
+                pool.second->defragment();
+    }
+
+    static size_t usedBytes()
+    {
+        size_t bytes = 0;
+        for (auto &pool : pools())
+            bytes += pool.second->usedBytes();
+        return bytes;
+    }
+
+    static size_t totalBytes()
+    {
+        size_t bytes = 0;
+        for (auto &pool : pools())
+            bytes += pool.second->totalBytes();
+        return bytes;
+    }
+
+    static unsigned int count()
+    {
+        return (unsigned int) pools().size();
+    }
+
+    static void destroy()
+    {
+        for (auto &pool : pools())
+            pool.second->destroy();
+        pools().clear();
+    }
+
+private:
+    static std::map<unsigned int, std::unique_ptr<GeometryPool>> &pools()
+    {
+        static std::map<unsigned int, std::unique_ptr<GeometryPool>> instance;
+        return instance;
+    }
+};
+
+// a detail level: a part of the mesh's index buffer, indexOffset in bytes, and its error in object space units
+struct MeshLod {
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    float error;
+};
+
 class Mesh {
 public:
-    // mesh Data
+    // mesh Data, empty when the mesh was uploaded straight from arrays owned elsewhere
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
+    // every detail level, full detail first
+    vector<MeshLod>      lods;
+    GLenum               indexType = GL_UNSIGNED_INT;
     vector<Texture>      textures;
 
-    unsigned int VAO;
+    // object space bounds, filled in by Model::processMesh
+    Aabb                 bounds;
+    BoundingSphere       sphere;
+
     std::string glslIdentifierPrefix;
+    VertexFormat format;
+    // the mesh's ranges in its format's shared buffers
+    GeometryPool *pool = nullptr;
+    GeometryPool::Allocation geometry;
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, VertexFormat format = VertexFormat())
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->format = format;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        vector<unsigned char> packed = format.pack(this->vertices.data(), this->vertices.size());
+        lods.push_back({0, (unsigned int) this->indices.size(), 0.0f});
+        setupMesh(packed.data(), this->vertices.size(), this->indices.data(), this->indices.size() * sizeof(unsigned int),
+                  sizeof(unsigned int));
+    }
+
+    // uploads vertices packed in format and the indices of every level, indexSize bytes each, 2 or 4, that
+    // stay with their owner, a mapped mesh cache for one, without keeping a copy
+    Mesh(const void *packedVertices, unsigned int vertexCount, const void *indices, unsigned int indexBytes,
+         unsigned int indexSize, vector<MeshLod> lods, vector<Texture> textures, VertexFormat format)
+    {
+        this->lods = lods;
+        this->textures = textures;
+        this->format = format;
+        setupMesh(packedVertices, vertexCount, indices, indexBytes, indexSize);
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // render the mesh, at the given detail level or the coarsest there is. The binds go through GlStateCache
+    // and are left in place; a CommandBucket submission puts the defaults back once at the end
+    void Draw(Shader &shader, unsigned int lod = 0)
+    {
+        BindTextures(shader);
+
+        // draw mesh
+        const MeshLod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+        pool->bind();
+        glDrawElementsBaseVertex(GL_TRIANGLES, level.indexCount, indexType,
+                                 (void*)(pool->indexOffset(geometry) + level.indexOffset), pool->baseVertex(geometry));
+    }
+
+    // render one copy of the mesh per instance in the buffer, with an *_instanced_vertex_shader.vs shader
+    void DrawInstanced(Shader &shader, const InstanceBuffer &instances)
+    {
+        if (instances.count() == 0)
+            return;
+        BindTextures(shader);
+
+        // the pool keeps a VAO per instance buffer, so switching buffers or models only binds
+        pool->bindInstanced(instances);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lods[0].indexCount, indexType, (void*)pool->indexOffset(geometry),
+                                          instances.count(), pool->baseVertex(geometry));
+    }
+
+    // this mesh's part of a glMultiDrawElementsBaseVertex over its pool, at the given level
+    void AddDraw(unsigned int lod, vector<GLsizei> &counts, vector<const void*> &offsets, vector<GLint> &baseVertices) const
+    {
+        const MeshLod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+        counts.push_back((GLsizei)level.indexCount);
+        offsets.push_back((const void*)(pool->indexOffset(geometry) + level.indexOffset));
+        baseVertices.push_back(pool->baseVertex(geometry));
+    }
+
+    // frees the mesh's ranges of the shared buffers, the mesh can't be drawn afterwards
+    void Release()
+    {
+        pool->free(geometry);
+    }
+
+    // binds the textures to units 0 and up and points the shader's samplers at them
+    void BindTextures(Shader &shader)
+    {
+        // sampler names only change with the shader or the prefix, resolve them to handles once for each
+        const vector<UniformHandle> &samplerHandles = samplers(shader);
+
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // set the sampler to the correct texture unit, a no-op after the first draw
+            shader.setInt(samplerHandles[i], i);
+            // and bind the texture, unless the unit already holds it
+            GlStateCache::bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+private:
+    // sampler uniform of every texture, for each program and prefix the mesh was drawn with. A mesh sees
+    // one or two programs, mercury's draws with its own shader and the rocks', so a search is cheap
+    struct SamplerSet
+    {
+        unsigned int program;
+        std::string prefix;
+        vector<UniformHandle> handles;
+    };
+    vector<SamplerSet> samplerSets;
+
+    const vector<UniformHandle> &samplers(const Shader &shader)
+    {
+        for (const SamplerSet &set : samplerSets)
+            if (set.program == shader.ID && set.prefix == glslIdentifierPrefix)
+                return set.handles;
+        samplerSets.push_back({shader.ID, glslIdentifierPrefix, {}});
+        resolveSamplers(shader, samplerSets.back().handles);
+        return samplerSets.back().handles;
+    }
+
+    void resolveSamplers(const Shader &shader, vector<UniformHandle> &samplerHandles) const
     {
-        // bind appropriate textures
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -75,65 +387,16 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplerHandles.push_back(shader.uniform(glslIdentifierPrefix + name + number));
         }
-
-
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
-    {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+    // copies the vertices and indices into the format's shared buffers, the VAO there already has the attributes
+    void setupMesh(const void *vertexData, size_t vertexCount, const void *indexData, size_t indexBytes, unsigned int indexSize)
+    {
+        indexType = indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        pool = &GeometryPools::get(format);
+        geometry = pool->allocate(vertexData, (unsigned int)vertexCount, indexData, indexBytes);
     }
 };
 #endif
\ No newline at end of file
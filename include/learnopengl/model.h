@@ -10,14 +10,23 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <learnopengl/camera.h>
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
 
+#include <rg/AssetLoader.h>
+#include <rg/CpuProfiler.h>
+#include <rg/MeshCache.h>
+#include <rg/MeshOptimizer.h>
+#include <rg/MeshSimplifier.h>
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
@@ -33,6 +42,13 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    VertexFormat vertexFormat;
+    // object space bounds of all meshes together
+    Aabb bounds;
+    BoundingSphere sphere;
+    // detail level drawn, 0 is full detail, and while lodFade is below 1 the one it crossfades from
+    unsigned int lod = 0, previousLod = 0;
+    float lodFade = 1.0f;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
@@ -40,40 +56,395 @@ public:
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
+    // loads in the background through the loader and draws a sphere of placeholderRadius until the meshes
+    // are resident, textures show placeholders until theirs are. The model must stay where it is until then.
+    // The meshes keep their vertices in format, which should have what the shaders drawing them read.
+    Model(string const &path, AssetLoader &assetLoader, float placeholderRadius, VertexFormat format = VertexFormat(),
+          bool gamma = false)
+        : gammaCorrection(gamma), vertexFormat(format), loader(&assetLoader)
+    {
+        setPlaceholder(placeholderRadius);
+        loader->beginAsset();
+        std::shared_ptr<MeshCache> data = std::make_shared<MeshCache>();
+        loader->background([this, path, data]
+        {
+            if (importModel(path, *data))
+            {
+                loader->schedule([this, data] { requestTextures(*data); return true; });
+                loader->schedule([this, data] { return uploadMeshes(*data); });
+            }
+            else
+                loader->schedule([this] { loader->endAsset(); return true; });
+        });
+    }
+
+    // whether the meshes are loaded, as opposed to the placeholder
+    bool Resident() const
+    {
+        return resident;
+    }
+
+    // the first mesh's vertex array and first texture, what a CommandBucket key sorts the model's draws by
+    unsigned int VertexArray() const
+    {
+        return meshes.empty() ? 0 : meshes[0].pool->vertexArray();
+    }
+
+    unsigned int Material() const
+    {
+        return meshes.empty() || meshes[0].textures.empty() ? 0 : meshes[0].textures[0].id;
+    }
+
+    // draws the model, and thus all its meshes, at the selected detail level. During a crossfade both levels
+    // draw, and the shader's lodFade uniform (common/lod_fade.glsl) gives each its half of a dither pattern
     void Draw(Shader &shader)
+    {
+        if (shader.ID != lodFadeProgram)
+        {
+            lodFadeUniform = shader.uniform("lodFade");
+            lodFadeProgram = shader.ID;
+        }
+        if (lodFade < 1.0f)
+        {
+            shader.setFloat(lodFadeUniform, -lodFade);
+            drawLevel(shader, previousLod);
+        }
+        if (lodFade > 0.0f)
+        {
+            shader.setFloat(lodFadeUniform, lodFade < 1.0f ? lodFade : 0.0f);
+            drawLevel(shader, lod);
+        }
+    }
+
+    // picks the coarsest level whose error, projected at the model's nearest point to the camera, stays
+    // within pixelError pixels of a viewport viewportHeight high, and moves the crossfade on by deltaTime. A new
+    // level fades in over fadeSeconds, and waits for the fade before it to finish. Levels coarser than the
+    // current one have to stay within a fraction of pixelError, so a camera sitting at the threshold keeps
+    // one level instead of fading back and forth
+    void SelectLod(const Camera &camera, const glm::mat4 &transform, float viewportHeight, float pixelError,
+                   float deltaTime, float fadeSeconds = 0.25f)
+    {
+        if (lodFade < 1.0f)
+            lodFade = fadeSeconds > 0.0f ? std::min(1.0f, lodFade + deltaTime / fadeSeconds) : 1.0f;
+        float scale = std::sqrt(std::max(glm::dot(transform[0], transform[0]),
+                                         std::max(glm::dot(transform[1], transform[1]), glm::dot(transform[2], transform[2]))));
+        glm::vec3 center = glm::vec3(transform * glm::vec4(sphere.center, 1.0f));
+        float distance = std::max(glm::length(center - camera.Position) - sphere.radius * scale, 1e-3f);
+        static const float coarsenBelow = 0.8f;
+        unsigned int target = 0;
+        while (target + 1 < lodErrors.size()
+               && camera.ProjectedSize(lodErrors[target + 1] * scale, distance, viewportHeight)
+                  <= (target + 1 > lod ? coarsenBelow * pixelError : pixelError))
+            target++;
+        if (target != lod && lodFade >= 1.0f)
+        {
+            previousLod = lod;
+            lod = target;
+            lodFade = 0.0f;
+        }
+    }
+
+    // draws every mesh once per instance in the buffer, one draw call per mesh
+    void DrawInstanced(Shader &shader, const InstanceBuffer &instances)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].DrawInstanced(shader, instances);
     }
 
     void SetShaderTextureNamePrefix(std::string prefix) {
+        textureNamePrefix = prefix;
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
         }
     }
 private:
+    // part of the mesh cache key, a change here invalidates every cache file
+    static const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    // a mesh as Assimp gives it, before it goes into the mesh cache
+    struct MeshData
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        vector<Texture> textures;
+        Aabb bounds;
+        BoundingSphere sphere;
+    };
+
+    // set for models loading in the background
+    AssetLoader *loader = nullptr;
+    bool resident = true;
+    // meshes made resident so far, they replace the placeholder once all are
+    vector<Mesh> loadingMeshes;
+    std::string textureNamePrefix;
+    // error of every detail level over all meshes
+    vector<float> lodErrors;
+    // meshes that draw in one glMultiDrawElementsBaseVertex: one pool, one index type, the same textures
+    vector<vector<unsigned int>> batches;
+    vector<GLsizei> drawCounts;
+    vector<const void*> drawOffsets;
+    vector<GLint> drawBaseVertices;
+    UniformHandle lodFadeUniform = INVALID_UNIFORM;
+    unsigned int lodFadeProgram = 0;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        PROFILE_SCOPE_DETAIL("Model::loadModel", path.c_str());
+        MeshCache data;
+        if (!importModel(path, data))
+            return;
+        for (unsigned int i = 0; i < data.submeshCount(); i++)
+            meshes.push_back(createMesh(data, i));
+        updateBounds();
+    }
+
+    // the model's mesh cache if it is current, else an Assimp import that writes one. No GL, so this can
+    // run on any thread
+    bool importModel(string const &path, MeshCache &data)
+    {
+        PROFILE_SCOPE_DETAIL("Model::importModel", path.c_str());
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        uint64_t sourceHash = 0;
+        bool hashed = MeshCache::hashFile(path, sourceHash);
+        if (hashed)
+        {
+            PROFILE_SCOPE("mesh cache");
+            if (data.open(MeshCache::pathFor(path), sourceHash, IMPORT_FLAGS, vertexFormat.key(), vertexFormat.stride()))
+                return true;
+        }
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene;
+        {
+            PROFILE_SCOPE("Assimp import");
+            scene = importer.ReadFile(path, IMPORT_FLAGS);
+        }
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        vector<MeshData> imported;
+        processNode(scene->mRootNode, scene, imported);
+        for (size_t m = 0; m < imported.size(); m++)
+        {
+            const MeshData &mesh = imported[m];
+            vector<string> types, paths;
+            for (const Texture &texture : mesh.textures)
+            {
+                types.push_back(texture.type);
+                paths.push_back(texture.path);
+            }
+            vector<unsigned char> packed = vertexFormat.pack(mesh.vertices.data(), mesh.vertices.size());
+            vector<glm::vec3> positions;
+            for (const Vertex &vertex : mesh.vertices)
+                positions.push_back(vertex.Position);
+            vector<uint32_t> indices(mesh.indices.begin(), mesh.indices.end());
+            {
+                PROFILE_SCOPE("mesh optimization");
+                MeshOptimizer::Stats before = MeshOptimizer::analyze(positions, indices);
+                MeshOptimizer::optimize(packed, vertexFormat.stride(), positions, indices);
+                MeshOptimizer::Stats after = MeshOptimizer::analyze(positions, indices);
+                cout << "Optimized " << path << " mesh " << m << ": "
+                     << before.vertices << " -> " << after.vertices << " vertices, ACMR "
+                     << before.acmr << " -> " << after.acmr << ", overdraw "
+                     << before.overdraw << " -> " << after.overdraw << endl;
+            }
+            vector<MeshSimplifier::Lod> chain;
+            {
+                PROFILE_SCOPE("mesh simplification");
+                chain = MeshSimplifier::buildChain(positions, indices);
+            }
+            // 16 bit indices whenever every vertex is reachable with them; the levels follow full detail
+            uint32_t indexSize = positions.size() <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+            vector<MeshCache::Lod> lods = {{0, (uint32_t) indices.size(), 0.0f}};
+            cout << "Detail levels of " << path << " mesh " << m << ": " << indices.size() / 3;
+            for (const MeshSimplifier::Lod &level : chain)
+            {
+                lods.push_back({(uint32_t) (indices.size() * indexSize), (uint32_t) level.indices.size(), level.error});
+                indices.insert(indices.end(), level.indices.begin(), level.indices.end());
+                cout << ", " << level.indices.size() / 3 << " (error " << level.error << ")";
+            }
+            cout << " triangles" << endl;
+            if (indexSize == sizeof(uint16_t))
+            {
+                vector<uint16_t> shortIndices(indices.begin(), indices.end());
+                data.add(packed.data(), positions.size(), shortIndices.data(), lods, indexSize,
+                         types, paths, mesh.bounds, mesh.sphere, vertexFormat.stride());
+            }
+            else
+                data.add(packed.data(), positions.size(), indices.data(), lods, indexSize,
+                         types, paths, mesh.bounds, mesh.sphere, vertexFormat.stride());
+        }
+        data.finish(sourceHash, IMPORT_FLAGS, vertexFormat.key(), vertexFormat.stride());
+        // the next start maps this instead of importing
+        if (hashed && !data.write(MeshCache::pathFor(path)))
+            cout << "Urk! Failed to write the mesh cache for " << path << "!" << endl;
+        return true;
+    }
+
+    // the model's sphere is centered on its box and reaches the farthest mesh sphere
+    void updateBounds()
+    {
+        bounds = Aabb();
+        sphere = BoundingSphere();
+        for (const Mesh &mesh : meshes)
+            bounds.add(mesh.bounds);
+        sphere.center = bounds.center();
+        for (const Mesh &mesh : meshes)
+            sphere.radius = std::max(sphere.radius, glm::length(mesh.sphere.center - sphere.center) + mesh.sphere.radius);
+        // a level's error is its worst mesh's, meshes without that many levels stay at their coarsest
+        lodErrors.clear();
+        for (const Mesh &mesh : meshes)
+            lodErrors.resize(std::max(lodErrors.size(), mesh.lods.size()), 0.0f);
+        for (const Mesh &mesh : meshes)
+            for (unsigned int level = 0; level < lodErrors.size(); level++)
+                lodErrors[level] = std::max(lodErrors[level], mesh.lods[std::min<size_t>(level, mesh.lods.size() - 1)].error);
+        lod = previousLod = 0;
+        lodFade = 1.0f;
+        updateBatches();
+    }
+
+    void updateBatches()
+    {
+        batches.clear();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            vector<unsigned int> *batch = nullptr;
+            for (vector<unsigned int> &candidate : batches)
+                if (sameBatch(meshes[candidate[0]], meshes[i]))
+                    batch = &candidate;
+            if (!batch)
+            {
+                batches.emplace_back();
+                batch = &batches.back();
+            }
+            batch->push_back(i);
+        }
+    }
+
+    static bool sameBatch(const Mesh &a, const Mesh &b)
+    {
+        if (a.pool != b.pool || a.indexType != b.indexType || a.textures.size() != b.textures.size())
+            return false;
+        for (unsigned int i = 0; i < a.textures.size(); i++)
+            if (a.textures[i].id != b.textures[i].id || a.textures[i].type != b.textures[i].type)
+                return false;
+        return true;
+    }
+
+    // one multi-draw per batch; the meshes share the pool's VAO, so there's one bind per format
+    void drawLevel(Shader &shader, unsigned int level)
+    {
+        for (const vector<unsigned int> &batch : batches)
+        {
+            Mesh &first = meshes[batch[0]];
+            drawCounts.clear();
+            drawOffsets.clear();
+            drawBaseVertices.clear();
+            for (unsigned int i : batch)
+                meshes[i].AddDraw(level, drawCounts, drawOffsets, drawBaseVertices);
+            first.BindTextures(shader);
+            first.pool->bind();
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), first.indexType, drawOffsets.data(),
+                                          (GLsizei) drawCounts.size(), drawBaseVertices.data());
+        }
+    }
+
+    // GL buffers and textures for a mesh, on the render thread
+    Mesh createMesh(const MeshCache &data, unsigned int i)
+    {
+        const MeshCache::Submesh &submesh = data.submesh(i);
+        vector<Texture> textures;
+        for (unsigned int j = submesh.firstTexture; j < submesh.firstTexture + submesh.textureCount; j++)
+        {
+            Texture texture;
+            texture.type = data.textureType(j);
+            texture.path = data.texturePath(j);
+            texture.id = textureFor(texture.path, texture.type);
+            textures.push_back(texture);
+        }
+        vector<MeshLod> lods;
+        for (unsigned int level = 0; level < submesh.lodCount; level++)
+        {
+            const MeshCache::Lod &lod = data.lod(i, level);
+            lods.push_back({lod.indexOffset, lod.indexCount, lod.error});
+        }
+        Mesh result(data.vertices(i), submesh.vertexCount, data.indices(i), submesh.indexBytes, submesh.indexSize,
+                    lods, textures, vertexFormat);
+        result.bounds = submesh.bounds;
+        result.sphere = submesh.sphere;
+        result.glslIdentifierPrefix = textureNamePrefix;
+        return result;
+    }
+
+    // one render thread step of a background load: meshes while the frame's budget lasts, then the swap
+    bool uploadMeshes(const MeshCache &data)
+    {
+        while (loadingMeshes.size() < data.submeshCount() && loader->timeLeft())
+            loadingMeshes.push_back(createMesh(data, loadingMeshes.size()));
+        if (loadingMeshes.size() < data.submeshCount())
+            return false;
+        for (Mesh &mesh : meshes)
+            mesh.Release();
+        meshes.swap(loadingMeshes);
+        loadingMeshes.clear();
+        updateBounds();
+        resident = true;
+        loader->endAsset();
+        return true;
+    }
+
+    // a sphere to draw until the meshes are in, with the loader's placeholder texture
+    void setPlaceholder(float radius)
+    {
+        const unsigned rings = 8, sectors = 16;
+        const float pi = 3.14159265f;
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        for (unsigned ring = 0; ring <= rings; ++ring)
+        {
+            float polar = pi * ring / rings;
+            for (unsigned sector = 0; sector <= sectors; ++sector)
+            {
+                float azimuth = 2.0f * pi * sector / sectors;
+                Vertex vertex;
+                vertex.Normal = glm::vec3(std::sin(polar) * std::cos(azimuth), std::cos(polar), std::sin(polar) * std::sin(azimuth));
+                vertex.Position = vertex.Normal * radius;
+                vertex.TexCoords = glm::vec2((float) sector / sectors, 1.0f - (float) ring / rings);
+                vertex.Tangent = glm::vec3(-std::sin(azimuth), 0.0f, std::cos(azimuth));
+                vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent);
+                vertices.push_back(vertex);
+            }
+        }
+        for (unsigned ring = 0; ring < rings; ++ring)
+        {
+            for (unsigned sector = 0; sector < sectors; ++sector)
+            {
+                unsigned first = ring * (sectors + 1) + sector, below = first + sectors + 1;
+                unsigned int quad[] = {first, below, first + 1, first + 1, below, below + 1};
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+        vector<Texture> textures = {
+                {loader->placeholderTexture(), "texture_diffuse", ""},
+                {loader->placeholderTexture(), "texture_specular", ""}
+        };
+        meshes.push_back(Mesh(vertices, indices, textures, vertexFormat));
+        meshes.back().bounds.add(glm::vec3(-radius));
+        meshes.back().bounds.add(glm::vec3(radius));
+        meshes.back().sphere.radius = radius;
+        updateBounds();
+        resident = false;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    void processNode(aiNode *node, const aiScene *scene, vector<MeshData> &data)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -81,17 +452,17 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            data.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, data);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
         vector<Vertex> vertices;
@@ -178,11 +549,26 @@ private:
 
 
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // bounds: the box first, then a sphere around its center through the farthest vertex
+        Aabb bounds;
+        for (const Vertex &vertex : vertices)
+            bounds.add(vertex.Position);
+        BoundingSphere sphere;
+        sphere.center = bounds.empty() ? glm::vec3(0.0f) : bounds.center();
+        for (const Vertex &vertex : vertices)
+            sphere.radius = std::max(sphere.radius, glm::length(vertex.Position - sphere.center));
+
+        // return the extracted mesh data, the render thread makes a mesh object of it
+        MeshData result;
+        result.vertices.swap(vertices);
+        result.indices.swap(indices);
+        result.textures.swap(textures);
+        result.bounds = bounds;
+        result.sphere = sphere;
+        return result;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
+    // lists all material textures of a given type, they get loaded when the mesh is created.
     // the required info is returned as a Texture struct.
     vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
@@ -191,28 +577,76 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
+        }
+        return textures;
+    }
+
+    // checks if the texture was loaded before and loads it if not, from a background model through the loader
+    unsigned int textureFor(const string &path, const string &type)
+    {
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(textures_loaded[j].path == path)
+                return textures_loaded[j].id; // a texture with the same filepath has already been loaded. (optimization)
+        }
+        Texture texture;
+        texture.id = TextureFromFile(path.c_str(), this->directory);
+        texture.type = type;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture.id;
+    }
+
+    // a background model asks for all of its textures at once, so the loader decodes them side by side
+    void requestTextures(const MeshCache &data)
+    {
+        vector<TextureDesc> descs;
+        vector<string> paths, types;
+        for (unsigned int i = 0; i < data.submeshCount(); i++)
+        {
+            const MeshCache::Submesh &submesh = data.submesh(i);
+            for (unsigned int j = submesh.firstTexture; j < submesh.firstTexture + submesh.textureCount; j++)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                string path = data.texturePath(j), type = data.textureType(j);
+                if (std::find(paths.begin(), paths.end(), path) != paths.end())
+                    continue;
+                TextureDesc desc;
+                desc.paths.push_back(directory + '/' + path);
+                // normal and height maps are data, not colors
+                desc.color = type == "texture_diffuse" || type == "texture_specular";
+                descs.push_back(desc);
+                paths.push_back(path);
+                types.push_back(type);
             }
         }
-        return textures;
+        if (descs.empty())
+            return;
+        vector<unsigned int> placeholders = loader->loadTextures(descs, [this, paths](unsigned int index, unsigned int id)
+        {
+            replaceTexture(paths[index], id);
+        });
+        for (unsigned int i = 0; i < paths.size(); i++)
+            textures_loaded.push_back(Texture{placeholders[i], types[i], paths[i]});
+    }
+
+    // a texture finished loading in the background, it takes over from its placeholder everywhere
+    void replaceTexture(const string &path, unsigned int id)
+    {
+        for (vector<Mesh> *list : {&meshes, &loadingMeshes})
+            for (Mesh &mesh : *list)
+                for (Texture &texture : mesh.textures)
+                    if (texture.path == path)
+                        texture.id = id;
+        for (Texture &texture : textures_loaded)
+            if (texture.path == path)
+                texture.id = id;
+        // meshes that differed only by placeholder may share a batch now, or the other way round
+        updateBatches();
     }
 };
 
@@ -226,7 +660,11 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     glGenTextures(1, &textureID);
 
     int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+    unsigned char *data;
+    {
+        PROFILE_SCOPE_DETAIL("stbi_load", filename.c_str());
+        data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+    }
     if (data)
     {
         GLenum format;
@@ -5,18 +5,27 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <common.h>
+
+#include <rg/CpuProfiler.h>
+#include <rg/UniformBuffers.h>
+#include <rg/UniformTable.h>
+
 class Shader
 {
 public:
     unsigned int ID;
     // constructor generates the shader on the fly
+    // feedbackVaryings are captured interleaved into transform feedback buffer 0, in the given order
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::vector<const char *> &feedbackVaryings = std::vector<const char *>())
     {
+        PROFILE_SCOPE_DETAIL("Shader compile", fragmentPath);
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
 
@@ -46,8 +55,8 @@ public:
             vShaderFile.close();
             fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
+            vertexCode = resolveIncludes(vShaderStream.str(), vertexPath);
+            fragmentCode = resolveIncludes(fShaderStream.str(), fragmentPath);
             // if geometry shader path is present, also load a geometry shader
             if(geometryPath != nullptr)
             {
@@ -57,7 +66,7 @@ public:
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = resolveIncludes(gShaderStream.str(), geometryPath);
             }
         }
         catch (std::ifstream::failure& e)
@@ -94,8 +103,12 @@ public:
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        if(!feedbackVaryings.empty())
+            glTransformFeedbackVaryings(ID, (GLsizei)feedbackVaryings.size(), feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        uniforms.reflect(ID);
+        bindUniformBlocks(ID);
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -109,66 +122,177 @@ public:
     { 
         glUseProgram(ID); 
     }
+    // bit n set for every active vertex attribute at location n below 32, what a mesh drawn with it has to provide
+    // ------------------------------------------------------------------------
+    unsigned int vertexAttributes() const
+    {
+        GLint count = 0;
+        glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &count);
+        unsigned int mask = 0;
+        for (GLint i = 0; i < count; i++)
+        {
+            char name[256];
+            GLint size;
+            GLenum type;
+            glGetActiveAttrib(ID, i, sizeof(name), nullptr, &size, &type, name);
+            GLint location = glGetAttribLocation(ID, name);
+            if (location >= 0 && location < 32)
+                mask |= 1u << location;
+        }
+        return mask;
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
+    // handle of an active uniform, resolve once and pass it to the setters on hot paths
+    UniformHandle uniform(const std::string &name) const
+    {
+        return uniforms.find(name);
+    }
+    // ------------------------------------------------------------------------
+    void setBool(UniformHandle handle, bool value) const
+    {
+        setInt(handle, (int)value);
+    }
     void setBool(const std::string &name, bool value) const
-    {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    {
+        setInt(uniforms.find(name), (int)value);
     }
     // ------------------------------------------------------------------------
+    void setInt(UniformHandle handle, int value) const
+    {
+        if (uniforms.changed(handle, &value, sizeof(value)))
+            glUniform1i(uniforms.location(handle), value);
+    }
     void setInt(const std::string &name, int value) const
-    { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    {
+        setInt(uniforms.find(name), value);
     }
     // ------------------------------------------------------------------------
+    void setFloat(UniformHandle handle, float value) const
+    {
+        if (uniforms.changed(handle, &value, sizeof(value)))
+            glUniform1f(uniforms.location(handle), value);
+    }
     void setFloat(const std::string &name, float value) const
-    { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+    {
+        setFloat(uniforms.find(name), value);
     }
     // ------------------------------------------------------------------------
+    void setVec2(UniformHandle handle, const glm::vec2 &value) const
+    {
+        if (uniforms.changed(handle, &value[0], sizeof(value)))
+            glUniform2fv(uniforms.location(handle), 1, &value[0]);
+    }
     void setVec2(const std::string &name, const glm::vec2 &value) const
-    { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    {
+        setVec2(uniforms.find(name), value);
     }
     void setVec2(const std::string &name, float x, float y) const
-    { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+    {
+        setVec2(uniforms.find(name), glm::vec2(x, y));
     }
     // ------------------------------------------------------------------------
+    void setVec3(UniformHandle handle, const glm::vec3 &value) const
+    {
+        if (uniforms.changed(handle, &value[0], sizeof(value)))
+            glUniform3fv(uniforms.location(handle), 1, &value[0]);
+    }
     void setVec3(const std::string &name, const glm::vec3 &value) const
-    { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    {
+        setVec3(uniforms.find(name), value);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
-    { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+    {
+        setVec3(uniforms.find(name), glm::vec3(x, y, z));
     }
     // ------------------------------------------------------------------------
+    void setVec4(UniformHandle handle, const glm::vec4 &value) const
+    {
+        if (uniforms.changed(handle, &value[0], sizeof(value)))
+            glUniform4fv(uniforms.location(handle), 1, &value[0]);
+    }
     void setVec4(const std::string &name, const glm::vec4 &value) const
-    { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    {
+        setVec4(uniforms.find(name), value);
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
-    { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+    void setVec4(const std::string &name, float x, float y, float z, float w) const
+    {
+        setVec4(uniforms.find(name), glm::vec4(x, y, z, w));
     }
     // ------------------------------------------------------------------------
+    void setMat2(UniformHandle handle, const glm::mat2 &mat) const
+    {
+        if (uniforms.changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix2fv(uniforms.location(handle), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(uniforms.find(name), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat3(UniformHandle handle, const glm::mat3 &mat) const
+    {
+        if (uniforms.changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix3fv(uniforms.location(handle), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(uniforms.find(name), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat4(UniformHandle handle, const glm::mat4 &mat) const
+    {
+        if (uniforms.changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix4fv(uniforms.location(handle), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniforms.find(name), mat);
     }
 
 private:
+    // active uniforms with the last uploaded values, the setters stay const for existing callers
+    mutable UniformTable uniforms;
+
+    // replaces #include "file" lines with the file's contents, the path is relative to the including file.
+    // a #line after every include keeps the including file's line numbers right in compile errors.
+    // ------------------------------------------------------------------------
+    static std::string resolveIncludes(const std::string &code, const std::string &path, int depth = 0)
+    {
+        std::string directory = path.substr(0, path.find_last_of('/') + 1);
+        std::istringstream lines(code);
+        std::string line, result;
+        int number = 0;
+        while (std::getline(lines, line))
+        {
+            ++number;
+            size_t directive = line.find("#include");
+            if (directive == std::string::npos || line.find_first_not_of(" \t") != directive)
+            {
+                result += line + '\n';
+                continue;
+            }
+            size_t open = line.find('"', directive);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            std::ifstream includeFile;
+            std::string includePath;
+            if (close != std::string::npos && depth < 8)
+            {
+                includePath = directory + line.substr(open + 1, close - open - 1);
+                includeFile.open(includePath);
+            }
+            if (!includeFile.is_open())
+            {
+                std::cout << "ERROR::SHADER::INCLUDE_FAILED in " << path << ": " << line << std::endl;
+                continue;
+            }
+            std::stringstream includeStream;
+            includeStream << includeFile.rdbuf();
+            result += resolveIncludes(includeStream.str(), includePath, depth + 1);
+            result += "#line " + std::to_string(number + 1) + "\n";
+        }
+        return result;
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type, const char *path = NULL)
@@ -0,0 +1,532 @@
+#ifndef PROJECT_BASE_ASSETLOADER_H
+#define PROJECT_BASE_ASSETLOADER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <rg/CpuProfiler.h>
+#include <rg/JobSystem.h>
+#include <rg/TextureCache.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// EXT_texture_compression_s3tc, which the GL 3.3 core loader doesn't know about
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+/* A texture to load: one image, or six cube map faces in GL's +x, -x, +y, -y, +z, -z order. */
+struct TextureDesc {
+    GLenum target = GL_TEXTURE_2D;
+    std::vector<std::string> paths;
+    GLint wrapS = GL_REPEAT, wrapT = GL_REPEAT, wrapR = GL_REPEAT;
+    GLint minFilter = GL_NEAREST_MIPMAP_LINEAR, magFilter = GL_LINEAR;
+    bool mipmaps = true;
+    // block compressed with a stored mip chain, converted on first load and cached next to the first image
+    bool compressed = true;
+    // whether the images are colors, whose mips average in linear light; false for normals, heights and such
+    bool color = true;
+    // the RGBA texel shown until the image is resident
+    unsigned char placeholder[4] = {128, 128, 128, 255};
+};
+
+/* Loads assets in the background and makes them resident on the render thread a slice at a time.
+ * Decoding and parsing run as jobs. What needs GL comes back as steps that update() calls on the render
+ * thread every frame until they report done, and only while the frame's time budget lasts. Textures stream
+ * in row bands through a small ring of pixel unpack buffers: each band is copied into a mapped buffer and
+ * handed to glTexSubImage2D, and a fence tells when that buffer may be written again, so the mapping never
+ * has to synchronize and the copy overlaps the GPU's transfer of the band before. Compressed textures are
+ * converted once, in the background, and kept in a TextureCache next to their source; from then on the
+ * cache is mapped and its levels go to glCompressedTexImage2D one at a time. Either way the image
+ * goes into a texture of its own; a 1x1 placeholder stands in for it until a last fence says the upload
+ * and mipmaps are done, then onResident gets the real texture and the placeholder is deleted.
+ * Whatever a request's callbacks capture has to outlive the loader or its finish(). */
+class AssetLoader {
+public:
+    // bytes per staging buffer, the largest band of rows uploaded at once; a single row has to fit
+    static const unsigned STAGING_SIZE = 4u << 20;
+    static const unsigned STAGING_BUFFERS = 4;
+
+    explicit AssetLoader(JobSystem &jobSystem) : jobs(jobSystem)
+    {
+    }
+
+    void create()
+    {
+        glGenBuffers(STAGING_BUFFERS, stagingBuffers);
+        for (unsigned i = 0; i < STAGING_BUFFERS; ++i) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffers[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, STAGING_SIZE, nullptr, GL_STREAM_DRAW);
+            stagingFences[i] = 0;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        unsigned char grey[4] = {128, 128, 128, 255};
+        placeholder = createPlaceholder(GL_TEXTURE_2D, grey);
+        // RGTC (BC4, BC5) is core, BC1 and BC3 come with the S3TC extension everybody has
+        GLint extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (GLint i = 0; i < extensions; ++i)
+            if (std::strcmp((const char *) glGetStringi(GL_EXTENSIONS, i), "GL_EXT_texture_compression_s3tc") == 0)
+                s3tc = true;
+    }
+
+    // waits for everything in flight first
+    void destroy()
+    {
+        finish();
+        for (GLsync &fence : stagingFences) {
+            if (fence)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+        glDeleteBuffers(STAGING_BUFFERS, stagingBuffers);
+        glDeleteTextures(1, &placeholder);
+    }
+
+    // a neutral 1x1 texture for anything that has nothing better to show yet
+    unsigned placeholderTexture() const
+    {
+        return placeholder;
+    }
+
+    /* Starts decoding the images and returns a placeholder texture to use meanwhile. onResident is called
+     * on the render thread with the loaded texture, which replaces the placeholder. If an image fails to
+     * load the placeholder stays for good. */
+    unsigned loadTexture(const TextureDesc &desc, std::function<void(unsigned)> onResident)
+    {
+        return loadTextures({desc}, [onResident](unsigned, unsigned texture) { onResident(texture); })[0];
+    }
+
+    /* The same for a batch, such as everything a scene or a model needs, returning the placeholders in
+     * order; onResident also gets the texture's index in descs. Every image of the batch is decoded from
+     * its mapped file as a job of its own, so a cold start spreads over all workers instead of decoding one
+     * image after the other. The batch is converted and handed to the render thread together. */
+    std::vector<unsigned> loadTextures(const std::vector<TextureDesc> &descs, std::function<void(unsigned, unsigned)> onResident)
+    {
+        std::vector<std::shared_ptr<TextureUpload>> batch;
+        std::vector<unsigned> placeholders;
+        for (unsigned i = 0; i < descs.size(); ++i) {
+            std::shared_ptr<TextureUpload> upload = std::make_shared<TextureUpload>();
+            upload->desc = descs[i];
+            upload->onResident = [onResident, i](unsigned texture) { onResident(i, texture); };
+            upload->placeholder = createPlaceholder(descs[i].target, descs[i].placeholder);
+            placeholders.push_back(upload->placeholder);
+            batch.push_back(upload);
+            beginAsset();
+        }
+        background([this, batch] { loadBatch(batch); });
+        return placeholders;
+    }
+
+    // runs work as a background job
+    void background(std::function<void()> work)
+    {
+        jobs.run(std::move(work), backgroundJobs);
+    }
+
+    // queues a step for the render thread, from any thread; it is called every update() until it returns true
+    void schedule(std::function<bool()> step)
+    {
+        std::lock_guard<std::mutex> lock(incomingMutex);
+        incoming.push_back(std::move(step));
+    }
+
+    // assets count themselves in while loading, pending() is what's still on its way
+    void beginAsset()
+    {
+        pendingAssets.fetch_add(1);
+    }
+
+    void endAsset()
+    {
+        pendingAssets.fetch_sub(1);
+    }
+
+    unsigned pending() const
+    {
+        return pendingAssets.load();
+    }
+
+    // render thread, once per frame: runs the steps in order until budgetMs is spent
+    void update(double budgetMs)
+    {
+        PROFILE_SCOPE("asset uploads");
+        deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(budgetMs));
+        {
+            std::lock_guard<std::mutex> lock(incomingMutex);
+            steps.splice(steps.end(), incoming);
+        }
+        for (auto it = steps.begin(); it != steps.end() && timeLeft();) {
+            if ((*it)())
+                it = steps.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // whether the current update() still has budget, for steps that do their work in slices
+    bool timeLeft() const
+    {
+        return Clock::now() < deadline;
+    }
+
+    // render thread: blocks until every asset is resident
+    void finish()
+    {
+        while (pending() > 0) {
+            update(1000.0);
+            std::this_thread::yield();
+        }
+        jobs.wait(backgroundJobs);
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct ImageFree {
+        void operator()(unsigned char *pixels) const
+        {
+            stbi_image_free(pixels);
+        }
+    };
+
+    struct Image {
+        std::unique_ptr<unsigned char, ImageFree> pixels;
+        int width = 0, height = 0, channels = 0;
+    };
+
+    struct TextureUpload {
+        TextureDesc desc;
+        std::function<void(unsigned)> onResident;
+        unsigned placeholder = 0;
+        std::vector<Image> images;
+        // set instead of images when the texture is block compressed
+        std::unique_ptr<TextureCache> compressed;
+        bool cacheable = false;
+        uint64_t cacheKey = FNV_OFFSET;
+        unsigned texture = 0;
+        // the next band or level to upload
+        unsigned face = 0;
+        int row = 0;
+        unsigned level = 0;
+        // set once the last band and the mipmaps are queued
+        GLsync done = 0;
+    };
+
+    JobSystem &jobs;
+    JobCounter backgroundJobs;
+    std::atomic<unsigned> pendingAssets{0};
+    std::mutex incomingMutex;
+    std::list<std::function<bool()>> incoming;
+    // render thread only from here on
+    std::list<std::function<bool()>> steps;
+    Clock::time_point deadline;
+    unsigned stagingBuffers[STAGING_BUFFERS];
+    GLsync stagingFences[STAGING_BUFFERS];
+    unsigned placeholder = 0;
+    bool s3tc = false;
+
+    static GLenum pixelFormat(int channels)
+    {
+        return channels == 1 ? GL_RED : channels == 2 ? GL_RG : channels == 3 ? GL_RGB : GL_RGBA;
+    }
+
+    static unsigned createPlaceholder(GLenum target, const unsigned char *texel)
+    {
+        unsigned texture;
+        glGenTextures(1, &texture);
+        glBindTexture(target, texture);
+        unsigned faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+        for (unsigned face = 0; face < faces; ++face)
+            glTexImage2D(target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target, 0, GL_RGBA, 1, 1, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, texel);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        return texture;
+    }
+
+    // a staging buffer the GPU is done reading from, or -1
+    int acquireStaging()
+    {
+        for (unsigned i = 0; i < STAGING_BUFFERS; ++i) {
+            if (stagingFences[i]) {
+                GLenum state = glClientWaitSync(stagingFences[i], 0, 0);
+                if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+                    continue;
+                glDeleteSync(stagingFences[i]);
+                stagingFences[i] = 0;
+            }
+            return (int) i;
+        }
+        return -1;
+    }
+
+    static GLenum compressedFormat(BlockFormat format)
+    {
+        switch (format) {
+            case BlockFormat::BC1:
+                return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case BlockFormat::BC3:
+                return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case BlockFormat::BC4:
+                return GL_COMPRESSED_RED_RGTC1;
+            case BlockFormat::BC5:
+                break;
+        }
+        return GL_COMPRESSED_RG_RGTC2;
+    }
+
+    bool supported(BlockFormat format) const
+    {
+        return s3tc || format == BlockFormat::BC4 || format == BlockFormat::BC5;
+    }
+
+    // hashes the images and the options that change what conversion makes of them
+    static bool cacheKey(const TextureDesc &desc, uint64_t &key)
+    {
+        for (const std::string &path : desc.paths)
+            if (!MappedFile::hash(path, key))
+                return false;
+        uint32_t options[] = {desc.mipmaps, desc.color};
+        key = fnv1a(options, sizeof(options), key);
+        return true;
+    }
+
+    // background: cached textures are mapped, the others decoded image by image in parallel and converted
+    void loadBatch(const std::vector<std::shared_ptr<TextureUpload>> &batch)
+    {
+        std::vector<std::pair<TextureUpload *, unsigned>> decodes;
+        for (const std::shared_ptr<TextureUpload> &upload : batch) {
+            if (openCache(*upload))
+                continue;
+            upload->images.resize(upload->desc.paths.size());
+            for (unsigned i = 0; i < upload->images.size(); ++i)
+                decodes.emplace_back(upload.get(), i);
+        }
+        jobs.parallelFor((unsigned) decodes.size(), 1, [&decodes](unsigned begin, unsigned end) {
+            for (unsigned i = begin; i < end; ++i)
+                decode(decodes[i].first->desc.paths[decodes[i].second], decodes[i].first->images[decodes[i].second]);
+        });
+        jobs.parallelFor((unsigned) batch.size(), 1, [this, &batch](unsigned begin, unsigned end) {
+            for (unsigned i = begin; i < end; ++i)
+                convert(*batch[i]);
+        });
+        for (const std::shared_ptr<TextureUpload> &upload : batch) {
+            if (upload->compressed || decoded(*upload)) {
+                std::shared_ptr<TextureUpload> ready = upload;
+                schedule([this, ready] { return streamTexture(*ready); });
+            } else {
+                schedule([this] {
+                    endAsset();
+                    return true;
+                });
+            }
+        }
+    }
+
+    // maps the texture's cache if it is current
+    bool openCache(TextureUpload &upload)
+    {
+        const TextureDesc &desc = upload.desc;
+        upload.cacheable = desc.compressed && cacheKey(desc, upload.cacheKey);
+        if (!upload.cacheable)
+            return false;
+        std::string cachePath = TextureCache::pathFor(desc.paths[0]);
+        PROFILE_SCOPE_DETAIL("texture cache", cachePath.c_str());
+        upload.compressed.reset(new TextureCache);
+        if (upload.compressed->open(cachePath, upload.cacheKey) && supported(upload.compressed->format()))
+            return true;
+        upload.compressed.reset();
+        return false;
+    }
+
+    static void decode(const std::string &path, Image &image)
+    {
+        PROFILE_SCOPE_DETAIL("stbi_load", path.c_str());
+        MappedFile file;
+        if (file.open(path))
+            image.pixels.reset(stbi_load_from_memory(file.data(), (int) file.size(), &image.width, &image.height,
+                                                     &image.channels, 0));
+        if (!image.pixels)
+            std::cerr << "Urk! Failed to load " << path << "!" << std::endl;
+    }
+
+    static bool decoded(const TextureUpload &upload)
+    {
+        for (const Image &image : upload.images)
+            if (!image.pixels)
+                return false;
+        return !upload.images.empty();
+    }
+
+    // the first decode of a cacheable texture writes its cache
+    void convert(TextureUpload &upload)
+    {
+        if (upload.compressed || !upload.cacheable || !decoded(upload) || !compress(upload, upload.cacheKey))
+            return;
+        std::string cachePath = TextureCache::pathFor(upload.desc.paths[0]);
+        if (!upload.compressed->write(cachePath))
+            std::cerr << "Urk! Failed to write the texture cache " << cachePath << "!" << std::endl;
+    }
+
+    /* Background: compresses the decoded images and their mips into upload.compressed, the faces and the
+     * block rows of the big levels in parallel. Images that don't fit a supported format stay as they are. */
+    bool compress(TextureUpload &upload, uint64_t key)
+    {
+        std::vector<Image> &images = upload.images;
+        const Image &first = images[0];
+        BlockFormat format = BlockFormat::BC1;
+        for (const Image &image : images) {
+            if (image.width != first.width || image.height != first.height || image.channels != first.channels)
+                return false;
+            BlockFormat chosen = TextureCompressor::chooseFormat(image.pixels.get(), image.width, image.height, image.channels);
+            if (chosen != BlockFormat::BC1)
+                format = chosen;
+        }
+        if (!supported(format))
+            return false;
+        PROFILE_SCOPE_DETAIL("texture compression", upload.desc.paths[0].c_str());
+        unsigned levels = upload.desc.mipmaps ? TextureCompressor::levelCount(first.width, first.height) : 1;
+        std::unique_ptr<TextureCache> cache(new TextureCache);
+        cache->create(key, format, first.width, first.height, (unsigned) images.size(), levels);
+        bool color = upload.desc.color;
+        jobs.parallelFor((unsigned) images.size(), 1, [&](unsigned begin, unsigned end) {
+            for (unsigned face = begin; face < end; ++face) {
+                const Image &image = images[face];
+                std::vector<unsigned char> mip;
+                const unsigned char *pixels = image.pixels.get();
+                for (unsigned level = 0; level < levels; ++level) {
+                    unsigned width = cache->width(level), height = cache->height(level);
+                    unsigned char *out = cache->writableLevel(face, level);
+                    jobs.parallelFor((height + 3) / 4, 32, [&](unsigned firstRow, unsigned lastRow) {
+                        TextureCompressor::compress(pixels, width, height, image.channels, format, firstRow, lastRow, out);
+                    });
+                    if (level + 1 < levels) {
+                        std::vector<unsigned char> next = TextureCompressor::downsample(pixels, width, height, image.channels, color);
+                        mip.swap(next);
+                        pixels = mip.data();
+                    }
+                }
+            }
+        });
+        images.clear();
+        upload.compressed = std::move(cache);
+        return true;
+    }
+
+    bool streamTexture(TextureUpload &upload)
+    {
+        const TextureDesc &desc = upload.desc;
+        if (upload.done) {
+            GLenum state = glClientWaitSync(upload.done, 0, 0);
+            if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+                return false;
+            glDeleteSync(upload.done);
+            upload.onResident(upload.texture);
+            glDeleteTextures(1, &upload.placeholder);
+            endAsset();
+            return true;
+        }
+
+        if (!(upload.compressed ? streamLevels(upload) : streamBands(upload)))
+            return false;
+
+        glBindTexture(desc.target, upload.texture);
+        if (desc.mipmaps && !upload.compressed)
+            glGenerateMipmap(desc.target);
+        glTexParameteri(desc.target, GL_TEXTURE_WRAP_S, desc.wrapS);
+        glTexParameteri(desc.target, GL_TEXTURE_WRAP_T, desc.wrapT);
+        glTexParameteri(desc.target, GL_TEXTURE_WRAP_R, desc.wrapR);
+        glTexParameteri(desc.target, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+        glTexParameteri(desc.target, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+        if (upload.compressed)
+            glTexParameteri(desc.target, GL_TEXTURE_MAX_LEVEL, upload.compressed->levels() - 1);
+        upload.compressed.reset();
+        upload.done = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        return false;
+    }
+
+    // compressed levels straight from the cache, one at a time while the budget lasts
+    bool streamLevels(TextureUpload &upload)
+    {
+        const TextureDesc &desc = upload.desc;
+        const TextureCache &cache = *upload.compressed;
+        bool cube = desc.target == GL_TEXTURE_CUBE_MAP;
+        if (!upload.texture)
+            glGenTextures(1, &upload.texture);
+        glBindTexture(desc.target, upload.texture);
+        while (upload.face < cache.faces() && timeLeft()) {
+            glCompressedTexImage2D(cube ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + upload.face : desc.target, upload.level,
+                                   compressedFormat(cache.format()), cache.width(upload.level), cache.height(upload.level), 0,
+                                   (GLsizei) cache.levelSize(upload.face, upload.level), cache.level(upload.face, upload.level));
+            if (++upload.level == cache.levels()) {
+                upload.level = 0;
+                ++upload.face;
+            }
+        }
+        return upload.face == cache.faces();
+    }
+
+    // decoded images in row bands through the staging buffers
+    bool streamBands(TextureUpload &upload)
+    {
+        const TextureDesc &desc = upload.desc;
+        bool cube = desc.target == GL_TEXTURE_CUBE_MAP;
+        if (!upload.texture) {
+            glGenTextures(1, &upload.texture);
+            glBindTexture(desc.target, upload.texture);
+            for (unsigned face = 0; face < upload.images.size(); ++face) {
+                const Image &image = upload.images[face];
+                GLenum format = pixelFormat(image.channels);
+                glTexImage2D(cube ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : desc.target, 0, format, image.width, image.height, 0,
+                             format, GL_UNSIGNED_BYTE, nullptr);
+            }
+        }
+
+        glBindTexture(desc.target, upload.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        while (upload.face < upload.images.size() && timeLeft()) {
+            int staging = acquireStaging();
+            if (staging < 0)
+                break;
+            Image &image = upload.images[upload.face];
+            size_t rowBytes = (size_t) image.width * image.channels;
+            int rows = std::min(image.height - upload.row, std::max(1, (int) (STAGING_SIZE / rowBytes)));
+            size_t bytes = rowBytes * rows;
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffers[staging]);
+            // the buffer's fence has passed, nothing reads it any more
+            void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            std::memcpy(mapped, image.pixels.get() + rowBytes * upload.row, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glTexSubImage2D(cube ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + upload.face : desc.target, 0, 0, upload.row,
+                            image.width, rows, pixelFormat(image.channels), GL_UNSIGNED_BYTE, nullptr);
+            stagingFences[staging] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            upload.row += rows;
+            if (upload.row == image.height) {
+                image.pixels.reset();
+                ++upload.face;
+                upload.row = 0;
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        return upload.face == upload.images.size();
+    }
+};
+
+#endif //PROJECT_BASE_ASSETLOADER_H
@@ -0,0 +1,73 @@
+#ifndef PROJECT_BASE_ASTEROIDBELT_H
+#define PROJECT_BASE_ASTEROIDBELT_H
+
+#include <glm/glm.hpp>
+
+#include <rg/BodyStore.h>
+#include <rg/Kepler.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+enum BeltMesh {
+    SHARD_MESH,
+    ROCK_MESH,
+    BELT_MESH_COUNT
+};
+
+/* A ring of rocks around the sun, between the tetrahedra and the edge of the skybox, as bodies in a
+ * BodyStore and their orbits in KeplerOrbits, body i on orbit i. The generator is seeded, so the same count
+ * always gives the same belt and benchmark runs stay comparable. Every rockEvery-th rock is a mercury
+ * model, the rest are tetrahedron shards. Each rock is on a slightly eccentric, slightly tilted orbit with
+ * the period its distance gives it (inner rocks overtake outer ones) and tumbles around its own axis. */
+struct AsteroidBelt {
+    float innerRadius = 14.0f;
+    float outerRadius = 22.0f;
+    float thickness = 0.6f;
+    float maxEccentricity = 0.05f;
+    // orbit rate times radius^1.5, about five minutes a lap through the middle of the belt
+    float orbitConstant = 1.6f;
+    unsigned rockEvery = 8;
+    unsigned seed = 1337;
+
+    void generate(unsigned count, BodyStore &bodies, KeplerOrbits &orbits) const
+    {
+        bodies.clear();
+        bodies.reserve(count);
+        orbits.clear();
+        orbits.reserve(count);
+
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::normal_distribution<float> height(0.0f, thickness);
+        for (unsigned i = 0; i < count; ++i) {
+            BodyDesc body;
+            body.mesh = i % rockEvery == 0 ? ROCK_MESH : SHARD_MESH;
+            OrbitalElements orbit;
+            // sqrt keeps the density even over the ring's area instead of bunching up on the inside
+            float r2 = innerRadius * innerRadius + unit(random) * (outerRadius * outerRadius - innerRadius * innerRadius);
+            orbit.semiMajorAxis = std::sqrt(r2);
+            orbit.eccentricity = maxEccentricity * unit(random);
+            // tilts that lift the rocks about thickness out of the plane
+            orbit.inclination = std::abs(height(random)) / orbit.semiMajorAxis;
+            orbit.ascendingNode = unit(random) * 6.2831853f;
+            orbit.argumentOfPeriapsis = unit(random) * 6.2831853f;
+            orbit.meanAnomaly = unit(random) * 6.2831853f;
+            orbit.period = 6.2831853f * orbit.semiMajorAxis * std::sqrt(orbit.semiMajorAxis) / orbitConstant;
+            orbits.add(orbit);
+            // separate draws, argument order would differ between compilers
+            float axisX = unit(random), axisY = unit(random), axisZ = unit(random);
+            body.spinAxis = glm::normalize(glm::vec3(axisX, axisY, axisZ) - 0.5f + 1e-4f);
+            body.spinPhase = unit(random) * 6.2831853f;
+            body.spinRate = 2.0f * unit(random) - 1.0f;
+            body.scale = body.mesh == ROCK_MESH ? 0.15f + 0.45f * unit(random) : 0.05f + 0.15f * unit(random);
+            // dusty greys with a little warmth, so neighbours don't look copy pasted
+            float shade = 0.55f + 0.45f * unit(random);
+            body.tint = glm::vec4(shade, shade * (0.9f + 0.1f * unit(random)), shade * 0.85f, 1.0f);
+            bodies.add(body);
+        }
+    }
+};
+
+#endif //PROJECT_BASE_ASTEROIDBELT_H
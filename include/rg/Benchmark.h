@@ -0,0 +1,412 @@
+#ifndef PROJECT_BASE_BENCHMARK_H
+#define PROJECT_BASE_BENCHMARK_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/camera.h>
+#include <rg/Bvh.h>
+#include <rg/CpuProfiler.h>
+#include <rg/GlCallCounter.h>
+#include <rg/GpuProfiler.h>
+#include <rg/JobSystem.h>
+#include <rg/Kepler.h>
+#include <rg/NBody.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/* Command line of the headless benchmark mode.
+ *   --headless          render offscreen without a display (GLFW null platform, EGL surfaceless or OSMesa)
+ *   --frames N          measured frames, 600 by default
+ *   --warmup N          frames rendered before measuring, 30 by default
+ *   --size WxH          render size, 1280x720 by default
+ *   --dt SECONDS        fixed simulation step, 1/60 by default
+ *   --report PATH       JSON report, benchmark.json by default
+ *   --bench-bvh N       no rendering, times refitting and culling a BVH of N objects for --frames frames
+ *   --bench-nbody N     no rendering, n-body steps per second for up to N bodies and 1 to --threads threads
+ *   --bench-jobs N      no rendering, job system overhead for N jobs and scaling from 1 to --threads threads
+ *   --threads N         worker threads counting the main thread, one per hardware thread by default */
+struct BenchmarkSettings {
+    bool headless = false;
+    unsigned frames = 600;
+    unsigned warmupFrames = 30;
+    unsigned width = 1280, height = 720;
+    float dt = 1.0f / 60.0f;
+    std::string reportPath = "benchmark.json";
+    unsigned bvhObjects = 0;
+    unsigned nbodyBodies = 0;
+    unsigned jobCount = 0;
+    unsigned threads = 0;
+
+    // false on anything it doesn't understand, after printing the usage
+    bool parse(int argc, char **argv)
+    {
+        for (int i = 1; i < argc; ++i) {
+            const char *arg = argv[i];
+            const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+            if (std::strcmp(arg, "--headless") == 0) {
+                headless = true;
+                continue;
+            }
+            if (!value)
+                return usage(arg);
+            ++i;
+            if (std::strcmp(arg, "--frames") == 0)
+                frames = (unsigned) std::strtoul(value, nullptr, 10);
+            else if (std::strcmp(arg, "--warmup") == 0)
+                warmupFrames = (unsigned) std::strtoul(value, nullptr, 10);
+            else if (std::strcmp(arg, "--dt") == 0)
+                dt = std::strtof(value, nullptr);
+            else if (std::strcmp(arg, "--report") == 0)
+                reportPath = value;
+            else if (std::strcmp(arg, "--bench-bvh") == 0)
+                bvhObjects = (unsigned) std::strtoul(value, nullptr, 10);
+            else if (std::strcmp(arg, "--bench-nbody") == 0)
+                nbodyBodies = (unsigned) std::strtoul(value, nullptr, 10);
+            else if (std::strcmp(arg, "--bench-jobs") == 0)
+                jobCount = (unsigned) std::strtoul(value, nullptr, 10);
+            else if (std::strcmp(arg, "--threads") == 0)
+                threads = (unsigned) std::strtoul(value, nullptr, 10);
+            else if (std::strcmp(arg, "--size") != 0 || std::sscanf(value, "%ux%u", &width, &height) != 2)
+                return usage(arg);
+        }
+        if (frames == 0 || width == 0 || height == 0 || dt <= 0.0f)
+            return usage("a zero frame count, size or dt");
+        return true;
+    }
+
+private:
+    static bool usage(const char *offending)
+    {
+        std::cerr << "Urk! Can't make sense of " << offending << "!" << std::endl
+                  << "usage: project_base [--headless] [--frames N] [--warmup N] [--size WxH] [--dt SECONDS] "
+                     "[--report PATH] [--bench-bvh N] [--bench-nbody N] [--bench-jobs N] "
+                     "[--threads N]" << std::endl;
+        return false;
+    }
+};
+
+/* Looping Catmull-Rom path through camera positions, each looking at its own target.
+ * Time maps to the path directly, so with a fixed dt every run sees the same frames. */
+class CameraPath {
+public:
+    struct Key {
+        glm::vec3 position;
+        glm::vec3 target;
+    };
+
+    float secondsPerKey = 2.5f;
+
+    // a lap around the system: the default view, a pass over the sun, the tetrahedra and Mercury's orbit
+    CameraPath()
+    {
+        keys = {
+                { glm::vec3(0.0f, 0.0f, 5.7f), glm::vec3(0.0f) },
+                { glm::vec3(7.0f, 2.5f, 7.0f), glm::vec3(0.0f) },
+                { glm::vec3(12.0f, 1.0f, -2.0f), glm::vec3(9.0f, 0.0f, -7.794229f) },
+                { glm::vec3(0.0f, 6.0f, -13.0f), glm::vec3(0.0f) },
+                { glm::vec3(-12.0f, 1.0f, -2.0f), glm::vec3(-9.0f, 0.0f, -7.794229f) },
+                { glm::vec3(-4.0f, 0.5f, 4.0f), glm::vec3(0.0f, 0.0f, 7.794229f) },
+                { glm::vec3(3.0f, 0.3f, 3.0f), glm::vec3(0.0f) },
+        };
+    }
+
+    void apply(Camera &camera, float time) const
+    {
+        float t = time / secondsPerKey;
+        int segment = (int) std::floor(t);
+        float f = t - (float) segment;
+
+        glm::vec3 position = interpolate(segment, f, &Key::position);
+        glm::vec3 target = interpolate(segment, f, &Key::target);
+        glm::vec3 direction = glm::normalize(target - position);
+        camera.Position = position;
+        camera.SetOrientation(glm::degrees(std::atan2(direction.z, direction.x)),
+                              glm::degrees(std::asin(direction.y)));
+    }
+
+private:
+    std::vector<Key> keys;
+
+    glm::vec3 interpolate(int segment, float f, glm::vec3 Key::*member) const
+    {
+        int n = (int) keys.size();
+        auto at = [&](int i) { return keys[((i % n) + n) % n].*member; };
+        glm::vec3 p0 = at(segment - 1), p1 = at(segment), p2 = at(segment + 1), p3 = at(segment + 2);
+        float f2 = f * f, f3 = f2 * f;
+        return 0.5f * (2.0f * p1 + (p2 - p0) * f + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * f2 +
+                       (3.0f * p1 - p0 - 3.0f * p2 + p3) * f3);
+    }
+};
+
+/* Collects per frame wall times and GL call counts of the measured frames and writes the JSON report.
+ * In headless mode every frame ends with glFinish, so the wall time covers the whole frame's GPU work. */
+class BenchmarkReport {
+public:
+    void addFrame(float frameMs)
+    {
+        frameTimes.push_back(frameMs);
+        for (unsigned i = 0; i < GlCallCounter::COUNTER_COUNT; ++i)
+            totals[i] += GlCallCounter::counts()[i];
+    }
+
+    bool write(const BenchmarkSettings &settings, const std::string &renderer, GpuProfiler &profiler) const
+    {
+        std::ofstream out(settings.reportPath);
+        if (!out)
+            return false;
+
+        std::vector<float> sorted = frameTimes;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (float ms : sorted)
+            sum += ms;
+        double frames = sorted.empty() ? 1.0 : (double) sorted.size();
+        double averageMs = sum / frames;
+
+        out << "{\n";
+        out << "  \"renderer\": \"" << CpuProfiler::escape(renderer) << "\",\n";
+        out << "  \"width\": " << settings.width << ", \"height\": " << settings.height << ",\n";
+        out << "  \"frames\": " << sorted.size() << ", \"warmupFrames\": " << settings.warmupFrames
+            << ", \"dt\": " << settings.dt << ",\n";
+        out << "  \"frameMs\": { \"average\": " << averageMs << ", \"min\": " << percentile(sorted, 0.0f)
+            << ", \"p50\": " << percentile(sorted, 0.5f) << ", \"p90\": " << percentile(sorted, 0.9f)
+            << ", \"p95\": " << percentile(sorted, 0.95f) << ", \"p99\": " << percentile(sorted, 0.99f)
+            << ", \"max\": " << percentile(sorted, 1.0f) << " },\n";
+        out << "  \"fps\": " << (averageMs > 0.0 ? 1000.0 / averageMs : 0.0) << ",\n";
+
+        // the pass percentiles cover the profiler's rolling window, the averages the whole run
+        out << "  \"passes\": [";
+        const std::vector<GpuProfiler::ScopeStats> &scopes = profiler.stats();
+        for (size_t i = 0; i < scopes.size(); ++i) {
+            const GpuProfiler::ScopeStats &scope = scopes[i];
+            out << (i ? "," : "") << "\n    { \"name\": \"" << CpuProfiler::escape(scope.name) << "\", \"depth\": " << scope.depth
+                << ", \"averageMs\": " << scope.runAverageMs << ", \"p50Ms\": " << scope.p50Ms
+                << ", \"p95Ms\": " << scope.p95Ms << ", \"p99Ms\": " << scope.p99Ms
+                << ", \"samples\": " << scope.runSamples << " }";
+        }
+        out << "\n  ],\n";
+
+        out << "  \"perFrame\": {";
+        for (unsigned i = 0; i < GlCallCounter::COUNTER_COUNT; ++i)
+            out << (i ? "," : "") << " \"" << GlCallCounter::name((GlCallCounter::Counter) i) << "\": "
+                << totals[i] / frames;
+        out << " }\n}\n";
+        return (bool) out;
+    }
+
+private:
+    std::vector<float> frameTimes;
+    unsigned long long totals[GlCallCounter::COUNTER_COUNT] = {};
+
+    static float percentile(const std::vector<float> &sorted, float p)
+    {
+        if (sorted.empty())
+            return 0.0f;
+        return sorted[(size_t) (p * (sorted.size() - 1) + 0.5f)];
+    }
+};
+
+/* Culling cost of a scene of many small objects: a tenth of them move every frame, then the tree is refit
+ * and culled against a camera looking around from the middle of the field. The culled set is checked
+ * against testing every box on its own. Returns the process exit code. */
+inline int runBvhBenchmark(const BenchmarkSettings &settings)
+{
+    typedef std::chrono::steady_clock Clock;
+    auto micros = [](Clock::time_point begin, Clock::time_point end) {
+        return std::chrono::duration<double, std::micro>(end - begin).count();
+    };
+    std::mt19937 random(1337);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f), size(0.2f, 2.0f), unit(-1.0f, 1.0f);
+
+    unsigned count = settings.bvhObjects;
+    std::vector<Aabb> boxes(count);
+    Bvh bvh;
+    for (Aabb &box : boxes) {
+        float x = position(random), y = position(random), z = position(random);
+        glm::vec3 center(x, y, z);
+        box.add(center - size(random));
+        box.add(center + size(random));
+        bvh.add(box);
+    }
+    Clock::time_point begin = Clock::now();
+    bvh.build();
+    double buildUs = micros(begin, Clock::now());
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+    std::vector<unsigned> visible;
+    std::vector<double> refitUs, cullUs;
+    unsigned long long visibleTotal = 0;
+    bool matches = true;
+    for (unsigned frame = 0; frame < settings.frames; ++frame) {
+        for (unsigned i = 0; i < count / 10; ++i) {
+            unsigned object = random() % count;
+            float x = unit(random), y = unit(random), z = unit(random);
+            glm::vec3 step(x, y, z);
+            boxes[object].min += step;
+            boxes[object].max += step;
+            bvh.update(object, boxes[object]);
+        }
+        float angle = frame * settings.dt * 0.5f;
+        Frustum frustum(projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(std::cos(angle), 0.2f * std::sin(3.0f * angle),
+                                                                         std::sin(angle)), glm::vec3(0.0f, 1.0f, 0.0f)));
+        Clock::time_point refitBegin = Clock::now();
+        bvh.refit();
+        Clock::time_point cullBegin = Clock::now();
+        bvh.cull(frustum, visible);
+        Clock::time_point cullEnd = Clock::now();
+        refitUs.push_back(micros(refitBegin, cullBegin));
+        cullUs.push_back(micros(cullBegin, cullEnd));
+        visibleTotal += visible.size();
+
+        if (frame % 64 == 0) {
+            size_t expected = 0;
+            for (const Aabb &box : boxes)
+                expected += frustum.intersects(box);
+            matches = matches && expected == visible.size();
+        }
+    }
+
+    auto report = [](const char *name, std::vector<double> &times) {
+        std::sort(times.begin(), times.end());
+        double sum = 0.0;
+        for (double t : times)
+            sum += t;
+        std::cout << name << ": average " << sum / times.size() << " us, p99 "
+                  << times[(size_t) (0.99 * (times.size() - 1))] << " us" << std::endl;
+    };
+    std::cout << "BVH of " << count << " objects, " << bvh.nodeCount() << " nodes, built in " << buildUs << " us"
+              << std::endl;
+    report("refit", refitUs);
+    report("cull", cullUs);
+    std::cout << "visible on average: " << visibleTotal / settings.frames << std::endl;
+    if (!matches) {
+        std::cerr << "Urk! The BVH disagrees with testing every object!" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+/* Steps per second of the n-body simulation for a disc of N/16, N/4 and N bodies around a heavy center,
+ * with 1, 2, 4 ... threads up to --threads. Every run starts from the same disc. */
+inline int runNBodyBenchmark(const BenchmarkSettings &settings)
+{
+    typedef std::chrono::steady_clock Clock;
+    const unsigned steps = 10;
+    unsigned maxThreads = settings.threads ? settings.threads : std::max(std::thread::hardware_concurrency(), 1u);
+    JobSystem jobs;
+
+    std::cout << "bodies";
+    for (unsigned threads = 1; threads < maxThreads * 2; threads *= 2)
+        std::cout << "\t" << std::min(threads, maxThreads) << " threads";
+    std::cout << "\t(steps per second)" << std::endl;
+    for (unsigned count : {settings.nbodyBodies / 16, settings.nbodyBodies / 4, settings.nbodyBodies}) {
+        if (count == 0)
+            continue;
+        std::cout << count;
+        for (unsigned threads = 1; threads < maxThreads * 2; threads *= 2) {
+            jobs.resize(std::min(threads, maxThreads));
+            NBody simulation(jobs);
+            simulation.timeStep = settings.dt;
+            std::mt19937 random(1337);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            std::normal_distribution<float> height(0.0f, 0.5f);
+            simulation.add(glm::vec3(0.0f), glm::vec3(0.0f), 10.0f);
+            for (unsigned i = 1; i < count; ++i) {
+                float radius = 4.0f + 20.0f * unit(random), angle = 6.2831853f * unit(random);
+                glm::vec3 position(radius * std::cos(angle), height(random), radius * std::sin(angle));
+                glm::vec3 along(-std::sin(angle), 0.0f, std::cos(angle));
+                simulation.add(position, along * std::sqrt(10.0f / radius), 1.0f / count);
+            }
+            // the first step also computes the starting accelerations
+            simulation.step();
+            Clock::time_point begin = Clock::now();
+            for (unsigned step = 0; step < steps; ++step)
+                simulation.step();
+            double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+            std::cout << "\t" << steps / seconds;
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+/* Job system costs: N empty jobs started and waited on, a chain of N / 16 jobs each depending on the one
+ * before, then the scaling of a real frame workload (Kepler orbits of N bodies as a parallel for) from 1
+ * thread up to --threads. */
+inline int runJobBenchmark(const BenchmarkSettings &settings)
+{
+    typedef std::chrono::steady_clock Clock;
+    auto nanos = [](Clock::time_point begin, Clock::time_point end) {
+        return std::chrono::duration<double, std::nano>(end - begin).count();
+    };
+    unsigned count = settings.jobCount;
+    unsigned maxThreads = settings.threads ? settings.threads : std::max(std::thread::hardware_concurrency(), 1u);
+    JobSystem jobs(maxThreads);
+
+    std::atomic<unsigned> ran(0);
+    Clock::time_point begin = Clock::now();
+    JobCounter empty;
+    for (unsigned i = 0; i < count; ++i)
+        jobs.run([&ran] { ran.fetch_add(1, std::memory_order_relaxed); }, empty);
+    jobs.wait(empty);
+    std::cout << count << " empty jobs on " << jobs.size() << " threads: " << nanos(begin, Clock::now()) / count
+              << " ns per job" << std::endl;
+
+    unsigned links = std::max(count / 16, 1u);
+    std::vector<std::unique_ptr<JobCounter>> chain;
+    for (unsigned i = 0; i < links; ++i)
+        chain.emplace_back(new JobCounter);
+    begin = Clock::now();
+    jobs.run([&ran] { ran.fetch_add(1, std::memory_order_relaxed); }, *chain[0]);
+    for (unsigned i = 1; i < links; ++i)
+        jobs.runAfter(*chain[i - 1], [&ran] { ran.fetch_add(1, std::memory_order_relaxed); }, *chain[i]);
+    for (std::unique_ptr<JobCounter> &counter : chain)
+        jobs.wait(*counter);
+    std::cout << "chain of " << links << " dependent jobs: " << nanos(begin, Clock::now()) / links << " ns per link"
+              << std::endl;
+
+    KeplerOrbits orbits;
+    std::mt19937 random(1337);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    orbits.reserve(count);
+    for (unsigned i = 0; i < count; ++i) {
+        OrbitalElements orbit;
+        orbit.semiMajorAxis = 1.0f + 20.0f * unit(random);
+        orbit.eccentricity = 0.3f * unit(random);
+        orbit.meanAnomaly = 6.2831853f * unit(random);
+        orbit.period = 10.0f + 100.0f * unit(random);
+        orbits.add(orbit);
+    }
+    std::vector<float> x(count), y(count), z(count);
+    double singleThreadMs = 0.0;
+    for (unsigned threads = 1; threads < maxThreads * 2; threads *= 2) {
+        jobs.resize(std::min(threads, maxThreads));
+        const unsigned frames = 20;
+        begin = Clock::now();
+        for (unsigned frame = 0; frame < frames; ++frame)
+            orbits.propagate(frame * settings.dt, jobs, x.data(), y.data(), z.data());
+        double ms = nanos(begin, Clock::now()) / frames / 1e6;
+        if (threads == 1)
+            singleThreadMs = ms;
+        std::cout << "orbits of " << count << " bodies on " << jobs.size() << " threads: " << ms << " ms, "
+                  << singleThreadMs / ms << "x" << std::endl;
+    }
+    if (ran.load() != count + links) {
+        std::cerr << "Urk! " << count + links - ran.load() << " jobs never ran!" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+#endif //PROJECT_BASE_BENCHMARK_H
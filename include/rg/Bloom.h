@@ -0,0 +1,116 @@
+#ifndef PROJECT_BASE_BLOOM_H
+#define PROJECT_BASE_BLOOM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <rg/FrameGraph.h>
+
+#include <vector>
+
+/* Progressive downsample/upsample bloom.
+ * The highlights are filtered down a chain of half resolution mips with a 13 tap box filter and then
+ * walked back up with a tent filter, each level added onto the one above it. The result ends up in the
+ * first (half resolution) mip, which the composite samples with bilinear filtering. */
+class MipChainBloom {
+public:
+    static const unsigned MAX_MIPS = 8;
+
+    MipChainBloom(const char *vertexPath, const char *downsamplePath, const char *upsamplePath)
+        : downsampleShader(vertexPath, downsamplePath), upsampleShader(vertexPath, upsamplePath)
+    {
+        downsampleShader.use();
+        downsampleShader.setInt("image", 0);
+        upsampleShader.use();
+        upsampleShader.setInt("image", 0);
+        upsampleShader.setVec2("uvScale", 1.0f, 1.0f);
+        karisAverageUniform = downsampleShader.uniform("karisAverage");
+        downsampleUvScaleUniform = downsampleShader.uniform("uvScale");
+        filterRadiusUniform = upsampleShader.uniform("filterRadius");
+    }
+
+    /* Declares the downsample and upsample passes and returns the filtered highlights (the top mip).
+     * The mips are transient frame graph textures. sourceUvScale is the part of the source that holds
+     * the image when it is rendered at a lower internal resolution, the first downsample stretches it
+     * over the whole chain. */
+    FrameGraphResource addPasses(FrameGraph &graph, FrameGraphResource source, unsigned width, unsigned height,
+                                 unsigned requestedMips, unsigned quadVAO, float filterRadius,
+                                 glm::vec2 sourceUvScale = glm::vec2(1.0f, 1.0f))
+    {
+        if (requestedMips < 1)
+            requestedMips = 1;
+        if (requestedMips > MAX_MIPS)
+            requestedMips = MAX_MIPS;
+
+        std::vector<FrameGraphResource> mips;
+        glm::ivec2 size((int) width, (int) height);
+        for (unsigned i = 0; i < requestedMips; ++i) {
+            size.x /= 2;
+            size.y /= 2;
+            if (size.x < 2 || size.y < 2)
+                break;
+            mips.push_back(INVALID_RESOURCE);
+        }
+        levels = (unsigned) mips.size();
+        if (mips.empty())
+            return source;
+
+        /* downsample */
+        size = glm::ivec2((int) width, (int) height);
+        FrameGraphResource previous = source;
+        for (unsigned i = 0; i < mips.size(); ++i) {
+            size.x /= 2;
+            size.y /= 2;
+            FrameGraphTextureDesc desc(size.x, size.y, GL_R11F_G11F_B10F);
+            graph.addPass("bloom downsample", [&](FrameGraph::Builder &builder) {
+                builder.read(previous);
+                mips[i] = builder.write(builder.create("bloom mip", desc));
+            }, [this, previous, i, quadVAO, sourceUvScale](const FrameGraph::Resources &resources) {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, resources.texture(previous));
+                glBindVertexArray(quadVAO);
+                downsampleShader.use();
+                downsampleShader.setBool(karisAverageUniform, i == 0);
+                downsampleShader.setVec2(downsampleUvScaleUniform, i == 0 ? sourceUvScale : glm::vec2(1.0f, 1.0f));
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            });
+            previous = mips[i];
+        }
+
+        /* upsample, accumulating every level onto the next bigger one */
+        for (unsigned i = mips.size() - 1; i > 0; --i) {
+            FrameGraphResource smaller = mips[i];
+            graph.addPass("bloom upsample", [&](FrameGraph::Builder &builder) {
+                builder.read(smaller);
+                mips[i - 1] = builder.write(mips[i - 1]);
+            }, [this, smaller, quadVAO, filterRadius](const FrameGraph::Resources &resources) {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, resources.texture(smaller));
+                glBindVertexArray(quadVAO);
+                upsampleShader.use();
+                upsampleShader.setFloat(filterRadiusUniform, filterRadius);
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+                glBlendEquation(GL_FUNC_ADD);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                glDisable(GL_BLEND);
+            });
+        }
+        return mips[0];
+    }
+
+    // number of levels declared by the last addPasses
+    unsigned mipCount() const
+    {
+        return levels;
+    }
+
+private:
+    Shader downsampleShader;
+    Shader upsampleShader;
+    UniformHandle karisAverageUniform, downsampleUvScaleUniform, filterRadiusUniform;
+    unsigned levels = 0;
+};
+
+#endif //PROJECT_BASE_BLOOM_H
@@ -0,0 +1,142 @@
+#ifndef PROJECT_BASE_BODYSTORE_H
+#define PROJECT_BASE_BODYSTORE_H
+
+#include <glm/glm.hpp>
+
+#include <rg/InstanceBuffer.h>
+
+#include <cmath>
+#include <vector>
+
+/* one body as handed to BodyStore::add, the store itself keeps every field in its own array */
+struct BodyDesc {
+    // spin around a unit axis, radians and radians per second
+    glm::vec3 spinAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float spinPhase = 0.0f;
+    float spinRate = 0.0f;
+    float scale = 1.0f;
+    glm::vec4 tint = glm::vec4(1.0f);
+    // which draw list the body ends up in
+    unsigned mesh = 0;
+};
+
+/* Celestial bodies and props as a structure of arrays.
+ * Each system below walks a few of the arrays front to back for a range of bodies and writes others, so
+ * the loops stay short, branch free and easy for the compiler to vectorize, and a frame costs the same
+ * per body for three of them or a million. Ranges let the work be split between threads. */
+struct BodyStore {
+    // state written by the systems, positions by whatever moves the bodies (KeplerOrbits, NBody)
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    // parameters
+    std::vector<float> spinAxisX, spinAxisY, spinAxisZ, spinPhase, spinRate;
+    std::vector<float> scale;
+    std::vector<glm::vec4> tint;
+    std::vector<unsigned> mesh;
+    // where in its draw list each body goes, set once when it's added so a range needs nothing before it
+    std::vector<unsigned> slot;
+    // bodies per draw list
+    std::vector<unsigned> meshCounts;
+
+    unsigned add(const BodyDesc &body)
+    {
+        positionX.push_back(0.0f);
+        positionY.push_back(0.0f);
+        positionZ.push_back(0.0f);
+        rotationX.push_back(0.0f);
+        rotationY.push_back(0.0f);
+        rotationZ.push_back(0.0f);
+        rotationW.push_back(1.0f);
+        spinAxisX.push_back(body.spinAxis.x);
+        spinAxisY.push_back(body.spinAxis.y);
+        spinAxisZ.push_back(body.spinAxis.z);
+        spinPhase.push_back(body.spinPhase);
+        spinRate.push_back(body.spinRate);
+        scale.push_back(body.scale);
+        tint.push_back(body.tint);
+        mesh.push_back(body.mesh);
+        if (meshCounts.size() <= body.mesh)
+            meshCounts.resize(body.mesh + 1, 0);
+        slot.push_back(meshCounts[body.mesh]++);
+        return size() - 1;
+    }
+
+    void clear()
+    {
+        std::vector<float> *arrays[] = {
+                &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW,
+                &spinAxisX, &spinAxisY, &spinAxisZ, &spinPhase, &spinRate, &scale
+        };
+        for (std::vector<float> *array : arrays)
+            array->clear();
+        tint.clear();
+        mesh.clear();
+        slot.clear();
+        meshCounts.clear();
+    }
+
+    void reserve(unsigned count)
+    {
+        std::vector<float> *arrays[] = {
+                &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW,
+                &spinAxisX, &spinAxisY, &spinAxisZ, &spinPhase, &spinRate, &scale
+        };
+        for (std::vector<float> *array : arrays)
+            array->reserve(count);
+        tint.reserve(count);
+        mesh.reserve(count);
+        slot.reserve(count);
+    }
+
+    unsigned size() const
+    {
+        return (unsigned) mesh.size();
+    }
+};
+
+// rotation quaternions of the spins at the given time, for bodies [first, last)
+inline void updateSpins(BodyStore &bodies, float time, unsigned first, unsigned last)
+{
+    const float *__restrict axisX = bodies.spinAxisX.data();
+    const float *__restrict axisY = bodies.spinAxisY.data();
+    const float *__restrict axisZ = bodies.spinAxisZ.data();
+    const float *__restrict phase = bodies.spinPhase.data();
+    const float *__restrict rate = bodies.spinRate.data();
+    float *__restrict qx = bodies.rotationX.data();
+    float *__restrict qy = bodies.rotationY.data();
+    float *__restrict qz = bodies.rotationZ.data();
+    float *__restrict qw = bodies.rotationW.data();
+    for (unsigned i = first; i < last; ++i) {
+        float half = 0.5f * (phase[i] + rate[i] * time);
+        float s = std::sin(half);
+        qx[i] = axisX[i] * s;
+        qy[i] = axisY[i] * s;
+        qz[i] = axisZ[i] * s;
+        qw[i] = std::cos(half);
+    }
+}
+
+/* Instance data of bodies [first, last), each written to lists[mesh] at its slot, so ranges cost only their
+ * own bodies and different ranges can be built at the same time. The lists have to be sized already,
+ * see resizeDrawLists. */
+inline void buildDrawLists(const BodyStore &bodies, std::vector<InstanceData> *lists, unsigned first, unsigned last)
+{
+    for (unsigned i = first; i < last; ++i) {
+        float x = bodies.rotationX[i], y = bodies.rotationY[i], z = bodies.rotationZ[i], w = bodies.rotationW[i];
+        float s = bodies.scale[i];
+        InstanceData &instance = lists[bodies.mesh[i]][bodies.slot[i]];
+        instance.model[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * s;
+        instance.model[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * s;
+        instance.model[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * s;
+        instance.model[3] = glm::vec4(bodies.positionX[i], bodies.positionY[i], bodies.positionZ[i], 1.0f);
+        instance.tint = bodies.tint[i];
+    }
+}
+
+inline void resizeDrawLists(const BodyStore &bodies, std::vector<InstanceData> *lists, unsigned listCount)
+{
+    for (unsigned list = 0; list < listCount; ++list)
+        lists[list].resize(list < bodies.meshCounts.size() ? bodies.meshCounts[list] : 0);
+}
+
+#endif //PROJECT_BASE_BODYSTORE_H
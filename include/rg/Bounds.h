@@ -0,0 +1,111 @@
+#ifndef PROJECT_BASE_BOUNDS_H
+#define PROJECT_BASE_BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cmath>
+
+/* axis aligned box, empty (min > max) until something is added to it */
+struct Aabb {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool empty() const
+    {
+        return min.x > max.x;
+    }
+
+    void add(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void add(const Aabb &box)
+    {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    glm::vec3 center() const
+    {
+        return 0.5f * (min + max);
+    }
+
+    glm::vec3 extents() const
+    {
+        return 0.5f * (max - min);
+    }
+
+    // box around this one after an affine transform, grows by the rotation but never misses anything
+    Aabb transformed(const glm::mat4 &m) const
+    {
+        glm::mat3 linear(m);
+        glm::mat3 absolute(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+        glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+        glm::vec3 e = absolute * extents();
+        Aabb box;
+        box.min = c - e;
+        box.max = c + e;
+        return box;
+    }
+
+    bool operator==(const Aabb &other) const
+    {
+        return min == other.min && max == other.max;
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    // sphere around the transformed one, non-uniform scale takes the largest axis
+    BoundingSphere transformed(const glm::mat4 &m) const
+    {
+        float scale = std::sqrt(std::fmax(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+                                          std::fmax(glm::dot(glm::vec3(m[1]), glm::vec3(m[1])),
+                                                    glm::dot(glm::vec3(m[2]), glm::vec3(m[2])))));
+        BoundingSphere sphere;
+        sphere.center = glm::vec3(m * glm::vec4(center, 1.0f));
+        sphere.radius = radius * scale;
+        return sphere;
+    }
+};
+
+/* The six planes of a view projection, normals pointing inwards and normalized so plane distances are
+ * in world units. Order: left, right, bottom, top, near, far. */
+struct Frustum {
+    glm::vec4 planes[6];
+
+    Frustum() = default;
+
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        // rows of the matrix added and subtracted give the planes (Gribb and Hartmann)
+        glm::mat4 m = glm::transpose(viewProjection);
+        glm::vec4 rows[6] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+        for (unsigned i = 0; i < 6; ++i)
+            planes[i] = rows[i] / glm::length(glm::vec3(rows[i]));
+    }
+
+    bool intersects(const BoundingSphere &sphere) const
+    {
+        for (const glm::vec4 &plane : planes)
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+                return false;
+        return true;
+    }
+
+    bool intersects(const Aabb &box) const
+    {
+        glm::vec3 c = box.center(), e = box.extents();
+        for (const glm::vec4 &plane : planes)
+            if (glm::dot(glm::vec3(plane), c) + glm::dot(glm::abs(glm::vec3(plane)), e) + plane.w < 0.0f)
+                return false;
+        return true;
+    }
+};
+
+#endif //PROJECT_BASE_BOUNDS_H
@@ -0,0 +1,300 @@
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <rg/Bounds.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RG_BVH_SSE 1
+#include <emmintrin.h>
+#endif
+
+/* Four wide bounding volume hierarchy over the world space boxes of the scene's objects.
+ * Every node keeps the boxes of its four children side by side (x mins of all four, then y mins, ...),
+ * so one SSE register holds a coordinate of all four and a plane is tested against the whole node at
+ * once. Children are either inner nodes or leaf ranges of up to LEAF_SIZE objects.
+ * Moving objects don't rebuild the tree: update() stores the new box and refit() grows and shrinks the
+ * boxes of the touched nodes bottom up. The topology stays as built, so build() again after adding
+ * objects or when things have wandered far from where they started. */
+class Bvh {
+public:
+    static const unsigned LEAF_SIZE = 4;
+
+    // adds an object and returns its id, it is only culled after the next build()
+    unsigned add(const Aabb &box)
+    {
+        boxes.push_back(box);
+        objectNode.push_back(-1);
+        return (unsigned) boxes.size() - 1;
+    }
+
+    void update(unsigned object, const Aabb &box)
+    {
+        if (boxes[object] == box)
+            return;
+        boxes[object] = box;
+        if (objectNode[object] >= 0)
+            dirty[objectNode[object]] = 1;
+    }
+
+    const Aabb &bounds(unsigned object) const
+    {
+        return boxes[object];
+    }
+
+    void build()
+    {
+        nodes.clear();
+        order.resize(boxes.size());
+        for (unsigned i = 0; i < order.size(); ++i)
+            order[i] = i;
+        centroids.resize(boxes.size());
+        for (unsigned i = 0; i < boxes.size(); ++i)
+            centroids[i] = boxes[i].center();
+        if (!boxes.empty())
+            buildNode(0, (unsigned) boxes.size(), -1, 0);
+        dirty.assign(nodes.size(), 0);
+        centroids.clear();
+    }
+
+    // brings the node boxes up to date with update(), children always come after their parent
+    void refit()
+    {
+        for (int n = (int) nodes.size() - 1; n >= 0; --n) {
+            if (!dirty[n])
+                continue;
+            dirty[n] = 0;
+            Node &node = nodes[n];
+            for (unsigned slot = 0; slot < 4; ++slot) {
+                if (node.child[slot] < 0 && node.count[slot] > 0) {
+                    Aabb box;
+                    unsigned first = ~node.child[slot];
+                    for (unsigned i = first; i < first + node.count[slot]; ++i)
+                        box.add(boxes[order[i]]);
+                    setSlot(node, slot, box);
+                }
+            }
+            if (node.parent >= 0) {
+                Aabb box = nodeBounds(node);
+                Node &parent = nodes[node.parent];
+                if (!(slotBounds(parent, node.parentSlot) == box)) {
+                    setSlot(parent, node.parentSlot, box);
+                    dirty[node.parent] = 1;
+                }
+            }
+        }
+    }
+
+    // ids of the objects whose box touches the frustum, in no particular order
+    void cull(const Frustum &frustum, std::vector<unsigned> &visible) const
+    {
+        visible.clear();
+        if (nodes.empty())
+            return;
+        // the low bit marks nodes known to be completely inside, those skip the plane tests
+        stack.clear();
+        stack.push_back(0);
+        while (!stack.empty()) {
+            unsigned entry = stack.back();
+            stack.pop_back();
+            const Node &node = nodes[entry >> 1];
+            unsigned outside = 0, inside = 0xf;
+            if (!(entry & 1))
+                classify(node, frustum, outside, inside);
+            for (unsigned slot = 0; slot < 4; ++slot) {
+                if (node.count[slot] == 0 || (outside >> slot & 1))
+                    continue;
+                bool contained = (inside >> slot & 1) != 0;
+                if (node.child[slot] >= 0) {
+                    stack.push_back((unsigned) node.child[slot] << 1 | (contained ? 1u : 0u));
+                    continue;
+                }
+                unsigned first = ~node.child[slot];
+                for (unsigned i = first; i < first + node.count[slot]; ++i)
+                    if (contained || node.count[slot] == 1 || frustum.intersects(boxes[order[i]]))
+                        visible.push_back(order[i]);
+            }
+        }
+    }
+
+    unsigned size() const
+    {
+        return (unsigned) boxes.size();
+    }
+
+    unsigned nodeCount() const
+    {
+        return (unsigned) nodes.size();
+    }
+
+private:
+    /* child >= 0 is an inner node, otherwise ~child is the first of count objects in order.
+     * Unused slots have count 0 and an inverted box. */
+    struct Node {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        int child[4];
+        unsigned count[4];
+        int parent;
+        unsigned parentSlot;
+    };
+
+    std::vector<Aabb> boxes;
+    std::vector<int> objectNode;
+    std::vector<unsigned> order;
+    std::vector<Node> nodes;
+    std::vector<unsigned char> dirty;
+    std::vector<glm::vec3> centroids;
+    mutable std::vector<unsigned> stack;
+
+    static void setSlot(Node &node, unsigned slot, const Aabb &box)
+    {
+        node.minX[slot] = box.min.x;
+        node.minY[slot] = box.min.y;
+        node.minZ[slot] = box.min.z;
+        node.maxX[slot] = box.max.x;
+        node.maxY[slot] = box.max.y;
+        node.maxZ[slot] = box.max.z;
+    }
+
+    static Aabb slotBounds(const Node &node, unsigned slot)
+    {
+        Aabb box;
+        box.min = glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]);
+        box.max = glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]);
+        return box;
+    }
+
+    static Aabb nodeBounds(const Node &node)
+    {
+        Aabb box;
+        for (unsigned slot = 0; slot < 4; ++slot)
+            if (node.count[slot] > 0)
+                box.add(slotBounds(node, slot));
+        return box;
+    }
+
+    /* Builds the node for order[first, first + count) and returns its index. The range is split in two
+     * along the longest axis of its centroids, and both halves once more, giving up to four children. */
+    int buildNode(unsigned first, unsigned count, int parent, unsigned parentSlot)
+    {
+        int index = (int) nodes.size();
+        nodes.push_back(Node());
+        nodes[index].parent = parent;
+        nodes[index].parentSlot = parentSlot;
+
+        unsigned middle = first + count / 2;
+        split(first, count, middle);
+        unsigned halves[3] = { first, middle, first + count };
+        unsigned childFirst[4], childCount[4];
+        unsigned used = 0;
+        for (unsigned half = 0; half < 2; ++half) {
+            unsigned begin = halves[half], n = halves[half + 1] - halves[half];
+            if (n <= LEAF_SIZE) {
+                childFirst[used] = begin;
+                childCount[used++] = n;
+                continue;
+            }
+            unsigned quarter = begin + n / 2;
+            split(begin, n, quarter);
+            childFirst[used] = begin;
+            childCount[used++] = quarter - begin;
+            childFirst[used] = quarter;
+            childCount[used++] = begin + n - quarter;
+        }
+
+        for (unsigned slot = 0; slot < 4; ++slot) {
+            Node &node = nodes[index];
+            node.count[slot] = 0;
+            node.child[slot] = -1;
+            setSlot(node, slot, Aabb());
+        }
+        for (unsigned slot = 0; slot < used; ++slot) {
+            if (childCount[slot] == 0)
+                continue;
+            Aabb box;
+            for (unsigned i = childFirst[slot]; i < childFirst[slot] + childCount[slot]; ++i)
+                box.add(boxes[order[i]]);
+            int child;
+            if (childCount[slot] <= LEAF_SIZE) {
+                child = ~(int) childFirst[slot];
+                for (unsigned i = childFirst[slot]; i < childFirst[slot] + childCount[slot]; ++i)
+                    objectNode[order[i]] = index;
+            } else {
+                child = buildNode(childFirst[slot], childCount[slot], index, slot);
+            }
+            // nodes may have moved when the child was built
+            Node &node = nodes[index];
+            node.child[slot] = child;
+            node.count[slot] = childCount[slot];
+            setSlot(node, slot, box);
+        }
+        return index;
+    }
+
+    // partitions order[first, first + count) around middle along the longest centroid axis
+    void split(unsigned first, unsigned count, unsigned middle)
+    {
+        if (count < 2)
+            return;
+        Aabb spread;
+        for (unsigned i = first; i < first + count; ++i)
+            spread.add(centroids[order[i]]);
+        glm::vec3 size = spread.max - spread.min;
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        const std::vector<glm::vec3> &c = centroids;
+        std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + first + count,
+                         [&c, axis](unsigned a, unsigned b) { return c[a][axis] < c[b][axis]; });
+    }
+
+    /* Per child slot, bit set in outside when the box is behind some plane and cleared in inside when
+     * the box pokes out of some plane. A plane tests the corner farthest along its normal for outside
+     * and the nearest corner for inside; which corner that is only depends on the normal's signs. */
+    static void classify(const Node &node, const Frustum &frustum, unsigned &outside, unsigned &inside)
+    {
+#ifdef RG_BVH_SSE
+        __m128 minX = _mm_loadu_ps(node.minX), minY = _mm_loadu_ps(node.minY), minZ = _mm_loadu_ps(node.minZ);
+        __m128 maxX = _mm_loadu_ps(node.maxX), maxY = _mm_loadu_ps(node.maxY), maxZ = _mm_loadu_ps(node.maxZ);
+        __m128 zero = _mm_setzero_ps();
+        __m128 out = zero, straddle = zero;
+        for (const glm::vec4 &plane : frustum.planes) {
+            __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+            __m128 w = _mm_set1_ps(plane.w);
+            __m128 far = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, plane.x > 0.0f ? maxX : minX),
+                                               _mm_mul_ps(ny, plane.y > 0.0f ? maxY : minY)),
+                                    _mm_add_ps(_mm_mul_ps(nz, plane.z > 0.0f ? maxZ : minZ), w));
+            __m128 near = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, plane.x > 0.0f ? minX : maxX),
+                                                _mm_mul_ps(ny, plane.y > 0.0f ? minY : maxY)),
+                                     _mm_add_ps(_mm_mul_ps(nz, plane.z > 0.0f ? minZ : maxZ), w));
+            out = _mm_or_ps(out, _mm_cmplt_ps(far, zero));
+            straddle = _mm_or_ps(straddle, _mm_cmplt_ps(near, zero));
+        }
+        outside = (unsigned) _mm_movemask_ps(out);
+        inside = ~(unsigned) _mm_movemask_ps(straddle) & 0xf;
+#else
+        outside = 0;
+        inside = 0xf;
+        for (unsigned slot = 0; slot < 4; ++slot) {
+            for (const glm::vec4 &plane : frustum.planes) {
+                float far = plane.x * (plane.x > 0.0f ? node.maxX[slot] : node.minX[slot]) +
+                            plane.y * (plane.y > 0.0f ? node.maxY[slot] : node.minY[slot]) +
+                            plane.z * (plane.z > 0.0f ? node.maxZ[slot] : node.minZ[slot]) + plane.w;
+                float near = plane.x * (plane.x > 0.0f ? node.minX[slot] : node.maxX[slot]) +
+                             plane.y * (plane.y > 0.0f ? node.minY[slot] : node.maxY[slot]) +
+                             plane.z * (plane.z > 0.0f ? node.minZ[slot] : node.maxZ[slot]) + plane.w;
+                if (far < 0.0f)
+                    outside |= 1u << slot;
+                if (near < 0.0f)
+                    inside &= ~(1u << slot);
+            }
+        }
+#endif
+    }
+};
+
+#endif //PROJECT_BASE_BVH_H
@@ -0,0 +1,174 @@
+#ifndef PROJECT_BASE_COMMANDBUCKET_H
+#define PROJECT_BASE_COMMANDBUCKET_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/GlStateCache.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* A frame's draws recorded out of order, then sorted and submitted. Each command carries a 64 bit key, the
+ * state it needs bound (program, vertex array, textures) and a plain function that sets its uniforms and
+ * draws, with a pointer to what it draws, an instance count and the index of its matrices in the bucket's
+ * transforms for the frame. Commands are a few words each and nothing in them allocates, so once the vectors
+ * have grown recording a frame costs no allocation.
+ * Keys order by pass first, so the sky can go after everything opaque whatever order it was added in, then by
+ * a coarse depth bucket, then by program, material and vertex array, so draws sharing state end up next to
+ * each other. sort() is an LSD radix sort over the key bytes that skips a byte when every key has
+ * the same one, so a handful of commands cost a few passes, not eight. submit() binds through GlStateCache,
+ * so state repeated from the command before doesn't reach GL. The callbacks run with the program bound and
+ * must not bind programs, textures or vertex arrays behind the cache's back, use GlStateCache for that. */
+class CommandBucket {
+public:
+    static const unsigned MAX_TEXTURES = 4;
+
+    static const unsigned PASS_BITS = 4;
+    static const unsigned DEPTH_BITS = 8;
+    static const unsigned PROGRAM_BITS = 16;
+    static const unsigned MATERIAL_BITS = 20;
+    static const unsigned VERTEX_ARRAY_BITS = 16;
+
+    struct Texture {
+        GLenum target;
+        unsigned name;
+    };
+
+    // object, count and transforms, from the command's first one on, are what the command was added with
+    typedef void (*DrawFunction)(const void *object, const glm::mat4 *transforms, unsigned count);
+
+    struct Command {
+        unsigned program = 0;
+        unsigned vertexArray = 0;
+        unsigned textureCount = 0;
+        Texture textures[MAX_TEXTURES];
+        DrawFunction draw = nullptr;
+        const void *object = nullptr;
+        unsigned transform = 0;
+        unsigned count = 0;
+
+        // units go 0 and up in the order the textures are added
+        Command &texture(GLenum target, unsigned name)
+        {
+            if (textureCount < MAX_TEXTURES)
+                textures[textureCount++] = {target, name};
+            return *this;
+        }
+    };
+
+    // fields that don't fit their bits are cut, which only costs some grouping
+    static uint64_t key(unsigned pass, unsigned depthBucket, unsigned program, unsigned material, unsigned vertexArray)
+    {
+        uint64_t result = pass & mask(PASS_BITS);
+        result = result << DEPTH_BITS | (depthBucket & mask(DEPTH_BITS));
+        result = result << PROGRAM_BITS | (program & mask(PROGRAM_BITS));
+        result = result << MATERIAL_BITS | (material & mask(MATERIAL_BITS));
+        return result << VERTEX_ARRAY_BITS | (vertexArray & mask(VERTEX_ARRAY_BITS));
+    }
+
+    // front to back between the planes, on a log scale so far buckets are as fine relative to their distance
+    // as near ones
+    static unsigned depthBucket(float distance, float nearPlane, float farPlane)
+    {
+        if (distance <= nearPlane)
+            return 0;
+        float t = std::log(distance / nearPlane) / std::log(farPlane / nearPlane);
+        unsigned buckets = 1u << DEPTH_BITS;
+        return std::min(buckets - 1, (unsigned) (t * (float) buckets));
+    }
+
+    void clear()
+    {
+        commands.clear();
+        keys.clear();
+        transforms.clear();
+    }
+
+    // a matrix for this frame's draws, the index goes to add(). Matrices added one after another sit next to
+    // each other, so a draw that needs several passes the first
+    unsigned transform(const glm::mat4 &matrix)
+    {
+        transforms.push_back(matrix);
+        return (unsigned) transforms.size() - 1;
+    }
+
+    // vertexArray 0 for draws that bind their own, object has to live until submit(), the reference is good
+    // until the next add()
+    Command &add(uint64_t sortKey, unsigned program, unsigned vertexArray, DrawFunction draw,
+                 const void *object = nullptr, unsigned firstTransform = 0, unsigned count = 0)
+    {
+        keys.push_back({sortKey, (uint32_t) commands.size()});
+        commands.emplace_back();
+        Command &command = commands.back();
+        command.program = program;
+        command.vertexArray = vertexArray;
+        command.draw = draw;
+        command.object = object;
+        command.transform = firstTransform;
+        command.count = count;
+        return command;
+    }
+
+    // stable, commands with equal keys keep the order they were added in
+    void sort()
+    {
+        scratch.resize(keys.size());
+        for (unsigned shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = {};
+            for (const Entry &entry : keys)
+                ++counts[entry.key >> shift & 0xff];
+            if (counts[keys.empty() ? 0 : keys[0].key >> shift & 0xff] == keys.size())
+                continue;
+            size_t offset = 0;
+            for (size_t &count : counts) {
+                size_t next = offset + count;
+                count = offset;
+                offset = next;
+            }
+            for (const Entry &entry : keys)
+                scratch[counts[entry.key >> shift & 0xff]++] = entry;
+            keys.swap(scratch);
+        }
+    }
+
+    // draws in key order, sort() first
+    void submit()
+    {
+        GlStateCache::begin();
+        for (const Entry &entry : keys) {
+            const Command &command = commands[entry.command];
+            GlStateCache::useProgram(command.program);
+            if (command.vertexArray)
+                GlStateCache::bindVertexArray(command.vertexArray);
+            for (unsigned unit = 0; unit < command.textureCount; ++unit)
+                GlStateCache::bindTexture(unit, command.textures[unit].target, command.textures[unit].name);
+            command.draw(command.object, transforms.data() + command.transform, command.count);
+        }
+        GlStateCache::end();
+    }
+
+    size_t size() const
+    {
+        return commands.size();
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t command;
+    };
+
+    std::vector<Command> commands;
+    std::vector<Entry> keys, scratch;
+    std::vector<glm::mat4> transforms;
+
+    static uint64_t mask(unsigned bits)
+    {
+        return (1ull << bits) - 1;
+    }
+};
+
+#endif //PROJECT_BASE_COMMANDBUCKET_H
@@ -0,0 +1,221 @@
+#ifndef PROJECT_BASE_CPUPROFILER_H
+#define PROJECT_BASE_CPUPROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* CPU side zones for the main loop, asset loading and shader compiles.
+ * Each thread writes finished zones into its own ring buffer, so recording takes no lock; the buffers
+ * are registered once in a global list that the trace writer walks. While the profiler is disabled a
+ * zone costs one relaxed atomic load. The ring keeps the most recent RING_SIZE zones per thread and
+ * writeChromeTrace() dumps them as trace event JSON, which chrome://tracing and Perfetto open as is. Every
+ * slot carries the sequence number of the zone in it, zero while it's being written, which the dump checks
+ * before and after copying the zone out, so a zone overwritten mid-copy is dropped rather than torn.
+ * Zone names must outlive the profiler (string literals), details must outlive the zone and are copied
+ * when it closes. */
+class CpuProfiler {
+public:
+    static const unsigned RING_SIZE = 1 << 15;
+    static const unsigned DETAIL_LENGTH = 48;
+
+    struct Event {
+        const char *name;
+        uint64_t beginNs, endNs;
+        char detail[DETAIL_LENGTH];
+    };
+
+    static bool enabled()
+    {
+        return enabledFlag().load(std::memory_order_relaxed);
+    }
+
+    static void setEnabled(bool on)
+    {
+        enabledFlag().store(on, std::memory_order_relaxed);
+    }
+
+    // nanoseconds since the first call, which happens in the first zone
+    static uint64_t now()
+    {
+        static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static void setThreadName(const char *name)
+    {
+        ThreadBuffer &buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        buffer.name = name;
+    }
+
+    static void record(const char *name, const char *detail, uint64_t beginNs, uint64_t endNs)
+    {
+        ThreadBuffer &buffer = threadBuffer();
+        uint64_t head = buffer.head.load(std::memory_order_relaxed);
+        Slot &slot = buffer.slots[head % RING_SIZE];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Event &event = slot.event;
+        event.name = name;
+        event.beginNs = beginNs;
+        event.endNs = endNs;
+        event.detail[0] = '\0';
+        if (detail) {
+            // keep the end of long details, for paths that is the interesting part
+            size_t length = std::strlen(detail);
+            if (length >= DETAIL_LENGTH)
+                detail += length - (DETAIL_LENGTH - 1);
+            std::strncpy(event.detail, detail, DETAIL_LENGTH - 1);
+            event.detail[DETAIL_LENGTH - 1] = '\0';
+        }
+        slot.sequence.store(head + 1, std::memory_order_release);
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    /* Writes the zones that ended in the last `seconds` (everything still in the rings if seconds <= 0).
+     * Meant to be called from the main thread; zones other threads write while it runs may be missed, and
+     * so may the oldest ones if their slots get reused during the dump. */
+    static bool writeChromeTrace(const std::string &path, double seconds)
+    {
+        std::ofstream out(path);
+        if (!out)
+            return false;
+        out.setf(std::ios::fixed);
+        out.precision(3);
+
+        uint64_t end = now();
+        uint64_t window = seconds > 0.0 ? (uint64_t) (seconds * 1e9) : end;
+        uint64_t from = end > window ? end - window : 0;
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (unsigned tid = 0; tid < r.buffers.size(); ++tid) {
+            const ThreadBuffer &buffer = *r.buffers[tid];
+            out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+                << ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << escape(buffer.name) << "\"}}";
+            first = false;
+
+            uint64_t head = buffer.head.load(std::memory_order_acquire);
+            uint64_t count = head < RING_SIZE ? head : RING_SIZE;
+            for (uint64_t i = head - count; i < head; ++i) {
+                const Slot &slot = buffer.slots[i % RING_SIZE];
+                if (slot.sequence.load(std::memory_order_acquire) != i + 1)
+                    continue;
+                Event event = slot.event;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) != i + 1 || event.endNs < from)
+                    continue;
+                out << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"name\":\"" << escape(event.name)
+                    << "\",\"ts\":" << event.beginNs / 1000.0 << ",\"dur\":" << (event.endNs - event.beginNs) / 1000.0;
+                if (event.detail[0])
+                    out << ",\"args\":{\"detail\":\"" << escape(event.detail) << "\"}";
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+        return (bool) out;
+    }
+
+    // text for inside a JSON string: quotes and backslashes escaped, control characters dropped
+    static std::string escape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if ((unsigned char) c >= 0x20)
+                escaped += c;
+        }
+        return escaped;
+    }
+
+private:
+    struct Slot {
+        // 1 + the zone's index in the thread's sequence, 0 while being written or never written
+        std::atomic<uint64_t> sequence;
+        Event event;
+
+        Slot() : sequence(0) {}
+    };
+
+    struct ThreadBuffer {
+        std::string name;
+        std::atomic<uint64_t> head;
+        Slot slots[RING_SIZE];
+
+        ThreadBuffer() : head(0) {}
+    };
+
+    // buffers are owned here rather than by their threads, so zones of finished threads still get dumped
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    };
+
+    static std::atomic<bool> &enabledFlag()
+    {
+        static std::atomic<bool> flag(true);
+        return flag;
+    }
+
+    static Registry &registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    static ThreadBuffer &threadBuffer()
+    {
+        thread_local ThreadBuffer *buffer = nullptr;
+        if (!buffer) {
+            Registry &r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.buffers.emplace_back(new ThreadBuffer);
+            buffer = r.buffers.back().get();
+            buffer->name = "thread " + std::to_string(r.buffers.size() - 1);
+        }
+        return *buffer;
+    }
+};
+
+/* times the enclosing block, does nothing if the profiler was disabled when it opened */
+class CpuZone {
+public:
+    explicit CpuZone(const char *name, const char *detail = nullptr) : name(name), detail(detail)
+    {
+        active = CpuProfiler::enabled();
+        begin = active ? CpuProfiler::now() : 0;
+    }
+
+    ~CpuZone()
+    {
+        if (active)
+            CpuProfiler::record(name, detail, begin, CpuProfiler::now());
+    }
+
+    CpuZone(const CpuZone &) = delete;
+    CpuZone &operator=(const CpuZone &) = delete;
+
+private:
+    const char *name;
+    const char *detail;
+    uint64_t begin;
+    bool active;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) CpuZone PROFILE_CONCAT(cpuZone, __LINE__)(name)
+#define PROFILE_SCOPE_DETAIL(name, detail) CpuZone PROFILE_CONCAT(cpuZone, __LINE__)(name, detail)
+
+#endif //PROJECT_BASE_CPUPROFILER_H
@@ -0,0 +1,97 @@
+#ifndef PROJECT_BASE_DYNAMICRESOLUTION_H
+#define PROJECT_BASE_DYNAMICRESOLUTION_H
+
+#include <cmath>
+
+/* Size of the offscreen targets and of the region the scene is rendered into.
+ * The targets always match the window framebuffer. A lower internal resolution is rendered into the
+ * bottom left corner of the same storage (aliasing it) instead of reallocating every time the scale
+ * changes; passes that read the scene get the covered fraction through a uvScale uniform. */
+struct RenderExtent {
+    unsigned width = 0, height = 0;
+    unsigned internalWidth = 0, internalHeight = 0;
+    float scale = 1.0f;
+
+    // follows the framebuffer, ignoring the zero size of a minimized window
+    void resize(unsigned w, unsigned h)
+    {
+        if (w == 0 || h == 0)
+            return;
+        width = w;
+        height = h;
+        setScale(scale);
+    }
+
+    void setScale(float s)
+    {
+        scale = s > 1.0f ? 1.0f : s;
+        internalWidth = (unsigned) (width * scale + 0.5f);
+        internalHeight = (unsigned) (height * scale + 0.5f);
+        if (internalWidth < 1)
+            internalWidth = 1;
+        if (internalHeight < 1)
+            internalHeight = 1;
+    }
+
+    float uvScaleX() const
+    {
+        return (float) internalWidth / (float) width;
+    }
+
+    float uvScaleY() const
+    {
+        return (float) internalHeight / (float) height;
+    }
+};
+
+/* Picks the internal render scale that keeps the frame under a target frame time.
+ * Shaded pixel cost goes with the square of the scale, so the correction is the square root of the
+ * budget ratio. It reacts quickly when over budget and slowly when there is headroom, and ignores
+ * small errors, so the resolution doesn't oscillate. */
+class DynamicResolution {
+public:
+    bool enabled = true;
+    float targetFrameMs = 14.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+
+    float update(float frameMs)
+    {
+        if (frameMs <= 0.0f)
+            return scale;
+        smoothedMs = smoothedMs <= 0.0f ? frameMs : smoothedMs + (frameMs - smoothedMs) * 0.1f;
+
+        if (!enabled) {
+            scale = maxScale;
+            return scale;
+        }
+
+        float ratio = targetFrameMs / smoothedMs;
+        if (ratio < 0.95f || ratio > 1.10f) {
+            float desired = scale * std::sqrt(ratio);
+            float rate = desired < scale ? 0.3f : 0.05f;
+            scale += (desired - scale) * rate;
+        }
+        if (scale < minScale)
+            scale = minScale;
+        if (scale > maxScale)
+            scale = maxScale;
+        return scale;
+    }
+
+    float currentScale() const
+    {
+        return scale;
+    }
+
+    float smoothedFrameMs() const
+    {
+        return smoothedMs;
+    }
+
+private:
+    float scale = 1.0f;
+    float smoothedMs = 0.0f;
+};
+
+#endif //PROJECT_BASE_DYNAMICRESOLUTION_H
@@ -0,0 +1,537 @@
+#ifndef PROJECT_BASE_FRAMEGRAPH_H
+#define PROJECT_BASE_FRAMEGRAPH_H
+
+#include <glad/glad.h>
+
+#include <rg/CpuProfiler.h>
+#include <rg/GpuProfiler.h>
+
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/* A small frame graph.
+ * Every frame the passes are declared again together with the textures they create, read and write.
+ * compile() culls passes whose outputs nobody reads, orders the rest by their dependencies and assigns
+ * the transient textures to physical ones. Transient textures whose lifetimes don't overlap and that
+ * have the same description share one GL texture (the closest GL 3.3 gets to aliasing memory), and the
+ * physical textures and framebuffers live across frames so a stable graph allocates nothing.
+ * Writing a resource produces a new version of it that lives in the same texture, which is how a pass
+ * accumulates onto the output of an earlier one. */
+
+typedef int FrameGraphResource;
+const FrameGraphResource INVALID_RESOURCE = -1;
+
+struct FrameGraphTextureDesc {
+    unsigned width = 0;
+    unsigned height = 0;
+    GLenum format = GL_RGBA16F;
+
+    FrameGraphTextureDesc() {}
+    FrameGraphTextureDesc(unsigned w, unsigned h, GLenum f) : width(w), height(h), format(f) {}
+
+    bool operator==(const FrameGraphTextureDesc &o) const
+    {
+        return width == o.width && height == o.height && format == o.format;
+    }
+};
+
+class FrameGraph {
+public:
+    class Resources;
+
+private:
+    struct VirtualTexture {
+        std::string name;
+        FrameGraphTextureDesc desc;
+        bool imported;
+        unsigned importedFbo;
+        int firstUse, lastUse;
+        int physical;
+    };
+
+    struct ResourceNode {
+        int texture;    // VirtualTexture index
+        int producer;   // pass index, -1 for the initial version
+        int previous;   // version this one was written over, -1 if none
+        int refCount;
+    };
+
+    struct Pass {
+        std::string name;
+        std::function<void(const Resources &)> execute;
+        std::vector<FrameGraphResource> reads;
+        std::vector<FrameGraphResource> writes;
+        bool sideEffect;
+        int refCount;
+        bool culled;
+        unsigned fbo;
+        unsigned width, height;
+    };
+
+    struct PhysicalTexture {
+        FrameGraphTextureDesc desc;
+        unsigned id;
+        bool inUse;
+        unsigned lastFrame;
+    };
+
+    struct CachedFramebuffer {
+        unsigned id;
+        unsigned lastFrame;
+    };
+
+public:
+    static const unsigned EVICT_AFTER_FRAMES = 4;
+
+    class Builder {
+    public:
+        // declares a transient texture, its storage is only guaranteed between its first and last use
+        FrameGraphResource create(const std::string &name, const FrameGraphTextureDesc &desc)
+        {
+            VirtualTexture texture;
+            texture.name = name;
+            texture.desc = desc;
+            texture.imported = false;
+            texture.importedFbo = 0;
+            graph.textures.push_back(texture);
+            return graph.addNode((int) graph.textures.size() - 1, -1, -1);
+        }
+
+        FrameGraphResource read(FrameGraphResource resource)
+        {
+            graph.passes[pass].reads.push_back(resource);
+            return resource;
+        }
+
+        // returns the new version, writes become the color attachments in declaration order
+        FrameGraphResource write(FrameGraphResource resource)
+        {
+            const ResourceNode &node = graph.nodes[resource];
+            if (graph.textures[node.texture].imported)
+                graph.passes[pass].sideEffect = true;
+            FrameGraphResource version = graph.addNode(node.texture, pass, resource);
+            graph.passes[pass].writes.push_back(version);
+            return version;
+        }
+
+        // keeps the pass even if nothing reads its outputs
+        void sideEffect()
+        {
+            graph.passes[pass].sideEffect = true;
+        }
+
+    private:
+        friend class FrameGraph;
+        Builder(FrameGraph &g, int p) : graph(g), pass(p) {}
+        FrameGraph &graph;
+        int pass;
+    };
+
+    class Resources {
+    public:
+        unsigned texture(FrameGraphResource resource) const
+        {
+            const VirtualTexture &t = graph.textures[graph.nodes[resource].texture];
+            return t.physical >= 0 ? graph.pool[t.physical].id : 0;
+        }
+
+        const FrameGraphTextureDesc &desc(FrameGraphResource resource) const
+        {
+            return graph.textures[graph.nodes[resource].texture].desc;
+        }
+
+    private:
+        friend class FrameGraph;
+        explicit Resources(const FrameGraph &g) : graph(g) {}
+        const FrameGraph &graph;
+    };
+
+    typedef std::function<void(Builder &)> SetupFunction;
+    typedef std::function<void(const Resources &)> ExecuteFunction;
+
+    ~FrameGraph()
+    {
+        destroy();
+    }
+
+    // starts declaring a new frame
+    void reset()
+    {
+        passes.clear();
+        nodes.clear();
+        textures.clear();
+        order.clear();
+        ++frame;
+    }
+
+    // an externally owned framebuffer, e.g. the window's; passes writing to it are never culled
+    FrameGraphResource importRenderTarget(const std::string &name, unsigned fbo, unsigned width, unsigned height)
+    {
+        VirtualTexture texture;
+        texture.name = name;
+        texture.desc = FrameGraphTextureDesc(width, height, GL_NONE);
+        texture.imported = true;
+        texture.importedFbo = fbo;
+        textures.push_back(texture);
+        return addNode((int) textures.size() - 1, -1, -1);
+    }
+
+    // setup runs immediately, execute is deferred to execute()
+    void addPass(const std::string &name, const SetupFunction &setup, const ExecuteFunction &execute)
+    {
+        Pass pass;
+        pass.name = name;
+        pass.execute = execute;
+        pass.sideEffect = false;
+        pass.refCount = 0;
+        pass.culled = false;
+        pass.fbo = 0;
+        pass.width = pass.height = 0;
+        passes.push_back(pass);
+        Builder builder(*this, (int) passes.size() - 1);
+        setup(builder);
+    }
+
+    void compile()
+    {
+        cull();
+        sortPasses();
+        assignTextures();
+        assignFramebuffers();
+        evictUnused();
+    }
+
+    // with a profiler every pass is timed (and shows up as a debug group) under its own name
+    void execute(GpuProfiler *profiler = nullptr)
+    {
+        Resources resources(*this);
+        for (int index : order) {
+            Pass &pass = passes[index];
+            PROFILE_SCOPE_DETAIL("frame graph pass", pass.name.c_str());
+            if (profiler)
+                profiler->push(pass.name.c_str());
+            glBindFramebuffer(GL_FRAMEBUFFER, pass.fbo);
+            if (pass.width && pass.height)
+                glViewport(0, 0, pass.width, pass.height);
+            pass.execute(resources);
+            if (profiler)
+                profiler->pop();
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void destroy()
+    {
+        for (auto &entry : framebuffers)
+            glDeleteFramebuffers(1, &entry.second.id);
+        framebuffers.clear();
+        for (PhysicalTexture &texture : pool)
+            glDeleteTextures(1, &texture.id);
+        pool.clear();
+    }
+
+    struct Stats {
+        unsigned passes = 0;
+        unsigned culledPasses = 0;
+        unsigned transientTextures = 0;
+        unsigned physicalTextures = 0;
+        size_t physicalBytes = 0;
+    };
+
+    // statistics of the last compile
+    Stats stats() const
+    {
+        Stats result;
+        result.passes = (unsigned) passes.size();
+        result.culledPasses = (unsigned) (passes.size() - order.size());
+        for (const VirtualTexture &texture : textures)
+            result.transientTextures += texture.imported ? 0 : 1;
+        result.physicalTextures = (unsigned) pool.size();
+        for (const PhysicalTexture &texture : pool)
+            result.physicalBytes += (size_t) texture.desc.width * texture.desc.height * bytesPerTexel(texture.desc.format);
+        return result;
+    }
+
+private:
+    std::vector<Pass> passes;
+    std::vector<ResourceNode> nodes;
+    std::vector<VirtualTexture> textures;
+    std::vector<int> order;
+    std::vector<PhysicalTexture> pool;
+    std::map<std::vector<unsigned>, CachedFramebuffer> framebuffers;
+    unsigned frame = 0;
+
+    FrameGraphResource addNode(int texture, int producer, int previous)
+    {
+        ResourceNode node;
+        node.texture = texture;
+        node.producer = producer;
+        node.previous = previous;
+        node.refCount = 0;
+        nodes.push_back(node);
+        return (FrameGraphResource) nodes.size() - 1;
+    }
+
+    static bool isDepthFormat(GLenum format)
+    {
+        return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH_COMPONENT32F;
+    }
+
+    // client format and type that go with an internal format when allocating without data
+    static void transferFormat(GLenum internalFormat, GLenum &format, GLenum &type)
+    {
+        switch (internalFormat) {
+            case GL_DEPTH24_STENCIL8: format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; break;
+            case GL_DEPTH_COMPONENT32F: format = GL_DEPTH_COMPONENT; type = GL_FLOAT; break;
+            case GL_R11F_G11F_B10F: format = GL_RGB; type = GL_FLOAT; break;
+            case GL_RGBA8: format = GL_RGBA; type = GL_UNSIGNED_BYTE; break;
+            default: format = GL_RGBA; type = GL_FLOAT; break;
+        }
+    }
+
+    static unsigned bytesPerTexel(GLenum format)
+    {
+        switch (format) {
+            case GL_RGBA16F: return 8;
+            case GL_RGBA32F: return 16;
+            case GL_R11F_G11F_B10F:
+            case GL_RGBA8:
+            case GL_DEPTH24_STENCIL8:
+            case GL_DEPTH_COMPONENT32F: return 4;
+            default: return 4;
+        }
+    }
+
+    /* reference counting from the outputs back: a pass survives while one of its writes is read
+     * or it has side effects, every pass that dies releases the resources it reads */
+    void cull()
+    {
+        for (Pass &pass : passes) {
+            pass.refCount = (int) pass.writes.size() + (pass.sideEffect ? 1 : 0);
+            pass.culled = false;
+            for (FrameGraphResource read : pass.reads)
+                ++nodes[read].refCount;
+        }
+        // a write over an existing version keeps that version's producer alive as well
+        for (const ResourceNode &node : nodes)
+            if (node.previous >= 0)
+                ++nodes[node.previous].refCount;
+
+        std::vector<FrameGraphResource> unreferenced;
+        for (unsigned i = 0; i < nodes.size(); ++i)
+            if (nodes[i].refCount == 0)
+                unreferenced.push_back((FrameGraphResource) i);
+
+        while (!unreferenced.empty()) {
+            FrameGraphResource resource = unreferenced.back();
+            unreferenced.pop_back();
+            const ResourceNode &node = nodes[resource];
+            if (node.previous >= 0 && --nodes[node.previous].refCount == 0)
+                unreferenced.push_back(node.previous);
+            if (node.producer < 0)
+                continue;
+            Pass &producer = passes[node.producer];
+            if (--producer.refCount > 0 || producer.sideEffect)
+                continue;
+            producer.culled = true;
+            for (FrameGraphResource read : producer.reads)
+                if (--nodes[read].refCount == 0)
+                    unreferenced.push_back(read);
+        }
+    }
+
+    /* Kahn's algorithm over the surviving passes, ties broken by declaration order */
+    void sortPasses()
+    {
+        std::vector<std::vector<int>> dependents(passes.size());
+        std::vector<int> pending(passes.size(), 0);
+        for (unsigned i = 0; i < passes.size(); ++i) {
+            if (passes[i].culled)
+                continue;
+            std::vector<int> dependencies;
+            for (FrameGraphResource read : passes[i].reads)
+                dependencies.push_back(nodes[read].producer);
+            for (FrameGraphResource write : passes[i].writes)
+                if (nodes[write].previous >= 0)
+                    dependencies.push_back(nodes[nodes[write].previous].producer);
+            // a write over a version has to wait for everyone still reading that version
+            for (FrameGraphResource write : passes[i].writes)
+                if (nodes[write].previous >= 0)
+                    for (unsigned j = 0; j < passes.size(); ++j)
+                        for (FrameGraphResource read : passes[j].reads)
+                            if (read == nodes[write].previous && !passes[j].culled)
+                                dependencies.push_back((int) j);
+            for (int dependency : dependencies) {
+                if (dependency < 0 || dependency == (int) i)
+                    continue;
+                dependents[dependency].push_back((int) i);
+                ++pending[i];
+            }
+        }
+
+        std::vector<bool> done(passes.size(), false);
+        for (;;) {
+            int next = -1;
+            for (unsigned i = 0; i < passes.size() && next < 0; ++i)
+                if (!passes[i].culled && !done[i] && pending[i] == 0)
+                    next = (int) i;
+            if (next < 0)
+                break;
+            done[next] = true;
+            order.push_back(next);
+            for (int dependent : dependents[next])
+                --pending[dependent];
+        }
+    }
+
+    /* lifetimes in execution order, then a greedy first fit over the pool */
+    void assignTextures()
+    {
+        for (VirtualTexture &texture : textures) {
+            texture.firstUse = texture.lastUse = -1;
+            texture.physical = -1;
+        }
+        for (unsigned step = 0; step < order.size(); ++step) {
+            const Pass &pass = passes[order[step]];
+            for (const std::vector<FrameGraphResource> *list : { &pass.reads, &pass.writes }) {
+                for (FrameGraphResource resource : *list) {
+                    VirtualTexture &texture = textures[nodes[resource].texture];
+                    if (texture.firstUse < 0)
+                        texture.firstUse = (int) step;
+                    texture.lastUse = (int) step;
+                }
+            }
+        }
+
+        for (PhysicalTexture &physical : pool)
+            physical.inUse = false;
+        for (unsigned step = 0; step < order.size(); ++step) {
+            for (VirtualTexture &texture : textures)
+                if (!texture.imported && texture.firstUse == (int) step)
+                    texture.physical = acquire(texture.desc);
+            for (VirtualTexture &texture : textures)
+                if (!texture.imported && texture.lastUse == (int) step)
+                    pool[texture.physical].inUse = false;
+        }
+    }
+
+    int acquire(const FrameGraphTextureDesc &desc)
+    {
+        for (unsigned i = 0; i < pool.size(); ++i) {
+            if (!pool[i].inUse && pool[i].desc == desc) {
+                pool[i].inUse = true;
+                pool[i].lastFrame = frame;
+                return (int) i;
+            }
+        }
+
+        PhysicalTexture physical;
+        physical.desc = desc;
+        physical.inUse = true;
+        physical.lastFrame = frame;
+        glGenTextures(1, &physical.id);
+        glBindTexture(GL_TEXTURE_2D, physical.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        GLenum format, type;
+        transferFormat(desc.format, format, type);
+        glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0, format, type, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        pool.push_back(physical);
+        return (int) pool.size() - 1;
+    }
+
+    /* framebuffers are cached by their attachment list, which is stable as long as the graph is */
+    void assignFramebuffers()
+    {
+        for (int index : order) {
+            Pass &pass = passes[index];
+            pass.fbo = 0;
+            if (pass.writes.empty())
+                continue;
+
+            const VirtualTexture &first = textures[nodes[pass.writes[0]].texture];
+            pass.width = first.desc.width;
+            pass.height = first.desc.height;
+            if (first.imported) {
+                pass.fbo = first.importedFbo;
+                continue;
+            }
+
+            std::vector<unsigned> key;
+            for (FrameGraphResource write : pass.writes) {
+                const VirtualTexture &texture = textures[nodes[write].texture];
+                key.push_back(pool[texture.physical].id);
+            }
+
+            auto cached = framebuffers.find(key);
+            if (cached != framebuffers.end()) {
+                cached->second.lastFrame = frame;
+                pass.fbo = cached->second.id;
+                continue;
+            }
+
+            CachedFramebuffer framebuffer;
+            framebuffer.lastFrame = frame;
+            glGenFramebuffers(1, &framebuffer.id);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id);
+            std::vector<GLenum> drawBuffers;
+            for (FrameGraphResource write : pass.writes) {
+                const VirtualTexture &texture = textures[nodes[write].texture];
+                unsigned id = pool[texture.physical].id;
+                if (texture.desc.format == GL_DEPTH24_STENCIL8) {
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, id, 0);
+                } else if (isDepthFormat(texture.desc.format)) {
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, id, 0);
+                } else {
+                    GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum) drawBuffers.size();
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, id, 0);
+                    drawBuffers.push_back(attachment);
+                }
+            }
+            glDrawBuffers((GLsizei) drawBuffers.size(), drawBuffers.data());
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cerr << "Urk! Frame graph pass '" << pass.name << "' has an incomplete framebuffer!" << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            framebuffers[key] = framebuffer;
+            pass.fbo = framebuffer.id;
+        }
+    }
+
+    /* textures and framebuffers not touched for a few frames (e.g. after a resize) are released */
+    void evictUnused()
+    {
+        for (auto it = framebuffers.begin(); it != framebuffers.end();) {
+            if (frame - it->second.lastFrame > EVICT_AFTER_FRAMES) {
+                glDeleteFramebuffers(1, &it->second.id);
+                it = framebuffers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        std::vector<int> remap(pool.size(), -1);
+        std::vector<PhysicalTexture> kept;
+        for (unsigned i = 0; i < pool.size(); ++i) {
+            if (frame - pool[i].lastFrame > EVICT_AFTER_FRAMES) {
+                glDeleteTextures(1, &pool[i].id);
+            } else {
+                remap[i] = (int) kept.size();
+                kept.push_back(pool[i]);
+            }
+        }
+        if (kept.size() == pool.size())
+            return;
+        pool.swap(kept);
+        for (VirtualTexture &texture : textures)
+            if (texture.physical >= 0)
+                texture.physical = remap[texture.physical];
+    }
+};
+
+#endif //PROJECT_BASE_FRAMEGRAPH_H
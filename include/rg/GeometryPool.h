@@ -0,0 +1,239 @@
+#ifndef PROJECT_BASE_GEOMETRYPOOL_H
+#define PROJECT_BASE_GEOMETRYPOOL_H
+
+#include <glad/glad.h>
+
+#include <rg/GlStateCache.h>
+#include <rg/InstanceBuffer.h>
+#include <rg/OffsetAllocator.h>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/* One vertex buffer and one index buffer shared by every mesh of a vertex format, with the VAO over them.
+ * Instanced draws get a VAO of their own per instance buffer, the same two buffers plus that buffer's
+ * attributes, made the first time the buffer is drawn with and kept, so a ring of instance buffers costs
+ * binds, not attribute setup every frame. The VAOs are keyed by the buffer's serial, and one whose GL name
+ * turns up again on a newer buffer is deleted, as its buffer is gone.
+ * OffsetAllocators hand out the ranges, vertices in whole vertices so a mesh draws with its first vertex as
+ * the base vertex, indices in 4 byte units so 16 and 32 bit lists can sit side by side. A full buffer
+ * doubles, copied over on the GPU; defragment() packs the ranges to the front the same way after meshes
+ * were freed. Offsets move with both, so read them through the allocation every time instead of keeping
+ * them. Uploads go through GL_COPY_WRITE_BUFFER, which leaves whatever VAO is bound alone. */
+class GeometryPool {
+public:
+    static const unsigned INDEX_UNIT = 4;
+
+    struct Allocation {
+        OffsetAllocator::Handle vertices = OffsetAllocator::INVALID;
+        OffsetAllocator::Handle indices = OffsetAllocator::INVALID;
+    };
+
+    // setupAttributes points the attributes at the bound GL_ARRAY_BUFFER, it runs again whenever that changes
+    void create(unsigned vertexStride, std::function<void()> setupAttributes, unsigned vertexCapacity = 1 << 16,
+                unsigned indexCapacity = 1 << 20)
+    {
+        stride = vertexStride;
+        setup = setupAttributes;
+        vertexAllocator.reset(vertexCapacity);
+        indexAllocator.reset(indexCapacity / INDEX_UNIT);
+        glGenVertexArrays(1, &vao);
+        vbo = createBuffer((size_t) vertexCapacity * stride);
+        ebo = createBuffer((size_t) indexAllocator.totalSize() * INDEX_UNIT);
+        attachBuffers();
+    }
+
+    void destroy()
+    {
+        glDeleteVertexArrays(1, &vao);
+        for (const InstancedArray &array : instanced)
+            glDeleteVertexArrays(1, &array.vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+        vao = vbo = ebo = 0;
+        instanced.clear();
+    }
+
+    // copies a mesh in, growing the buffers if it doesn't fit
+    Allocation allocate(const void *vertices, unsigned vertexCount, const void *indices, size_t indexBytes)
+    {
+        Allocation allocation;
+        unsigned indexUnits = (unsigned) ((indexBytes + INDEX_UNIT - 1) / INDEX_UNIT);
+        allocation.vertices = vertexAllocator.allocate(vertexCount);
+        while (allocation.vertices == OffsetAllocator::INVALID) {
+            grow(vertexAllocator, vbo, stride);
+            allocation.vertices = vertexAllocator.allocate(vertexCount);
+        }
+        allocation.indices = indexAllocator.allocate(indexUnits);
+        while (allocation.indices == OffsetAllocator::INVALID) {
+            grow(indexAllocator, ebo, INDEX_UNIT);
+            allocation.indices = indexAllocator.allocate(indexUnits);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr) baseVertex(allocation) * stride, (GLsizeiptr) vertexCount * stride, vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr) indexOffset(allocation), (GLsizeiptr) indexBytes, indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return allocation;
+    }
+
+    void free(Allocation &allocation)
+    {
+        vertexAllocator.free(allocation.vertices);
+        indexAllocator.free(allocation.indices);
+        allocation = Allocation();
+    }
+
+    GLint baseVertex(const Allocation &allocation) const
+    {
+        return (GLint) vertexAllocator.offset(allocation.vertices);
+    }
+
+    // in bytes
+    size_t indexOffset(const Allocation &allocation) const
+    {
+        return (size_t) indexAllocator.offset(allocation.indices) * INDEX_UNIT;
+    }
+
+    // through GlStateCache, so back to back draws from one pool bind it once
+    void bind() const
+    {
+        GlStateCache::bindVertexArray(vao);
+    }
+
+    unsigned vertexArray() const
+    {
+        return vao;
+    }
+
+    // the VAO for instanced draws with the buffer, through GlStateCache like bind()
+    void bindInstanced(const InstanceBuffer &instances)
+    {
+        for (size_t i = 0; i < instanced.size(); ++i) {
+            if (instanced[i].instances != instances.name())
+                continue;
+            if (instanced[i].serial == instances.serial()) {
+                GlStateCache::bindVertexArray(instanced[i].vao);
+                return;
+            }
+            glDeleteVertexArrays(1, &instanced[i].vao);
+            instanced[i] = instanced.back();
+            instanced.pop_back();
+            break;
+        }
+        InstancedArray array;
+        array.instances = instances.name();
+        array.serial = instances.serial();
+        glGenVertexArrays(1, &array.vao);
+        attachBuffers(array.vao);
+        instances.attach(array.vao);
+        instanced.push_back(array);
+        GlStateCache::invalidate(GlStateCache::VERTEX_ARRAY);
+        GlStateCache::bindVertexArray(array.vao);
+    }
+
+    // whether freed ranges left holes, which defragment() would close
+    bool fragmented() const
+    {
+        return vertexAllocator.freeRanges() > 1 || indexAllocator.freeRanges() > 1;
+    }
+
+    void defragment()
+    {
+        std::vector<OffsetAllocator::Move> moves;
+        vertexAllocator.defragment(moves);
+        vbo = rebuild(vbo, (size_t) vertexAllocator.totalSize() * stride, moves, stride);
+        indexAllocator.defragment(moves);
+        ebo = rebuild(ebo, (size_t) indexAllocator.totalSize() * INDEX_UNIT, moves, INDEX_UNIT);
+        attachBuffers();
+    }
+
+    size_t usedBytes() const
+    {
+        return (size_t) vertexAllocator.usedSize() * stride + (size_t) indexAllocator.usedSize() * INDEX_UNIT;
+    }
+
+    size_t totalBytes() const
+    {
+        return (size_t) vertexAllocator.totalSize() * stride + (size_t) indexAllocator.totalSize() * INDEX_UNIT;
+    }
+
+    unsigned freeRanges() const
+    {
+        return vertexAllocator.freeRanges() + indexAllocator.freeRanges();
+    }
+
+private:
+    unsigned stride = 0;
+    std::function<void()> setup;
+    OffsetAllocator vertexAllocator, indexAllocator;
+    struct InstancedArray {
+        unsigned instances;
+        unsigned long long serial;
+        unsigned vao;
+    };
+
+    unsigned vao = 0, vbo = 0, ebo = 0;
+    std::vector<InstancedArray> instanced;
+
+    static unsigned createBuffer(size_t bytes)
+    {
+        unsigned buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr) bytes, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    // a new buffer of bytes with the moved ranges copied over from the old one, which goes
+    static unsigned rebuild(unsigned buffer, size_t bytes, const std::vector<OffsetAllocator::Move> &moves, unsigned unit)
+    {
+        unsigned result = createBuffer(bytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, result);
+        for (size_t i = 0; i < moves.size();) {
+            // ranges that stay next to each other go in one copy
+            OffsetAllocator::Move run = moves[i++];
+            while (i < moves.size() && moves[i].from == run.from + run.size && moves[i].to == run.to + run.size)
+                run.size += moves[i++].size;
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr) run.from * unit,
+                                (GLintptr) run.to * unit, (GLsizeiptr) run.size * unit);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        return result;
+    }
+
+    void grow(OffsetAllocator &allocator, unsigned &buffer, unsigned unit)
+    {
+        uint32_t size = allocator.totalSize();
+        std::vector<OffsetAllocator::Move> moves = {{0, 0, size}};
+        allocator.grow(size * 2);
+        buffer = rebuild(buffer, (size_t) size * 2 * unit, moves, unit);
+        attachBuffers();
+    }
+
+    // points every VAO at the current buffers, the instance attributes stay as they are
+    void attachBuffers()
+    {
+        attachBuffers(vao);
+        for (const InstancedArray &array : instanced)
+            attachBuffers(array.vao);
+    }
+
+    void attachBuffers(unsigned vertexArray)
+    {
+        glBindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        setup();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        GlStateCache::invalidate(GlStateCache::VERTEX_ARRAY);
+    }
+};
+
+#endif //PROJECT_BASE_GEOMETRYPOOL_H
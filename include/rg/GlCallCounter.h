@@ -0,0 +1,138 @@
+#ifndef PROJECT_BASE_GLCALLCOUNTER_H
+#define PROJECT_BASE_GLCALLCOUNTER_H
+
+#include <glad/glad.h>
+
+/* Counts draw calls and state changes by swapping counting trampolines into glad's function pointers.
+ * Every GL call in the program goes through the glad_gl* pointers, so nothing has to be instrumented by
+ * hand and the counters cost nothing unless install() was called. Install after gladLoadGL. */
+class GlCallCounter {
+public:
+    enum Counter {
+        DRAW_CALLS,
+        PROGRAM_BINDS,
+        TEXTURE_BINDS,
+        VERTEX_ARRAY_BINDS,
+        FRAMEBUFFER_BINDS,
+        STATE_CHANGES,
+        UNIFORM_UPLOADS,
+        DATA_UPLOADS,
+        COUNTER_COUNT
+    };
+
+    static const char *name(Counter counter)
+    {
+        static const char *names[COUNTER_COUNT] = {
+                "drawCalls", "programBinds", "textureBinds", "vertexArrayBinds", "framebufferBinds",
+                "stateChanges", "uniformUploads", "dataUploads"
+        };
+        return names[counter];
+    }
+
+    static unsigned long long *counts()
+    {
+        static unsigned long long values[COUNTER_COUNT] = {};
+        return values;
+    }
+
+    static void reset()
+    {
+        for (unsigned i = 0; i < COUNTER_COUNT; ++i)
+            counts()[i] = 0;
+    }
+
+    static void install()
+    {
+        hooks(true);
+    }
+
+    static void uninstall()
+    {
+        hooks(false);
+    }
+
+private:
+    template<typename Proc, Proc *Slot, Counter C>
+    struct Hook;
+
+    template<typename R, typename... Args, R (APIENTRYP *Slot)(Args...), Counter C>
+    struct Hook<R (APIENTRYP)(Args...), Slot, C> {
+        static R (APIENTRYP &original())(Args...)
+        {
+            static R (APIENTRYP proc)(Args...) = nullptr;
+            return proc;
+        }
+
+        static R APIENTRY call(Args... args)
+        {
+            ++counts()[C];
+            return original()(args...);
+        }
+
+        static void set(bool on)
+        {
+            if (on && *Slot != &call) {
+                original() = *Slot;
+                *Slot = &call;
+            } else if (!on && *Slot == &call) {
+                *Slot = original();
+            }
+        }
+    };
+
+#define GL_COUNTED(proc, counter) Hook<decltype(glad_##proc), &glad_##proc, counter>::set(on)
+
+    static void hooks(bool on)
+    {
+        GL_COUNTED(glDrawArrays, DRAW_CALLS);
+        GL_COUNTED(glDrawElements, DRAW_CALLS);
+        GL_COUNTED(glDrawArraysInstanced, DRAW_CALLS);
+        GL_COUNTED(glDrawElementsInstanced, DRAW_CALLS);
+        GL_COUNTED(glDrawElementsBaseVertex, DRAW_CALLS);
+        GL_COUNTED(glDrawElementsInstancedBaseVertex, DRAW_CALLS);
+        GL_COUNTED(glDrawRangeElements, DRAW_CALLS);
+        GL_COUNTED(glMultiDrawArrays, DRAW_CALLS);
+        GL_COUNTED(glMultiDrawElements, DRAW_CALLS);
+        GL_COUNTED(glMultiDrawElementsBaseVertex, DRAW_CALLS);
+
+        GL_COUNTED(glUseProgram, PROGRAM_BINDS);
+        GL_COUNTED(glBindTexture, TEXTURE_BINDS);
+        GL_COUNTED(glActiveTexture, STATE_CHANGES);
+        GL_COUNTED(glBindVertexArray, VERTEX_ARRAY_BINDS);
+        GL_COUNTED(glBindFramebuffer, FRAMEBUFFER_BINDS);
+
+        GL_COUNTED(glEnable, STATE_CHANGES);
+        GL_COUNTED(glDisable, STATE_CHANGES);
+        GL_COUNTED(glBlendFunc, STATE_CHANGES);
+        GL_COUNTED(glBlendEquation, STATE_CHANGES);
+        GL_COUNTED(glDepthFunc, STATE_CHANGES);
+        GL_COUNTED(glDepthMask, STATE_CHANGES);
+        GL_COUNTED(glCullFace, STATE_CHANGES);
+        GL_COUNTED(glViewport, STATE_CHANGES);
+        GL_COUNTED(glClearColor, STATE_CHANGES);
+
+        GL_COUNTED(glUniform1i, UNIFORM_UPLOADS);
+        GL_COUNTED(glUniform1f, UNIFORM_UPLOADS);
+        GL_COUNTED(glUniform2f, UNIFORM_UPLOADS);
+        GL_COUNTED(glUniform2fv, UNIFORM_UPLOADS);
+        GL_COUNTED(glUniform3f, UNIFORM_UPLOADS);
+        GL_COUNTED(glUniform3fv, UNIFORM_UPLOADS);
+        GL_COUNTED(glUniform4f, UNIFORM_UPLOADS);
+        GL_COUNTED(glUniform4fv, UNIFORM_UPLOADS);
+        GL_COUNTED(glUniformMatrix2fv, UNIFORM_UPLOADS);
+        GL_COUNTED(glUniformMatrix3fv, UNIFORM_UPLOADS);
+        GL_COUNTED(glUniformMatrix4fv, UNIFORM_UPLOADS);
+
+        GL_COUNTED(glBufferData, DATA_UPLOADS);
+        GL_COUNTED(glBufferSubData, DATA_UPLOADS);
+        GL_COUNTED(glCopyBufferSubData, DATA_UPLOADS);
+        GL_COUNTED(glTexImage2D, DATA_UPLOADS);
+        GL_COUNTED(glTexSubImage2D, DATA_UPLOADS);
+        GL_COUNTED(glCompressedTexImage2D, DATA_UPLOADS);
+        GL_COUNTED(glCompressedTexSubImage2D, DATA_UPLOADS);
+    }
+
+#undef GL_COUNTED
+};
+
+#endif //PROJECT_BASE_GLCALLCOUNTER_H
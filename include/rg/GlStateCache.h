@@ -0,0 +1,140 @@
+#ifndef PROJECT_BASE_GLSTATECACHE_H
+#define PROJECT_BASE_GLSTATECACHE_H
+
+#include <glad/glad.h>
+
+/* Program, texture and vertex array binds that skip themselves when they'd change nothing.
+ * Between begin() and end() the cache remembers what it last bound and drops binds that match; every bind
+ * in that stretch has to come through here, or be owned up to with invalidate(). begin()
+ * forgets everything, as anything may have run since, and end() leaves vertex array 0 and texture unit 0
+ * current like the hand-written draws used to after each call. Outside the two every bind is issued.
+ * stats() counts issued and skipped binds of each kind until resetStats(). */
+class GlStateCache {
+public:
+    enum Binding {
+        PROGRAM,
+        TEXTURE_UNIT,
+        TEXTURE,
+        VERTEX_ARRAY,
+        BINDING_COUNT
+    };
+
+    static const unsigned MAX_TEXTURE_UNITS = 16;
+
+    struct Stats {
+        unsigned long long issued[BINDING_COUNT] = {};
+        unsigned long long skipped[BINDING_COUNT] = {};
+    };
+
+    static const char *name(Binding binding)
+    {
+        static const char *names[BINDING_COUNT] = {"program", "texture unit", "texture", "vertex array"};
+        return names[binding];
+    }
+
+    static void begin()
+    {
+        State &s = state();
+        s.active = true;
+        for (unsigned binding = 0; binding < BINDING_COUNT; ++binding)
+            invalidate((Binding) binding);
+    }
+
+    static void end()
+    {
+        bindVertexArray(0);
+        activeTexture(0);
+        state().active = false;
+    }
+
+    static void useProgram(unsigned program)
+    {
+        if (changed(PROGRAM, state().program, program))
+            glUseProgram(program);
+    }
+
+    static void bindTexture(unsigned unit, GLenum target, unsigned texture)
+    {
+        State &s = state();
+        if (unit < MAX_TEXTURE_UNITS && s.active && s.textures[unit] == texture && s.targets[unit] == target) {
+            ++s.stats.skipped[TEXTURE];
+            return;
+        }
+        activeTexture(unit);
+        glBindTexture(target, texture);
+        ++s.stats.issued[TEXTURE];
+        if (unit < MAX_TEXTURE_UNITS) {
+            s.textures[unit] = texture;
+            s.targets[unit] = target;
+        }
+    }
+
+    static void bindVertexArray(unsigned vertexArray)
+    {
+        if (changed(VERTEX_ARRAY, state().vertexArray, vertexArray))
+            glBindVertexArray(vertexArray);
+    }
+
+    // for code that had to bind GL directly in between, the next bind of the kind goes through
+    static void invalidate(Binding binding)
+    {
+        State &s = state();
+        if (binding == PROGRAM)
+            s.program = UNKNOWN;
+        else if (binding == TEXTURE_UNIT)
+            s.unit = UNKNOWN;
+        else if (binding == VERTEX_ARRAY)
+            s.vertexArray = UNKNOWN;
+        else
+            for (unsigned unit = 0; unit < MAX_TEXTURE_UNITS; ++unit)
+                s.textures[unit] = UNKNOWN;
+    }
+
+    static const Stats &stats()
+    {
+        return state().stats;
+    }
+
+    static void resetStats()
+    {
+        state().stats = Stats();
+    }
+
+private:
+    static const unsigned UNKNOWN = 0xffffffffu;
+
+    struct State {
+        bool active = false;
+        unsigned program = UNKNOWN, vertexArray = UNKNOWN, unit = UNKNOWN;
+        unsigned textures[MAX_TEXTURE_UNITS] = {};
+        GLenum targets[MAX_TEXTURE_UNITS] = {};
+        Stats stats;
+    };
+
+    static State &state()
+    {
+        static State instance;
+        return instance;
+    }
+
+    static void activeTexture(unsigned unit)
+    {
+        if (changed(TEXTURE_UNIT, state().unit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // records value as current, false when the cache is on and it already was
+    static bool changed(Binding binding, unsigned &current, unsigned value)
+    {
+        State &s = state();
+        if (s.active && current == value) {
+            ++s.stats.skipped[binding];
+            return false;
+        }
+        current = value;
+        ++s.stats.issued[binding];
+        return true;
+    }
+};
+
+#endif //PROJECT_BASE_GLSTATECACHE_H
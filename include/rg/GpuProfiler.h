@@ -0,0 +1,328 @@
+#ifndef PROJECT_BASE_GPUPROFILER_H
+#define PROJECT_BASE_GPUPROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef GL_DEBUG_SOURCE_APPLICATION
+#define GL_DEBUG_SOURCE_APPLICATION 0x824A
+#endif
+
+/* Per pass GPU timings from GL_TIMESTAMP queries.
+ * Every scope writes a timestamp when it opens and when it closes, so scopes can nest. The queries of a
+ * frame are read back FRAME_LATENCY frames later, and only if the GPU already got to them: a frame that
+ * isn't done by then is dropped instead of waited for, so the profiler never stalls the pipeline. finish()
+ * does wait, for the frames still in flight when the run ends.
+ * Scopes with the same path in one frame (the 16 blur passes, say) are summed into one sample, and a
+ * rolling window of samples per scope gives the averages and percentiles shown in the panel.
+ * If the context has KHR_debug every scope is also pushed as a debug group, which is what RenderDoc,
+ * apitrace and friends show as the event hierarchy. */
+class GpuProfiler {
+public:
+    static const unsigned FRAME_LATENCY = 4;
+    static const unsigned HISTORY = 128;
+
+    struct ScopeStats {
+        std::string name;
+        unsigned depth;
+        float lastMs, averageMs, p50Ms, p95Ms, p99Ms;
+        // over every resolved frame rather than the rolling window
+        float runAverageMs;
+        unsigned long long runSamples;
+    };
+
+    typedef void *(*ProcLoader)(const char *name);
+
+    void init(ProcLoader loader)
+    {
+        GLint major = 0, minor = 0, extensionCount = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        bool khrDebug = major > 4 || (major == 4 && minor >= 3);
+        for (GLint i = 0; i < extensionCount && !khrDebug; ++i)
+            khrDebug = std::strcmp((const char *) glGetStringi(GL_EXTENSIONS, i), "GL_KHR_debug") == 0;
+        if (khrDebug) {
+            pushDebugGroup = (PushDebugGroupProc) loader("glPushDebugGroup");
+            popDebugGroup = (PopDebugGroupProc) loader("glPopDebugGroup");
+        }
+    }
+
+    void destroy()
+    {
+        for (Frame &frame : frames) {
+            if (!frame.queries.empty())
+                glDeleteQueries((GLsizei) frame.queries.size(), frame.queries.data());
+            frame.queries.clear();
+        }
+    }
+
+    bool debugGroupsAvailable() const
+    {
+        return pushDebugGroup != nullptr;
+    }
+
+    // collects the oldest frame in the ring if it is ready and opens the "frame" scope
+    void beginFrame()
+    {
+        current = &frames[frameIndex % FRAME_LATENCY];
+        if (current->pending)
+            collect(*current);
+        current->records.clear();
+        current->usedQueries = 0;
+        current->pending = false;
+        current->index = frameIndex;
+        path.clear();
+        stack.clear();
+        push("frame");
+    }
+
+    void endFrame()
+    {
+        while (!stack.empty())
+            pop();
+        current->pending = true;
+        ++frameIndex;
+    }
+
+    void push(const char *name)
+    {
+        if (pushDebugGroup)
+            pushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+        if (!current)
+            return;
+
+        size_t parentLength = path.size();
+        if (!path.empty())
+            path += '/';
+        path += name;
+
+        Record record;
+        record.scope = internScope(name);
+        record.begin = nextQuery();
+        record.end = 0;
+        glQueryCounter(record.begin, GL_TIMESTAMP);
+        current->records.push_back(record);
+        stack.push_back(Open{ current->records.size() - 1, parentLength });
+    }
+
+    void pop()
+    {
+        if (popDebugGroup)
+            popDebugGroup();
+        if (!current || stack.empty())
+            return;
+
+        Open open = stack.back();
+        stack.pop_back();
+        Record &record = current->records[open.record];
+        record.end = nextQuery();
+        glQueryCounter(record.end, GL_TIMESTAMP);
+        path.resize(open.parentPathLength);
+    }
+
+    // scopes in the order they first showed up, which is also a depth first order
+    const std::vector<ScopeStats> &stats()
+    {
+        summary.resize(scopes.size());
+        for (unsigned i = 0; i < scopes.size(); ++i) {
+            const ScopeHistory &scope = scopes[i];
+            ScopeStats &out = summary[i];
+            out.name = scope.name;
+            out.depth = scope.depth;
+            out.lastMs = scope.count ? scope.samples[(scope.head + HISTORY - 1) % HISTORY] : 0.0f;
+
+            sorted.assign(scope.samples, scope.samples + scope.count);
+            std::sort(sorted.begin(), sorted.end());
+            float sum = 0.0f;
+            for (float sample : sorted)
+                sum += sample;
+            out.averageMs = sorted.empty() ? 0.0f : sum / sorted.size();
+            out.p50Ms = percentile(sorted, 0.50f);
+            out.p95Ms = percentile(sorted, 0.95f);
+            out.p99Ms = percentile(sorted, 0.99f);
+            out.runAverageMs = scope.runSamples ? (float) (scope.runMs / scope.runSamples) : 0.0f;
+            out.runSamples = scope.runSamples;
+        }
+        return summary;
+    }
+
+    // restarts the averages and the window, e.g. after benchmark warmup. Frames begun before this still come
+    // back over the next few frames, they only go into frameMs()
+    void resetRunStats()
+    {
+        for (ScopeHistory &scope : scopes) {
+            scope.head = scope.count = 0;
+            scope.runMs = 0.0;
+            scope.runSamples = 0;
+        }
+        statsFrom = frameIndex;
+    }
+
+    // waits for the GPU and collects every frame still in flight, oldest first, so nothing ended is lost
+    void finish()
+    {
+        glFinish();
+        unsigned long long first = frameIndex > FRAME_LATENCY ? frameIndex - FRAME_LATENCY : 0;
+        for (unsigned long long index = first; index < frameIndex; ++index) {
+            Frame &frame = frames[index % FRAME_LATENCY];
+            if (frame.pending && frame.index == index)
+                collect(frame);
+        }
+    }
+
+    // GPU time of the last resolved frame, 0 until one comes back
+    float frameMs() const
+    {
+        return lastFrameMs;
+    }
+
+private:
+    typedef void (APIENTRYP PushDebugGroupProc)(GLenum source, GLuint id, GLsizei length, const GLchar *message);
+    typedef void (APIENTRYP PopDebugGroupProc)(void);
+
+    struct Record {
+        unsigned scope;
+        unsigned begin, end;
+    };
+
+    struct Open {
+        size_t record;
+        size_t parentPathLength;
+    };
+
+    struct Frame {
+        std::vector<unsigned> queries;
+        unsigned usedQueries = 0;
+        std::vector<Record> records;
+        bool pending = false;
+        unsigned long long index = 0;
+    };
+
+    struct ScopeHistory {
+        std::string name;
+        unsigned depth;
+        float samples[HISTORY];
+        unsigned head, count;
+        float frameSum;
+        bool seen;
+        double runMs;
+        unsigned long long runSamples;
+    };
+
+    PushDebugGroupProc pushDebugGroup = nullptr;
+    PopDebugGroupProc popDebugGroup = nullptr;
+
+    Frame frames[FRAME_LATENCY];
+    Frame *current = nullptr;
+    unsigned long long frameIndex = 0;
+    // first frame whose samples go into the stats
+    unsigned long long statsFrom = 0;
+    std::string path;
+    std::vector<Open> stack;
+    std::map<std::string, unsigned> scopeIndex;
+    std::vector<ScopeHistory> scopes;
+    std::vector<ScopeStats> summary;
+    std::vector<float> sorted;
+    float lastFrameMs = 0.0f;
+
+    unsigned nextQuery()
+    {
+        if (current->usedQueries == current->queries.size()) {
+            unsigned query;
+            glGenQueries(1, &query);
+            current->queries.push_back(query);
+        }
+        return current->queries[current->usedQueries++];
+    }
+
+    unsigned internScope(const char *name)
+    {
+        auto found = scopeIndex.find(path);
+        if (found != scopeIndex.end())
+            return found->second;
+
+        ScopeHistory scope;
+        scope.name = name;
+        scope.depth = (unsigned) stack.size();
+        scope.head = scope.count = 0;
+        scope.frameSum = 0.0f;
+        scope.seen = false;
+        scope.runMs = 0.0;
+        scope.runSamples = 0;
+        scopes.push_back(scope);
+        scopeIndex[path] = (unsigned) scopes.size() - 1;
+        return (unsigned) scopes.size() - 1;
+    }
+
+    void collect(Frame &frame)
+    {
+        frame.pending = false;
+        if (frame.records.empty())
+            return;
+
+        // queries complete in order, so the last one written tells whether the whole frame is in
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        for (ScopeHistory &scope : scopes) {
+            scope.frameSum = 0.0f;
+            scope.seen = false;
+        }
+        for (const Record &record : frame.records) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(record.begin, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(record.end, GL_QUERY_RESULT, &end);
+            ScopeHistory &scope = scopes[record.scope];
+            scope.frameSum += end > begin ? (float) (end - begin) * 1e-6f : 0.0f;
+            scope.seen = true;
+        }
+        lastFrameMs = scopes[frame.records[0].scope].frameSum;
+        if (frame.index < statsFrom)
+            return;
+        for (ScopeHistory &scope : scopes) {
+            if (!scope.seen)
+                continue;
+            scope.samples[scope.head] = scope.frameSum;
+            scope.head = (scope.head + 1) % HISTORY;
+            if (scope.count < HISTORY)
+                ++scope.count;
+            scope.runMs += scope.frameSum;
+            ++scope.runSamples;
+        }
+    }
+
+    static float percentile(const std::vector<float> &sortedSamples, float p)
+    {
+        if (sortedSamples.empty())
+            return 0.0f;
+        size_t index = (size_t) (p * (sortedSamples.size() - 1) + 0.5f);
+        return sortedSamples[index];
+    }
+};
+
+/* opens a scope for the lifetime of the object */
+class GpuScope {
+public:
+    GpuScope(GpuProfiler &p, const char *name) : profiler(p)
+    {
+        profiler.push(name);
+    }
+
+    ~GpuScope()
+    {
+        profiler.pop();
+    }
+
+private:
+    GpuProfiler &profiler;
+};
+
+#endif //PROJECT_BASE_GPUPROFILER_H
@@ -0,0 +1,121 @@
+#ifndef PROJECT_BASE_INSTANCEBUFFER_H
+#define PROJECT_BASE_INSTANCEBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+/* per instance vertex data, read by the *_instanced_vertex_shader.vs variants */
+struct InstanceData {
+    glm::mat4 model;
+    glm::vec4 tint = glm::vec4(1.0f);
+};
+
+/* Vertex buffer of InstanceData, stepped once per instance.
+ * attach() adds it to a VAO: the model matrix as four vec4 columns at locations 5-8 and the tint at 9,
+ * each with divisor 1, leaving 0-4 to the mesh's own vertex attributes. The buffer keeps its name when it
+ * grows, so a VAO only needs attaching once. */
+class InstanceBuffer {
+public:
+    static const unsigned MODEL_LOCATION = 5;
+    static const unsigned TINT_LOCATION = 9;
+
+    void create(GLenum bufferUsage = GL_STATIC_DRAW)
+    {
+        static unsigned long long created = 0;
+        usage = bufferUsage;
+        glGenBuffers(1, &id);
+        generation = ++created;
+    }
+
+    void destroy()
+    {
+        glDeleteBuffers(1, &id);
+        id = 0;
+        capacity = instances = 0;
+    }
+
+    void upload(const InstanceData *data, unsigned count)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        if (count > capacity) {
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(InstanceData), data, usage);
+            capacity = count;
+        } else {
+            // orphan the old storage so a draw still reading it doesn't stall the upload
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr, usage);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), data);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        instances = count;
+    }
+
+    void upload(const std::vector<InstanceData> &data)
+    {
+        upload(data.data(), (unsigned) data.size());
+    }
+
+    // storage for at least count instances with undefined contents, for buffers the GPU fills
+    void allocate(unsigned count)
+    {
+        if (count > capacity) {
+            glBindBuffer(GL_ARRAY_BUFFER, id);
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(InstanceData), nullptr, usage);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            capacity = count;
+        }
+        instances = 0;
+    }
+
+    // number of instances the GPU wrote, clamped to the storage
+    void setCount(unsigned count)
+    {
+        instances = count < capacity ? count : capacity;
+    }
+
+    // divisor 0 steps the instances per vertex instead, for passes that process the instances themselves
+    void attach(unsigned vao, unsigned divisor = 1) const
+    {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        for (unsigned column = 0; column < 4; ++column) {
+            glEnableVertexAttribArray(MODEL_LOCATION + column);
+            glVertexAttribPointer(MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void *) (offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(MODEL_LOCATION + column, divisor);
+        }
+        glEnableVertexAttribArray(TINT_LOCATION);
+        glVertexAttribPointer(TINT_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void *) offsetof(InstanceData, tint));
+        glVertexAttribDivisor(TINT_LOCATION, divisor);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    unsigned name() const
+    {
+        return id;
+    }
+
+    // different for every create(), where GL may hand a deleted buffer's name to a new one
+    unsigned long long serial() const
+    {
+        return generation;
+    }
+
+    unsigned count() const
+    {
+        return instances;
+    }
+
+private:
+    unsigned id = 0;
+    GLenum usage = GL_STATIC_DRAW;
+    unsigned capacity = 0;
+    unsigned instances = 0;
+    unsigned long long generation = 0;
+};
+
+#endif //PROJECT_BASE_INSTANCEBUFFER_H
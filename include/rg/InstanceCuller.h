@@ -0,0 +1,181 @@
+#ifndef PROJECT_BASE_INSTANCECULLER_H
+#define PROJECT_BASE_INSTANCECULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/InstanceBuffer.h>
+
+#include <string>
+
+/* Culling state of one instanced field: the compacted copies of its instances and their queries.
+ * The survivors of a cull are only counted once its GL_PRIMITIVES_GENERATED query has a result, and the
+ * query is polled, never waited on. Until it lands the newest finished copy is drawn, so there are SLOTS
+ * copies in flight and what is drawn lags the camera by about a frame (the frustum margin hides that).
+ * Before the first cull has finished, instances() is the source itself. */
+class CulledInstances {
+public:
+    static const unsigned SLOTS = 3;
+
+    void create()
+    {
+        glGenVertexArrays(1, &vao);
+        glGenQueries(SLOTS, queries);
+        for (unsigned i = 0; i < SLOTS; ++i) {
+            slots[i].create(GL_STREAM_COPY);
+            pending[i] = false;
+            sequence[i] = 0;
+        }
+        visibleSlot = -1;
+        attachedSource = 0;
+    }
+
+    void destroy()
+    {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteQueries(SLOTS, queries);
+        for (unsigned i = 0; i < SLOTS; ++i)
+            slots[i].destroy();
+        vao = 0;
+    }
+
+    // what to draw: the newest compacted copy, or the source while there is none
+    const InstanceBuffer &instances(const InstanceBuffer &source) const
+    {
+        return visibleSlot < 0 ? source : slots[visibleSlot];
+    }
+
+private:
+    friend class InstanceCuller;
+
+    unsigned vao = 0;
+    unsigned attachedSource = 0;
+    InstanceBuffer slots[SLOTS];
+    unsigned queries[SLOTS] = {};
+    bool pending[SLOTS] = {};
+    unsigned sequence[SLOTS] = {};
+    unsigned nextSequence = 0;
+    int visibleSlot = -1;
+
+    // picks up finished culls, the newest one becomes visible
+    void collect()
+    {
+        for (unsigned i = 0; i < SLOTS; ++i) {
+            if (!pending[i])
+                continue;
+            GLuint available = 0;
+            glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint survivors = 0;
+            glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &survivors);
+            slots[i].setCount(survivors);
+            pending[i] = false;
+            if (visibleSlot < 0 || sequence[i] > sequence[visibleSlot])
+                visibleSlot = (int) i;
+        }
+    }
+
+    // a slot that is neither being drawn nor still being written, -1 if the GPU is too far behind
+    int freeSlot() const
+    {
+        for (unsigned i = 0; i < SLOTS; ++i)
+            if (!pending[i] && (int) i != visibleSlot)
+                return (int) i;
+        return -1;
+    }
+};
+
+/* Frustum and screen size culling of instance buffers on the GPU.
+ * A vertex shader tests every instance's bounding sphere and a geometry shader streams the survivors
+ * through transform feedback into a compacted InstanceBuffer, with the rasterizer off. The CPU never
+ * touches the instances, so its cost per field is the same for a hundred instances or a million. */
+class InstanceCuller {
+public:
+    // world units added to every bounding sphere, covers the frame the results lag behind
+    float margin = 0.5f;
+    // instances whose bounding sphere projects smaller than this many pixels are dropped, 0 keeps all
+    float minPixelRadius = 0.5f;
+    bool enabled = true;
+
+    InstanceCuller(const char *vertexPath, const char *geometryPath, const char *fragmentPath)
+        : cullShader(vertexPath, fragmentPath, geometryPath, { "cullModel", "cullTint" })
+    {
+        modelUniform = cullShader.uniform("model");
+        boundingSphereUniform = cullShader.uniform("boundingSphere");
+        marginUniform = cullShader.uniform("frustumMargin");
+        projectionScaleUniform = cullShader.uniform("projectionScale");
+        minPixelRadiusUniform = cullShader.uniform("minPixelRadius");
+        for (unsigned i = 0; i < 6; ++i)
+            planeUniforms[i] = cullShader.uniform("frustumPlanes[" + std::to_string(i) + "]");
+    }
+
+    // frustum of this frame's camera, call before culling
+    void setView(const glm::mat4 &projection, const glm::mat4 &view, unsigned viewportHeight)
+    {
+        frustum = Frustum(projection * view);
+        projectionScale = projection[1][1] * 0.5f * (float) viewportHeight;
+    }
+
+    /* Culls source, drawn with groupModel, into the field's next free copy. center and radius bound
+     * the mesh in object space. With culling off, or nothing to cull, the field goes back to drawing the
+     * source. */
+    void cull(CulledInstances &field, const InstanceBuffer &source, const glm::mat4 &groupModel,
+              const glm::vec3 &center, float radius)
+    {
+        if (!enabled) {
+            field.visibleSlot = -1;
+            return;
+        }
+        field.collect();
+        if (source.count() == 0) {
+            field.visibleSlot = -1;
+            return;
+        }
+        int slot = field.freeSlot();
+        if (slot < 0)
+            return;
+
+        if (field.attachedSource != source.name()) {
+            source.attach(field.vao, 0);
+            field.attachedSource = source.name();
+        }
+        InstanceBuffer &target = field.slots[slot];
+        target.allocate(source.count());
+
+        cullShader.use();
+        cullShader.setMat4(modelUniform, groupModel);
+        cullShader.setVec4(boundingSphereUniform, glm::vec4(center, radius));
+        cullShader.setFloat(marginUniform, margin);
+        cullShader.setFloat(projectionScaleUniform, projectionScale);
+        cullShader.setFloat(minPixelRadiusUniform, minPixelRadius);
+        for (unsigned i = 0; i < 6; ++i)
+            cullShader.setVec4(planeUniforms[i], frustum.planes[i]);
+
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(field.vao);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, target.name());
+        glBeginQuery(GL_PRIMITIVES_GENERATED, field.queries[slot]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, source.count());
+        glEndTransformFeedback();
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+
+        field.pending[slot] = true;
+        field.sequence[slot] = ++field.nextSequence;
+    }
+
+private:
+    Shader cullShader;
+    UniformHandle modelUniform, boundingSphereUniform, marginUniform, projectionScaleUniform, minPixelRadiusUniform;
+    UniformHandle planeUniforms[6];
+    Frustum frustum;
+    float projectionScale = 0.0f;
+};
+
+#endif //PROJECT_BASE_INSTANCECULLER_H
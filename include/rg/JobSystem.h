@@ -0,0 +1,270 @@
+#ifndef PROJECT_BASE_JOBSYSTEM_H
+#define PROJECT_BASE_JOBSYSTEM_H
+
+#include <rg/CpuProfiler.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+struct Job {
+    std::function<void()> work;
+    // decremented once work returns
+    JobCounter *counter = nullptr;
+};
+
+/* Counts the unfinished jobs that were started against it and keeps the jobs waiting for it to reach zero.
+ * A counter has to outlive every job that signals it; waiting on it before it goes out of scope makes
+ * sure of that. */
+class JobCounter {
+public:
+    bool done()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending == 0;
+    }
+
+private:
+    friend class JobSystem;
+    std::mutex mutex;
+    unsigned pending = 0;
+    std::vector<Job> waiting;
+};
+
+/* Work stealing job system.
+ * Each thread has its own deque: it pushes and pops jobs at the back, so it keeps working on what it just
+ * split off while the data is still in cache, and idle threads steal from the front of the others, which
+ * is where the biggest and oldest work sits. The deques are short critical sections behind their own
+ * mutex; idle workers sleep until something gets queued. The thread that created the system is thread 0
+ * and works too whenever it waits on a counter, so waiting inside a job doesn't block a worker. Jobs that
+ * depend on a counter are parked on it and queued when it reaches zero. */
+class JobSystem {
+public:
+    // threads counts the creating thread, 0 takes one per hardware thread
+    explicit JobSystem(unsigned threads = 0)
+    {
+        resize(threads);
+    }
+
+    ~JobSystem()
+    {
+        stopWorkers();
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // only while no jobs are in flight
+    void resize(unsigned threads)
+    {
+        stopWorkers();
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        if (threads == 0)
+            threads = 1;
+        stopping = false;
+        queues.clear();
+        for (unsigned i = 0; i < threads; ++i)
+            queues.emplace_back(new Queue);
+        owner() = this;
+        threadIndex() = 0;
+        for (unsigned i = 1; i < threads; ++i)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    unsigned size() const
+    {
+        return (unsigned) queues.size();
+    }
+
+    void run(std::function<void()> work, JobCounter &counter)
+    {
+        {
+            std::lock_guard<std::mutex> lock(counter.mutex);
+            ++counter.pending;
+        }
+        push(Job{std::move(work), &counter});
+    }
+
+    // runs work once dependency reaches zero
+    void runAfter(JobCounter &dependency, std::function<void()> work, JobCounter &counter)
+    {
+        {
+            std::lock_guard<std::mutex> lock(counter.mutex);
+            ++counter.pending;
+        }
+        Job job{std::move(work), &counter};
+        {
+            std::lock_guard<std::mutex> lock(dependency.mutex);
+            if (dependency.pending > 0) {
+                dependency.waiting.push_back(std::move(job));
+                return;
+            }
+        }
+        push(std::move(job));
+    }
+
+    // jobs calling body(begin, end) for chunks of at most grain indices covering [0, count)
+    void parallelFor(unsigned count, unsigned grain, std::function<void(unsigned, unsigned)> body, JobCounter &counter)
+    {
+        if (grain == 0)
+            grain = 1;
+        std::shared_ptr<std::function<void(unsigned, unsigned)>> shared =
+                std::make_shared<std::function<void(unsigned, unsigned)>>(std::move(body));
+        for (unsigned begin = 0; begin < count; begin += grain) {
+            unsigned end = count - begin > grain ? begin + grain : count;
+            run([shared, begin, end] { (*shared)(begin, end); }, counter);
+        }
+    }
+
+    // the same, returning when all chunks are done; small loops run right here
+    void parallelFor(unsigned count, unsigned grain, const std::function<void(unsigned, unsigned)> &body)
+    {
+        if (count <= grain || queues.size() == 1) {
+            if (count > 0)
+                body(0, count);
+            return;
+        }
+        JobCounter counter;
+        parallelFor(count, grain, [&body](unsigned begin, unsigned end) { body(begin, end); }, counter);
+        wait(counter);
+    }
+
+    // runs other jobs until the counter is done
+    void wait(JobCounter &counter)
+    {
+        unsigned index = currentIndex();
+        while (!counter.done()) {
+            Job job;
+            if (pop(index, job))
+                execute(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> queued{0};
+    std::atomic<unsigned> sleepers{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static JobSystem *&owner()
+    {
+        thread_local JobSystem *system = nullptr;
+        return system;
+    }
+
+    static unsigned &threadIndex()
+    {
+        thread_local unsigned index = 0;
+        return index;
+    }
+
+    // threads that aren't ours push to and wait on thread 0's deque
+    unsigned currentIndex() const
+    {
+        return owner() == this ? threadIndex() : 0;
+    }
+
+    void push(Job job)
+    {
+        Queue &queue = *queues[currentIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        queued.fetch_add(1);
+        if (sleepers.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wake.notify_one();
+        }
+    }
+
+    // the back of our own deque, else the front of someone else's
+    bool pop(unsigned index, Job &job)
+    {
+        if (queued.load(std::memory_order_relaxed) == 0)
+            return false;
+        unsigned count = (unsigned) queues.size();
+        for (unsigned offset = 0; offset < count; ++offset) {
+            Queue &queue = *queues[(index + offset) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+            if (offset == 0) {
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+            } else {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+            }
+            queued.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void execute(Job &job)
+    {
+        job.work();
+        std::vector<Job> ready;
+        {
+            std::lock_guard<std::mutex> lock(job.counter->mutex);
+            if (--job.counter->pending == 0)
+                ready.swap(job.counter->waiting);
+        }
+        // the counter may be gone from here on
+        for (Job &next : ready)
+            push(std::move(next));
+    }
+
+    void work(unsigned index)
+    {
+        owner() = this;
+        threadIndex() = index;
+        CpuProfiler::setThreadName("job worker");
+        for (;;) {
+            Job job;
+            if (pop(index, job)) {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepers.fetch_add(1);
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            sleepers.fetch_sub(1);
+            if (stopping)
+                return;
+        }
+    }
+
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+        workers.clear();
+    }
+};
+
+#endif //PROJECT_BASE_JOBSYSTEM_H
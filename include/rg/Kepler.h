@@ -0,0 +1,288 @@
+#ifndef PROJECT_BASE_KEPLER_H
+#define PROJECT_BASE_KEPLER_H
+
+#include <glm/glm.hpp>
+
+#include <rg/JobSystem.h>
+
+#include <cmath>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RG_KEPLER_AVX2 1
+#define RG_KEPLER_AVX2_TARGET __attribute__((target("avx2,fma")))
+#include <immintrin.h>
+#endif
+
+/* Classical elements of an orbit around a body at the origin, angles in radians.
+ * The reference plane is the world's xz plane: ecliptic x and y map to world x and z and the ecliptic
+ * pole to world y, so a prograde orbit runs from +x towards +z. */
+struct OrbitalElements {
+    float semiMajorAxis = 1.0f;
+    float eccentricity = 0.0f;
+    float inclination = 0.0f;
+    float ascendingNode = 0.0f;
+    float argumentOfPeriapsis = 0.0f;
+    // at time 0
+    float meanAnomaly = 0.0f;
+    // seconds per revolution
+    float period = 1.0f;
+};
+
+/* J2000 mean elements of the planets (Standish, JPL's approximate positions table), the Earth's being the
+ * Earth-Moon barycentre's. Sizes in AU, angles in degrees, periods in years. elements() scales one to the
+ * scene, so putting a planet in is a table lookup and a KeplerOrbits::add(). */
+struct Planet {
+    enum Index {
+        MERCURY,
+        VENUS,
+        EARTH,
+        MARS,
+        JUPITER,
+        SATURN,
+        URANUS,
+        NEPTUNE,
+        COUNT
+    };
+
+    const char *name;
+    double semiMajorAxis;
+    double eccentricity;
+    double inclination;
+    double meanLongitude;
+    double perihelionLongitude;
+    double ascendingNode;
+    double period;
+
+    static const Planet &get(Index planet)
+    {
+        static const Planet planets[COUNT] = {
+                {"Mercury", 0.38709927, 0.20563593, 7.00497902, 252.25032350, 77.45779628, 48.33076593, 0.2408467},
+                {"Venus", 0.72333566, 0.00677672, 3.39467605, 181.97909950, 131.60246718, 76.67984255, 0.61519726},
+                {"Earth", 1.00000261, 0.01671123, -0.00001531, 100.46457166, 102.93768193, 0.0, 1.0000174},
+                {"Mars", 1.52371034, 0.09339410, 1.84969142, -4.55343205, -23.94362959, 49.55953891, 1.8808476},
+                {"Jupiter", 5.20288700, 0.04838624, 1.30439695, 34.39644051, 14.72847983, 100.47390909, 11.862615},
+                {"Saturn", 9.53667594, 0.05386179, 2.48599187, 49.95424423, 92.59887831, 113.66242448, 29.447498},
+                {"Uranus", 19.18916464, 0.04725744, 0.77263783, 313.23810451, 170.95427630, 74.01692503, 84.016846},
+                {"Neptune", 30.06992276, 0.00859048, 1.77004347, -55.12002969, 44.96476227, 131.78422574, 164.79132}
+        };
+        return planets[planet];
+    }
+
+    // unitsPerAu scene units to an AU and secondsPerYear seconds to a year of the orbit clock
+    OrbitalElements elements(float unitsPerAu, float secondsPerYear) const
+    {
+        const double degrees = 0.017453292519943295;
+        OrbitalElements orbit;
+        orbit.semiMajorAxis = (float) (semiMajorAxis * unitsPerAu);
+        orbit.eccentricity = (float) eccentricity;
+        orbit.inclination = (float) (inclination * degrees);
+        orbit.ascendingNode = (float) (ascendingNode * degrees);
+        orbit.argumentOfPeriapsis = (float) ((perihelionLongitude - ascendingNode) * degrees);
+        orbit.meanAnomaly = (float) ((meanLongitude - perihelionLongitude) * degrees);
+        orbit.period = (float) (period * secondsPerYear);
+        return orbit;
+    }
+};
+
+/* Closed form Keplerian orbits for many bodies, kept as a structure of arrays.
+ * Positions are a function of time alone: the mean anomaly is taken in double precision and wrapped to
+ * [-pi, pi] before anything else, so a time warped clock a million times faster than real time gives the
+ * same orbits as a slow one and nothing accumulates from frame to frame. Kepler's equation is solved with
+ * a fixed number of Newton steps from Danby's starting guess, eight bodies at a time with AVX2 and FMA
+ * when the CPU has them. Only those functions are compiled for AVX2, the choice is made once at run time,
+ * so the build runs anywhere and the scalar path keeps plain float results. The orbit's plane is baked
+ * into two vectors at add(), so a body costs a handful of multiply-adds after the solve. */
+class KeplerOrbits {
+public:
+    // enough for eccentricities up to 0.97 to float precision
+    static const unsigned NEWTON_STEPS = 6;
+
+    unsigned add(const OrbitalElements &orbit)
+    {
+        float e = orbit.eccentricity;
+        float so = std::sin(orbit.argumentOfPeriapsis), co = std::cos(orbit.argumentOfPeriapsis);
+        float sn = std::sin(orbit.ascendingNode), cn = std::cos(orbit.ascendingNode);
+        float si = std::sin(orbit.inclination), ci = std::cos(orbit.inclination);
+        // periapsis direction and the in-plane direction a quarter turn ahead of it, ecliptic y and z swapped
+        glm::vec3 p(co * cn - so * sn * ci, so * si, co * sn + so * cn * ci);
+        glm::vec3 q(-so * cn - co * sn * ci, co * si, -so * sn + co * cn * ci);
+        meanAnomaly.push_back(orbit.meanAnomaly);
+        meanMotion.push_back(6.283185307179586 / orbit.period);
+        eccentricity.push_back(e);
+        float a = orbit.semiMajorAxis, b = a * std::sqrt(1.0f - e * e);
+        periapsisX.push_back(p.x * a);
+        periapsisY.push_back(p.y * a);
+        periapsisZ.push_back(p.z * a);
+        minorX.push_back(q.x * b);
+        minorY.push_back(q.y * b);
+        minorZ.push_back(q.z * b);
+        return size() - 1;
+    }
+
+    void clear()
+    {
+        meanAnomaly.clear();
+        meanMotion.clear();
+        std::vector<float> *arrays[] = {
+                &eccentricity, &periapsisX, &periapsisY, &periapsisZ, &minorX, &minorY, &minorZ
+        };
+        for (std::vector<float> *array : arrays)
+            array->clear();
+    }
+
+    void reserve(unsigned count)
+    {
+        meanAnomaly.reserve(count);
+        meanMotion.reserve(count);
+        std::vector<float> *arrays[] = {
+                &eccentricity, &periapsisX, &periapsisY, &periapsisZ, &minorX, &minorY, &minorZ
+        };
+        for (std::vector<float> *array : arrays)
+            array->reserve(count);
+    }
+
+    unsigned size() const
+    {
+        return (unsigned) eccentricity.size();
+    }
+
+    glm::vec3 position(unsigned body, double time) const
+    {
+        return solve(time, body);
+    }
+
+    /* Positions at time of bodies [first, last), written to x[i], y[i], z[i] for body i. */
+    void propagate(double time, unsigned first, unsigned last, float *x, float *y, float *z) const
+    {
+        unsigned i = first;
+#ifdef RG_KEPLER_AVX2
+        if (avx2())
+            for (; i + 8 <= last; i += 8)
+                propagate8(time, i, x, y, z);
+#endif
+        for (; i < last; ++i) {
+            glm::vec3 position = solve(time, i);
+            x[i] = position.x;
+            y[i] = position.y;
+            z[i] = position.z;
+        }
+    }
+
+    // the same for all bodies, spread over the job system
+    void propagate(double time, JobSystem &jobs, float *x, float *y, float *z) const
+    {
+        jobs.parallelFor(size(), 8192, [&](unsigned begin, unsigned end) {
+            propagate(time, begin, end, x, y, z);
+        });
+    }
+
+    // as jobs signalling counter, the orbits and outputs have to stay put until it is done
+    void propagate(double time, JobSystem &jobs, float *x, float *y, float *z, JobCounter &counter) const
+    {
+        jobs.parallelFor(size(), 8192, [this, time, x, y, z](unsigned begin, unsigned end) {
+            propagate(time, begin, end, x, y, z);
+        }, counter);
+    }
+
+private:
+    std::vector<double> meanAnomaly, meanMotion;
+    std::vector<float> eccentricity;
+    // semi-major axis along the periapsis, semi-minor axis a quarter turn ahead
+    std::vector<float> periapsisX, periapsisY, periapsisZ, minorX, minorY, minorZ;
+
+    // Cephes style sine and cosine for |x| up to a few pi: quadrant reduction, then polynomials on [-pi/4, pi/4]
+    static void sinCos(float x, float &s, float &c)
+    {
+        float quadrant = std::nearbyint(x * 0.63661977f);
+        float r = ((x - quadrant * 1.5703125f) - quadrant * 4.8375129699707031e-4f) - quadrant * 7.5497899548918821e-8f;
+        float r2 = r * r;
+        float sr = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+        float cr = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+        int q = (int) quadrant & 3;
+        s = q == 0 ? sr : q == 1 ? cr : q == 2 ? -sr : -cr;
+        c = q == 0 ? cr : q == 1 ? -sr : q == 2 ? -cr : sr;
+    }
+
+    glm::vec3 solve(double time, unsigned i) const
+    {
+        double turns = meanAnomaly[i] + meanMotion[i] * time;
+        float m = (float) (turns - 6.283185307179586 * std::nearbyint(turns * 0.15915494309189535));
+        float e = eccentricity[i];
+        float anomaly = m + (m < 0.0f ? -0.85f : 0.85f) * e;
+        float s, c;
+        for (unsigned step = 0; step < NEWTON_STEPS; ++step) {
+            sinCos(anomaly, s, c);
+            anomaly -= (anomaly - e * s - m) / (1.0f - e * c);
+        }
+        sinCos(anomaly, s, c);
+        float alongPeriapsis = c - e;
+        return glm::vec3(periapsisX[i] * alongPeriapsis + minorX[i] * s, periapsisY[i] * alongPeriapsis + minorY[i] * s,
+                         periapsisZ[i] * alongPeriapsis + minorZ[i] * s);
+    }
+
+#ifdef RG_KEPLER_AVX2
+    static bool avx2()
+    {
+        static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        return supported;
+    }
+
+    RG_KEPLER_AVX2_TARGET static void sinCos8(__m256 x, __m256 &s, __m256 &c)
+    {
+        __m256 quadrant = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(0.63661977f)),
+                                          _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256 r = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(1.5703125f), x);
+        r = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(4.8375129699707031e-4f), r);
+        r = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(7.5497899548918821e-8f), r);
+        __m256 r2 = _mm256_mul_ps(r, r);
+        __m256 sr = _mm256_fmadd_ps(r2, _mm256_set1_ps(-1.9515295891e-4f), _mm256_set1_ps(8.3321608736e-3f));
+        sr = _mm256_fmadd_ps(r2, sr, _mm256_set1_ps(-1.6666654611e-1f));
+        sr = _mm256_fmadd_ps(_mm256_mul_ps(r, r2), sr, r);
+        __m256 cr = _mm256_fmadd_ps(r2, _mm256_set1_ps(2.443315711809948e-5f), _mm256_set1_ps(-1.388731625493765e-3f));
+        cr = _mm256_fmadd_ps(r2, cr, _mm256_set1_ps(4.166664568298827e-2f));
+        cr = _mm256_fmadd_ps(_mm256_mul_ps(r2, r2), cr, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), r2, _mm256_set1_ps(1.0f)));
+        // odd quadrants swap sine and cosine, the sign bits follow quadrant bit 1 for sine and (quadrant + 1) bit 1 for cosine
+        __m256i q = _mm256_cvtps_epi32(quadrant);
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+        __m256 sineSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30));
+        __m256 cosineSign = _mm256_castsi256_ps(
+                _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+        s = _mm256_xor_ps(_mm256_blendv_ps(sr, cr, swap), sineSign);
+        c = _mm256_xor_ps(_mm256_blendv_ps(cr, sr, swap), cosineSign);
+    }
+
+    RG_KEPLER_AVX2_TARGET void propagate8(double time, unsigned i, float *x, float *y, float *z) const
+    {
+        __m256d t = _mm256_set1_pd(time), turn = _mm256_set1_pd(6.283185307179586);
+        __m256d inverseTurn = _mm256_set1_pd(0.15915494309189535);
+        __m256d low = _mm256_fmadd_pd(_mm256_loadu_pd(&meanMotion[i]), t, _mm256_loadu_pd(&meanAnomaly[i]));
+        __m256d high = _mm256_fmadd_pd(_mm256_loadu_pd(&meanMotion[i + 4]), t, _mm256_loadu_pd(&meanAnomaly[i + 4]));
+        low = _mm256_fnmadd_pd(turn, _mm256_round_pd(_mm256_mul_pd(low, inverseTurn), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC), low);
+        high = _mm256_fnmadd_pd(turn, _mm256_round_pd(_mm256_mul_pd(high, inverseTurn), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC), high);
+        __m256 m = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(low)), _mm256_cvtpd_ps(high), 1);
+
+        __m256 e = _mm256_loadu_ps(&eccentricity[i]);
+        // Danby's guess, m + 0.85 e with the sign of m
+        __m256 signOfM = _mm256_and_ps(m, _mm256_set1_ps(-0.0f));
+        __m256 anomaly = _mm256_fmadd_ps(_mm256_or_ps(_mm256_set1_ps(0.85f), signOfM), e, m);
+        __m256 s, c;
+        for (unsigned step = 0; step < NEWTON_STEPS; ++step) {
+            sinCos8(anomaly, s, c);
+            __m256 residual = _mm256_sub_ps(_mm256_fnmadd_ps(e, s, anomaly), m);
+            __m256 slope = _mm256_fnmadd_ps(e, c, _mm256_set1_ps(1.0f));
+            anomaly = _mm256_sub_ps(anomaly, _mm256_div_ps(residual, slope));
+        }
+        sinCos8(anomaly, s, c);
+        __m256 alongPeriapsis = _mm256_sub_ps(c, e);
+        _mm256_storeu_ps(x + i, _mm256_fmadd_ps(_mm256_loadu_ps(&periapsisX[i]), alongPeriapsis,
+                                                _mm256_mul_ps(_mm256_loadu_ps(&minorX[i]), s)));
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(_mm256_loadu_ps(&periapsisY[i]), alongPeriapsis,
+                                                _mm256_mul_ps(_mm256_loadu_ps(&minorY[i]), s)));
+        _mm256_storeu_ps(z + i, _mm256_fmadd_ps(_mm256_loadu_ps(&periapsisZ[i]), alongPeriapsis,
+                                                _mm256_mul_ps(_mm256_loadu_ps(&minorZ[i]), s)));
+    }
+#endif
+};
+
+#endif //PROJECT_BASE_KEPLER_H
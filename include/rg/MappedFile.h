@@ -0,0 +1,106 @@
+#ifndef PROJECT_BASE_MAPPEDFILE_H
+#define PROJECT_BASE_MAPPEDFILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+const uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+// FNV-1a, continues from hash so several pieces chain into one
+inline uint64_t fnv1a(const void *data, size_t bytes, uint64_t hash = FNV_OFFSET)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    for (size_t i = 0; i < bytes; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/* A whole file mapped read only, for the caches that are used straight from disk. */
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat status;
+        if (fstat(fd, &status) == 0 && status.st_size > 0) {
+            void *mapped = mmap(nullptr, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                mapping = mapped;
+                bytes = (size_t) status.st_size;
+            }
+        }
+        ::close(fd);
+        return mapping != nullptr;
+    }
+
+    void close()
+    {
+        if (mapping)
+            munmap(mapping, bytes);
+        mapping = nullptr;
+        bytes = 0;
+    }
+
+    const unsigned char *data() const
+    {
+        return (const unsigned char *) mapping;
+    }
+
+    size_t size() const
+    {
+        return bytes;
+    }
+
+    // hashes a file's contents into hash, false if it can't be read
+    static bool hash(const std::string &path, uint64_t &hash)
+    {
+        MappedFile file;
+        if (!file.open(path))
+            return false;
+        hash = fnv1a(file.data(), file.size(), hash);
+        return true;
+    }
+
+    // writes through a temporary file and renames it, so nobody ever maps half of one
+    static bool write(const std::string &path, const void *data, size_t bytes)
+    {
+        std::string temporary = path + ".tmp";
+        FILE *file = std::fopen(temporary.c_str(), "wb");
+        if (!file)
+            return false;
+        bool ok = std::fwrite(data, 1, bytes, file) == bytes;
+        ok = std::fclose(file) == 0 && ok;
+        if (ok)
+            ok = std::rename(temporary.c_str(), path.c_str()) == 0;
+        if (!ok)
+            std::remove(temporary.c_str());
+        return ok;
+    }
+
+private:
+    void *mapping = nullptr;
+    size_t bytes = 0;
+};
+
+#endif //PROJECT_BASE_MAPPEDFILE_H
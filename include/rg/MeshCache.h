@@ -0,0 +1,304 @@
+#ifndef PROJECT_BASE_MESHCACHE_H
+#define PROJECT_BASE_MESHCACHE_H
+
+#include <rg/Bounds.h>
+#include <rg/MappedFile.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Binary form of an imported model, written next to the source the first time it is imported.
+ * One file holds every submesh's final vertices and indices back to back, a range table saying which part
+ * belongs to which submesh, and the material texture references as type and path strings. Sections are
+ * 16 byte aligned, so the file is mapped as it is and the vertex and index ranges go to glBufferData
+ * without a copy. Indices are 16 bit for submeshes with few enough vertices and 32 bit otherwise, each
+ * submesh's range starting 4 byte aligned. A submesh's range holds all its detail levels, full detail
+ * first, and a level table gives each level's part of it and its error. The header records the format
+ * version, the source's content hash, the import flags and the vertex format and stride the vertices are
+ * packed in; a file that disagrees with any of them is stale and open() refuses it. The hash covers the
+ * model file itself, not the material library it names. */
+class MeshCache {
+public:
+    static const uint32_t MAGIC = 0x4843534d; // "MSCH"
+    static const uint32_t VERSION = 4;
+
+    struct Submesh {
+        uint32_t firstVertex, vertexCount;
+        uint32_t indexOffset, indexBytes, indexSize; // offset in bytes, size 2 or 4
+        uint32_t firstLod, lodCount;
+        uint32_t firstTexture, textureCount;
+        Aabb bounds;
+        BoundingSphere sphere;
+    };
+
+    // a detail level, indexOffset in bytes from the start of its submesh's indices
+    struct Lod {
+        uint32_t indexOffset, indexCount;
+        float error;
+    };
+
+    MeshCache() = default;
+
+    ~MeshCache()
+    {
+        unmap();
+    }
+
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+
+    static std::string pathFor(const std::string &source)
+    {
+        return source + ".meshcache";
+    }
+
+    // FNV-1a over the file's bytes, false if it can't be read
+    static bool hashFile(const std::string &path, uint64_t &hash)
+    {
+        hash = FNV_OFFSET;
+        return MappedFile::hash(path, hash);
+    }
+
+    // maps the cache file if it is current for this source hash, import flags and vertex format
+    bool open(const std::string &path, uint64_t sourceHash, uint32_t importFlags, uint32_t vertexFormat, uint32_t vertexStride)
+    {
+        unmap();
+        if (!file.open(path) || file.size() < sizeof(Header))
+            return false;
+        base = file.data();
+        if (!valid(file.size(), sourceHash, importFlags, vertexFormat, vertexStride)) {
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    // building a cache after an import: add every submesh, then finish() lays the file out in memory.
+    // indices holds every level, at the offsets in lods
+    void add(const void *vertices, uint32_t vertexCount, const void *indices, const std::vector<Lod> &lods, uint32_t indexSize,
+             const std::vector<std::string> &textureTypes, const std::vector<std::string> &texturePaths,
+             const Aabb &bounds, const BoundingSphere &sphere, uint32_t vertexStride)
+    {
+        Submesh submesh;
+        submesh.firstVertex = (uint32_t) (building.vertices.size() / vertexStride);
+        submesh.vertexCount = vertexCount;
+        building.indices.resize((building.indices.size() + 3) & ~(size_t) 3, 0);
+        submesh.indexOffset = (uint32_t) building.indices.size();
+        submesh.indexBytes = 0;
+        for (const Lod &lod : lods)
+            submesh.indexBytes = std::max(submesh.indexBytes, lod.indexOffset + lod.indexCount * indexSize);
+        submesh.indexSize = indexSize;
+        submesh.firstLod = (uint32_t) building.lods.size();
+        submesh.lodCount = (uint32_t) lods.size();
+        submesh.firstTexture = (uint32_t) (building.textures.size() / 2);
+        submesh.textureCount = (uint32_t) textureTypes.size();
+        submesh.bounds = bounds;
+        submesh.sphere = sphere;
+        building.submeshes.push_back(submesh);
+        const unsigned char *bytes = (const unsigned char *) vertices;
+        building.vertices.insert(building.vertices.end(), bytes, bytes + (size_t) vertexCount * vertexStride);
+        const unsigned char *indexBytes = (const unsigned char *) indices;
+        building.indices.insert(building.indices.end(), indexBytes, indexBytes + submesh.indexBytes);
+        building.lods.insert(building.lods.end(), lods.begin(), lods.end());
+        for (size_t i = 0; i < textureTypes.size(); ++i) {
+            building.textures.push_back(addString(textureTypes[i]));
+            building.textures.push_back(addString(texturePaths[i]));
+        }
+    }
+
+    void finish(uint64_t sourceHash, uint32_t importFlags, uint32_t vertexFormat, uint32_t vertexStride)
+    {
+        unmap();
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.sourceHash = sourceHash;
+        header.importFlags = importFlags;
+        header.vertexFormat = vertexFormat;
+        header.vertexStride = vertexStride;
+        header.submeshCount = (uint32_t) building.submeshes.size();
+        header.vertexCount = (uint32_t) (building.vertices.size() / vertexStride);
+        header.indexBytes = (uint32_t) building.indices.size();
+        header.lodCount = (uint32_t) building.lods.size();
+        header.textureCount = (uint32_t) (building.textures.size() / 2);
+        header.stringBytes = (uint32_t) building.strings.size();
+        uint64_t offset = align(sizeof(Header));
+        header.submeshOffset = offset;
+        offset = align(offset + building.submeshes.size() * sizeof(Submesh));
+        header.vertexOffset = offset;
+        offset = align(offset + building.vertices.size());
+        header.indexOffset = offset;
+        offset = align(offset + building.indices.size());
+        header.lodOffset = offset;
+        offset = align(offset + building.lods.size() * sizeof(Lod));
+        header.textureOffset = offset;
+        offset = align(offset + building.textures.size() * sizeof(uint32_t));
+        header.stringOffset = offset;
+        header.fileSize = offset + building.strings.size();
+
+        owned.assign((size_t) header.fileSize, 0);
+        std::memcpy(&owned[0], &header, sizeof(header));
+        copy(header.submeshOffset, building.submeshes.data(), building.submeshes.size() * sizeof(Submesh));
+        copy(header.vertexOffset, building.vertices.data(), building.vertices.size());
+        copy(header.indexOffset, building.indices.data(), building.indices.size());
+        copy(header.lodOffset, building.lods.data(), building.lods.size() * sizeof(Lod));
+        copy(header.textureOffset, building.textures.data(), building.textures.size() * sizeof(uint32_t));
+        copy(header.stringOffset, building.strings.data(), building.strings.size());
+        building = Building();
+        base = owned.data();
+    }
+
+    // writes a finished cache
+    bool write(const std::string &path) const
+    {
+        return !owned.empty() && MappedFile::write(path, owned.data(), owned.size());
+    }
+
+    unsigned submeshCount() const
+    {
+        return base ? header().submeshCount : 0;
+    }
+
+    const Submesh &submesh(unsigned i) const
+    {
+        return ((const Submesh *) (base + header().submeshOffset))[i];
+    }
+
+    const void *vertices(unsigned i) const
+    {
+        return base + header().vertexOffset + (size_t) submesh(i).firstVertex * header().vertexStride;
+    }
+
+    // every level of submesh i, submesh(i).indexSize bytes each
+    const void *indices(unsigned i) const
+    {
+        return base + header().indexOffset + submesh(i).indexOffset;
+    }
+
+    // level 0 is full detail
+    const Lod &lod(unsigned i, unsigned level) const
+    {
+        return ((const Lod *) (base + header().lodOffset))[submesh(i).firstLod + level];
+    }
+
+    // texture i of the whole cache, a submesh's are firstTexture up to firstTexture + textureCount
+    const char *textureType(unsigned i) const
+    {
+        return text(textureTable()[2 * i]);
+    }
+
+    const char *texturePath(unsigned i) const
+    {
+        return text(textureTable()[2 * i + 1]);
+    }
+
+private:
+    struct Header {
+        uint32_t magic, version;
+        uint64_t sourceHash;
+        uint32_t importFlags, vertexFormat, vertexStride;
+        uint32_t submeshCount, vertexCount, indexBytes, lodCount, textureCount, stringBytes;
+        uint64_t submeshOffset, vertexOffset, indexOffset, lodOffset, textureOffset, stringOffset, fileSize;
+    };
+
+    // submeshes added so far, textures as pairs of string table offsets
+    struct Building {
+        std::vector<Submesh> submeshes;
+        std::vector<unsigned char> vertices;
+        std::vector<unsigned char> indices;
+        std::vector<Lod> lods;
+        std::vector<uint32_t> textures;
+        std::vector<char> strings;
+    };
+
+    Building building;
+    std::vector<unsigned char> owned;
+    MappedFile file;
+    const unsigned char *base = nullptr;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~(uint64_t) 15;
+    }
+
+    const Header &header() const
+    {
+        return *(const Header *) base;
+    }
+
+    const uint32_t *textureTable() const
+    {
+        return (const uint32_t *) (base + header().textureOffset);
+    }
+
+    const char *text(uint32_t offset) const
+    {
+        return (const char *) base + header().stringOffset + offset;
+    }
+
+    uint32_t addString(const std::string &text)
+    {
+        uint32_t offset = (uint32_t) building.strings.size();
+        building.strings.insert(building.strings.end(), text.begin(), text.end());
+        building.strings.push_back('\0');
+        return offset;
+    }
+
+    void copy(uint64_t offset, const void *data, size_t bytes)
+    {
+        if (bytes)
+            std::memcpy(&owned[(size_t) offset], data, bytes);
+    }
+
+    // the header matches and every section lies inside the file
+    bool valid(size_t size, uint64_t sourceHash, uint32_t importFlags, uint32_t vertexFormat, uint32_t vertexStride) const
+    {
+        const Header &h = header();
+        if (h.magic != MAGIC || h.version != VERSION || h.sourceHash != sourceHash
+            || h.importFlags != importFlags || h.vertexFormat != vertexFormat || h.vertexStride != vertexStride
+            || h.fileSize != size)
+            return false;
+        uint64_t ends[] = {
+                h.submeshOffset + (uint64_t) h.submeshCount * sizeof(Submesh),
+                h.vertexOffset + (uint64_t) h.vertexCount * h.vertexStride,
+                h.indexOffset + h.indexBytes,
+                h.lodOffset + (uint64_t) h.lodCount * sizeof(Lod),
+                h.textureOffset + (uint64_t) h.textureCount * 2 * sizeof(uint32_t),
+                h.stringOffset + h.stringBytes
+        };
+        for (uint64_t end : ends)
+            if (end > size)
+                return false;
+        for (unsigned i = 0; i < h.submeshCount; ++i) {
+            const Submesh &s = submesh(i);
+            if ((uint64_t) s.firstVertex + s.vertexCount > h.vertexCount
+                || (s.indexSize != 2 && s.indexSize != 4) || s.indexOffset % 4 != 0
+                || (uint64_t) s.indexOffset + s.indexBytes > h.indexBytes
+                || s.lodCount == 0 || (uint64_t) s.firstLod + s.lodCount > h.lodCount
+                || (uint64_t) s.firstTexture + s.textureCount > h.textureCount)
+                return false;
+            for (unsigned level = 0; level < s.lodCount; ++level) {
+                const Lod &l = lod(i, level);
+                if (l.indexOffset % s.indexSize != 0 || (uint64_t) l.indexOffset + (uint64_t) l.indexCount * s.indexSize > s.indexBytes)
+                    return false;
+            }
+        }
+        for (unsigned i = 0; i < 2 * h.textureCount; ++i)
+            if (textureTable()[i] >= h.stringBytes)
+                return false;
+        return h.stringBytes == 0 || base[h.stringOffset + h.stringBytes - 1] == '\0';
+    }
+
+    void unmap()
+    {
+        file.close();
+        owned.clear();
+        base = nullptr;
+    }
+};
+
+#endif //PROJECT_BASE_MESHCACHE_H
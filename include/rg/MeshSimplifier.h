@@ -0,0 +1,299 @@
+#ifndef PROJECT_BASE_MESHSIMPLIFIER_H
+#define PROJECT_BASE_MESHSIMPLIFIER_H
+
+#include <rg/MeshOptimizer.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+/* Levels of detail by quadric error metric edge collapse (Garland and Heckbert 1997). A vertex collapses
+ * onto one of its neighbours, so every level indexes the original vertex buffer and keeps the original
+ * normals and UVs on what is left. Vertices on a seam, where several vertices share one position with
+ * different normals or UVs, and on open borders never move, which keeps the seams closed and the texture
+ * unwrapped the way it was. Collapses that would fold a triangle over or make the surface non-manifold are
+ * skipped. Each level starts from the one before, its error, in object space units, is the one before's
+ * plus the root of the largest mean squared distance to the planes around a collapsed vertex. */
+class MeshSimplifier {
+public:
+    struct Lod {
+        std::vector<uint32_t> indices;
+        float error = 0.0f;
+    };
+
+    // levels after the full one, each with about ratio of the triangles before it, until a level has fewer
+    // than minTriangles or hardly simplifies any more. Every level's triangles are ordered for the vertex cache
+    static std::vector<Lod> buildChain(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices,
+                                       unsigned maxLevels = 4, float ratio = 0.5f, unsigned minTriangles = 64)
+    {
+        std::vector<Lod> chain;
+        std::vector<char> locked = lockedVertices(positions, indices);
+        std::vector<uint32_t> current = indices;
+        float error = 0.0f;
+        while (chain.size() < maxLevels) {
+            unsigned triangles = (unsigned) (current.size() / 3);
+            unsigned target = (unsigned) (triangles * ratio);
+            if (target < minTriangles)
+                break;
+            Lod lod;
+            lod.indices = current;
+            error += simplify(positions, locked, lod.indices, target);
+            // a level that barely got smaller isn't worth its memory, and the ones after it won't do better
+            if (lod.indices.size() / 3 > triangles * 0.9f)
+                break;
+            lod.error = error;
+            current = lod.indices;
+            std::vector<unsigned> clusters;
+            MeshOptimizer::optimizeCache(lod.indices, (unsigned) positions.size(), clusters);
+            chain.push_back(std::move(lod));
+        }
+        return chain;
+    }
+
+    // vertices that share their position with another vertex or lie on an open border
+    static std::vector<char> lockedVertices(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices)
+    {
+        std::vector<char> locked(positions.size(), 0);
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+        std::vector<uint32_t> group(positions.size());
+        for (uint32_t v = 0; v < positions.size(); ++v) {
+            std::vector<uint32_t> &bucket = buckets[fnv1a(&positions[v], sizeof(glm::vec3))];
+            group[v] = v;
+            for (uint32_t other : bucket) {
+                if (positions[other] == positions[v]) {
+                    group[v] = group[other];
+                    locked[v] = locked[other] = 1;
+                }
+            }
+            bucket.push_back(v);
+        }
+        // an edge between positions used by only one triangle is on a border
+        std::unordered_map<uint64_t, unsigned> edges;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            for (int c = 0; c < 3; ++c)
+                ++edges[edgeKey(group[indices[t + c]], group[indices[t + (c + 1) % 3]])];
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            for (int c = 0; c < 3; ++c) {
+                uint32_t a = indices[t + c], b = indices[t + (c + 1) % 3];
+                if (edges[edgeKey(group[a], group[b])] == 1)
+                    locked[a] = locked[b] = 1;
+            }
+        }
+        // the whole group, so every vertex at a locked position stays
+        for (uint32_t v = 0; v < positions.size(); ++v)
+            if (locked[v])
+                locked[group[v]] = 1;
+        for (uint32_t v = 0; v < positions.size(); ++v)
+            locked[v] = locked[group[v]];
+        return locked;
+    }
+
+    // collapses edges, cheapest first, until indices has at most targetTriangles or nothing can go;
+    // returns the error of the worst collapse
+    static float simplify(const std::vector<glm::vec3> &positions, const std::vector<char> &locked,
+                          std::vector<uint32_t> &indices, unsigned targetTriangles)
+    {
+        std::vector<Quadric> quadrics(positions.size());
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            Quadric q = Quadric::plane(positions[indices[t]], positions[indices[t + 1]], positions[indices[t + 2]]);
+            for (int c = 0; c < 3; ++c)
+                quadrics[indices[t + c]].add(q);
+        }
+
+        float worst = 0.0f;
+        std::vector<uint32_t> remap(positions.size());
+        std::vector<char> touched(positions.size());
+        std::vector<unsigned> first, adjacency, neighbours;
+        std::vector<Collapse> collapses;
+        while (indices.size() / 3 > targetTriangles) {
+            unsigned triangles = (unsigned) (indices.size() / 3);
+            buildAdjacency(indices, (unsigned) positions.size(), first, adjacency);
+            collapses.clear();
+            for (size_t i = 0; i < indices.size(); ++i) {
+                uint32_t from = indices[i], to = indices[i - i % 3 + (i + 1) % 3];
+                if (!locked[from])
+                    collapses.push_back({from, to, cost(quadrics[from], quadrics[to], positions[to])});
+            }
+            std::sort(collapses.begin(), collapses.end(),
+                      [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+            for (uint32_t v = 0; v < remap.size(); ++v)
+                remap[v] = v;
+            std::fill(touched.begin(), touched.end(), 0);
+            int remaining = (int) (triangles - targetTriangles);
+            bool collapsed = false;
+            for (const Collapse &c : collapses) {
+                if (remaining <= 0)
+                    break;
+                if (touched[c.from] || touched[c.to])
+                    continue;
+                int removed = 0;
+                if (!allowed(positions, indices, first, adjacency, c.from, c.to, removed, neighbours))
+                    continue;
+                // the collapse changes every triangle around from, so their vertices wait for the next pass
+                for (unsigned a = first[c.from]; a < first[c.from + 1]; ++a)
+                    for (int k = 0; k < 3; ++k)
+                        touched[indices[3 * adjacency[a] + k]] = 1;
+                remap[c.from] = c.to;
+                quadrics[c.to].add(quadrics[c.from]);
+                worst = std::max(worst, c.cost);
+                remaining -= removed;
+                collapsed = true;
+            }
+            if (!collapsed)
+                break;
+
+            size_t kept = 0;
+            for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+                uint32_t a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+                if (a == b || b == c || c == a)
+                    continue;
+                indices[kept++] = a;
+                indices[kept++] = b;
+                indices[kept++] = c;
+            }
+            indices.resize(kept);
+        }
+        return std::sqrt(worst);
+    }
+
+private:
+    // symmetric 4x4 of plane equations, with the area the planes were weighted by
+    struct Quadric {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0, weight = 0;
+
+        static Quadric plane(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+        {
+            Quadric q;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(n);
+            if (length == 0.0f)
+                return q;
+            double area = 0.5 * length;
+            n /= length;
+            double d = -glm::dot(n, p0);
+            q.a2 = area * n.x * n.x;
+            q.ab = area * n.x * n.y;
+            q.ac = area * n.x * n.z;
+            q.ad = area * n.x * d;
+            q.b2 = area * n.y * n.y;
+            q.bc = area * n.y * n.z;
+            q.bd = area * n.y * d;
+            q.c2 = area * n.z * n.z;
+            q.cd = area * n.z * d;
+            q.d2 = area * d * d;
+            q.weight = area;
+            return q;
+        }
+
+        void add(const Quadric &q)
+        {
+            a2 += q.a2;
+            ab += q.ab;
+            ac += q.ac;
+            ad += q.ad;
+            b2 += q.b2;
+            bc += q.bc;
+            bd += q.bd;
+            c2 += q.c2;
+            cd += q.cd;
+            d2 += q.d2;
+            weight += q.weight;
+        }
+
+        double evaluate(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x + b2 * y * y + 2 * bc * y * z
+                   + 2 * bd * y + c2 * z * z + 2 * cd * z + d2;
+        }
+    };
+
+    struct Collapse {
+        uint32_t from, to;
+        float cost;
+    };
+
+    // mean squared distance of to from the planes around both ends
+    static float cost(const Quadric &from, const Quadric &to, const glm::vec3 &position)
+    {
+        Quadric q = from;
+        q.add(to);
+        return q.weight > 0 ? (float) std::max(0.0, q.evaluate(position) / q.weight) : 0.0f;
+    }
+
+    static uint64_t edgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? (uint64_t) a << 32 | b : (uint64_t) b << 32 | a;
+    }
+
+    // vertex -> triangles as offsets into one array
+    static void buildAdjacency(const std::vector<uint32_t> &indices, unsigned vertexCount, std::vector<unsigned> &first,
+                               std::vector<unsigned> &adjacency)
+    {
+        first.assign(vertexCount + 1, 0);
+        for (uint32_t index : indices)
+            ++first[index + 1];
+        for (unsigned v = 0; v < vertexCount; ++v)
+            first[v + 1] += first[v];
+        adjacency.resize(indices.size());
+        std::vector<unsigned> fill(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = (unsigned) (i / 3);
+    }
+
+    // whether from can go to to without folding a triangle over, or a link condition violation turning the
+    // surface non-manifold; removed gets the triangles it takes away
+    static bool allowed(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices,
+                        const std::vector<unsigned> &first, const std::vector<unsigned> &adjacency, uint32_t from,
+                        uint32_t to, int &removed, std::vector<unsigned> &neighbours)
+    {
+        removed = 0;
+        neighbours.clear();
+        for (unsigned a = first[from]; a < first[from + 1]; ++a) {
+            const uint32_t *triangle = &indices[3 * adjacency[a]];
+            bool shared = triangle[0] == to || triangle[1] == to || triangle[2] == to;
+            for (int k = 0; k < 3; ++k)
+                if (triangle[k] != from && triangle[k] != to)
+                    neighbours.push_back(triangle[k]);
+            if (shared) {
+                ++removed;
+                continue;
+            }
+            glm::vec3 corners[3], moved[3];
+            for (int k = 0; k < 3; ++k) {
+                corners[k] = positions[triangle[k]];
+                moved[k] = triangle[k] == from ? positions[to] : corners[k];
+            }
+            glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            // more than about 75 degrees of turn is a fold, or close enough to one
+            if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after))
+                return false;
+        }
+        if (removed == 0)
+            return false;
+        // the vertices both ends share must be just the ones across the collapsed edge
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        int common = 0;
+        for (unsigned a = first[to]; a < first[to + 1]; ++a) {
+            const uint32_t *triangle = &indices[3 * adjacency[a]];
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = triangle[k];
+                if (v != from && v != to && std::binary_search(neighbours.begin(), neighbours.end(), v)) {
+                    ++common;
+                    neighbours.erase(std::lower_bound(neighbours.begin(), neighbours.end(), v));
+                }
+            }
+        }
+        return common == removed;
+    }
+};
+
+#endif //PROJECT_BASE_MESHSIMPLIFIER_H
@@ -0,0 +1,499 @@
+#ifndef PROJECT_BASE_NBODY_H
+#define PROJECT_BASE_NBODY_H
+
+#include <glm/glm.hpp>
+
+#include <rg/JobSystem.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* Gravitational n-body simulation, Barnes-Hut accelerated and integrated with kick-drift-kick leapfrog
+ * at a fixed time step, which keeps orbits from drifting in energy the way explicit Euler does.
+ * Every step sorts the bodies along a Morton curve and builds an octree over the sorted order: cells are
+ * contiguous ranges of the sorted bodies, so leaves sum their bodies straight out of packed arrays. The
+ * top two levels are built on the calling thread and the subtrees below them, the forces and the
+ * integration are spread over the job system. Forces use a cell's mass and center of mass once the cell
+ * looks smaller than theta from every body of a small group of neighbours, which walk the tree once
+ * between them. */
+class NBody {
+public:
+    float gravity = 1.0f;
+    float theta = 0.7f;
+    // keeps close encounters from blowing up, in world units
+    float softening = 0.05f;
+    float timeStep = 1.0f / 60.0f;
+
+    explicit NBody(JobSystem &jobSystem) : jobs(jobSystem)
+    {
+    }
+
+    unsigned add(const glm::vec3 &position, const glm::vec3 &velocity, float mass)
+    {
+        px.push_back(position.x);
+        py.push_back(position.y);
+        pz.push_back(position.z);
+        vx.push_back(velocity.x);
+        vy.push_back(velocity.y);
+        vz.push_back(velocity.z);
+        ax.push_back(0.0f);
+        ay.push_back(0.0f);
+        az.push_back(0.0f);
+        masses.push_back(mass);
+        accelerationsValid = false;
+        return size() - 1;
+    }
+
+    void clear()
+    {
+        std::vector<float> *arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &masses };
+        for (std::vector<float> *array : arrays)
+            array->clear();
+        accelerationsValid = false;
+        accumulator = 0.0f;
+    }
+
+    // runs as many fixed steps as fit into seconds, at most maxSteps, and returns how many ran
+    unsigned advance(float seconds, unsigned maxSteps)
+    {
+        accumulator += seconds;
+        unsigned steps = 0;
+        while (accumulator >= timeStep && steps < maxSteps) {
+            step();
+            accumulator -= timeStep;
+            ++steps;
+        }
+        // falling behind: drop the backlog instead of spiralling
+        if (steps == maxSteps && accumulator > timeStep)
+            accumulator = 0.0f;
+        return steps;
+    }
+
+    void step()
+    {
+        unsigned n = size();
+        if (n == 0)
+            return;
+        if (!accelerationsValid)
+            computeAccelerations();
+        float dt = timeStep, half = 0.5f * timeStep;
+        jobs.parallelFor(n, 4096, [&](unsigned begin, unsigned end) {
+            for (unsigned i = begin; i < end; ++i) {
+                vx[i] += ax[i] * half;
+                vy[i] += ay[i] * half;
+                vz[i] += az[i] * half;
+                px[i] += vx[i] * dt;
+                py[i] += vy[i] * dt;
+                pz[i] += vz[i] * dt;
+            }
+        });
+        computeAccelerations();
+        jobs.parallelFor(n, 4096, [&](unsigned begin, unsigned end) {
+            for (unsigned i = begin; i < end; ++i) {
+                vx[i] += ax[i] * half;
+                vy[i] += ay[i] * half;
+                vz[i] += az[i] * half;
+            }
+        });
+    }
+
+    glm::vec3 position(unsigned body) const
+    {
+        return glm::vec3(px[body], py[body], pz[body]);
+    }
+
+    glm::vec3 velocity(unsigned body) const
+    {
+        return glm::vec3(vx[body], vy[body], vz[body]);
+    }
+
+    unsigned size() const
+    {
+        return (unsigned) masses.size();
+    }
+
+    unsigned nodeCount() const
+    {
+        return (unsigned) nodes.size();
+    }
+
+    const float *positionsX() const
+    {
+        return px.data();
+    }
+
+    const float *positionsY() const
+    {
+        return py.data();
+    }
+
+    const float *positionsZ() const
+    {
+        return pz.data();
+    }
+
+private:
+    static const unsigned LEAF_SIZE = 8;
+    static const unsigned MAX_LEVEL = 10;
+    // subtrees below this level are built in parallel
+    static const unsigned SPLIT_LEVEL = 2;
+    // bodies that walk the tree together
+    static const unsigned GROUP_SIZE = 32;
+    // bodies per job in the Morton sort's passes
+    static const unsigned SORT_CHUNK = 16384;
+
+    /* A cell: the sorted bodies [first, first + count) with their mass and center of mass.
+     * Inner cells have childCount consecutive children from firstChild, leaves have firstChild -1. */
+    struct Node {
+        float x, y, z, mass;
+        float size;
+        int firstChild;
+        unsigned childCount;
+        unsigned first, count;
+    };
+
+    struct Subtree {
+        unsigned slot;
+        unsigned first, last;
+        std::vector<Node> nodes;
+    };
+
+    JobSystem &jobs;
+    std::vector<float> px, py, pz, vx, vy, vz, ax, ay, az, masses;
+    bool accelerationsValid = false;
+    float accumulator = 0.0f;
+
+    // bodies in Morton order
+    std::vector<uint32_t> keys, order, scratchKeys, scratchOrder;
+    // 1024 digit counts, then starts, per sort chunk
+    std::vector<unsigned> digitOffsets;
+    std::vector<float> sx, sy, sz, sm, sax, say, saz;
+    std::vector<Node> nodes;
+    std::vector<unsigned> topNodes;
+    std::vector<Subtree> subtrees;
+    std::vector<unsigned> groups;
+    float rootSize = 1.0f;
+
+    // spreads the low 10 bits of v out to every third bit
+    static uint32_t spread(uint32_t v)
+    {
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    void sortBodies()
+    {
+        unsigned n = size();
+        glm::vec3 lo(px[0], py[0], pz[0]), hi = lo;
+        for (unsigned i = 1; i < n; ++i) {
+            lo = glm::min(lo, glm::vec3(px[i], py[i], pz[i]));
+            hi = glm::max(hi, glm::vec3(px[i], py[i], pz[i]));
+        }
+        glm::vec3 extent = hi - lo;
+        rootSize = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f)) * 1.0001f;
+        float cells = (float) (1u << MAX_LEVEL) / rootSize;
+
+        keys.resize(n);
+        order.resize(n);
+        jobs.parallelFor(n, 8192, [&](unsigned begin, unsigned end) {
+            for (unsigned i = begin; i < end; ++i) {
+                uint32_t cx = std::min((uint32_t) ((px[i] - lo.x) * cells), (1u << MAX_LEVEL) - 1);
+                uint32_t cy = std::min((uint32_t) ((py[i] - lo.y) * cells), (1u << MAX_LEVEL) - 1);
+                uint32_t cz = std::min((uint32_t) ((pz[i] - lo.z) * cells), (1u << MAX_LEVEL) - 1);
+                keys[i] = spread(cx) << 2 | spread(cy) << 1 | spread(cz);
+                order[i] = i;
+            }
+        });
+
+        /* three 10 bit radix passes over the 30 bit keys. Each pass counts digits per chunk of bodies in
+         * parallel, turns the counts into a start per digit and chunk, then scatters the chunks in parallel;
+         * chunks write in their order within a digit, so the sort stays stable */
+        scratchKeys.resize(n);
+        scratchOrder.resize(n);
+        unsigned chunks = (n + SORT_CHUNK - 1) / SORT_CHUNK;
+        digitOffsets.resize((size_t) chunks * 1024);
+        for (unsigned shift = 0; shift < 30; shift += 10) {
+            jobs.parallelFor(chunks, 1, [&](unsigned begin, unsigned end) {
+                for (unsigned chunk = begin; chunk < end; ++chunk) {
+                    unsigned *counts = &digitOffsets[(size_t) chunk * 1024];
+                    std::fill(counts, counts + 1024, 0u);
+                    for (unsigned i = chunk * SORT_CHUNK; i < std::min(n, (chunk + 1) * SORT_CHUNK); ++i)
+                        ++counts[keys[i] >> shift & 1023];
+                }
+            });
+            unsigned sum = 0;
+            for (unsigned digit = 0; digit < 1024; ++digit)
+                for (unsigned chunk = 0; chunk < chunks; ++chunk) {
+                    unsigned &offset = digitOffsets[(size_t) chunk * 1024 + digit];
+                    unsigned count = offset;
+                    offset = sum;
+                    sum += count;
+                }
+            jobs.parallelFor(chunks, 1, [&](unsigned begin, unsigned end) {
+                for (unsigned chunk = begin; chunk < end; ++chunk) {
+                    unsigned *offsets = &digitOffsets[(size_t) chunk * 1024];
+                    for (unsigned i = chunk * SORT_CHUNK; i < std::min(n, (chunk + 1) * SORT_CHUNK); ++i) {
+                        unsigned target = offsets[keys[i] >> shift & 1023]++;
+                        scratchKeys[target] = keys[i];
+                        scratchOrder[target] = order[i];
+                    }
+                }
+            });
+            keys.swap(scratchKeys);
+            order.swap(scratchOrder);
+        }
+
+        sx.resize(n);
+        sy.resize(n);
+        sz.resize(n);
+        sm.resize(n);
+        jobs.parallelFor(n, 8192, [&](unsigned begin, unsigned end) {
+            for (unsigned i = begin; i < end; ++i) {
+                unsigned body = order[i];
+                sx[i] = px[body];
+                sy[i] = py[body];
+                sz[i] = pz[body];
+                sm[i] = masses[body];
+            }
+        });
+    }
+
+    void summarizeLeaf(Node &node) const
+    {
+        float mass = 0.0f, x = 0.0f, y = 0.0f, z = 0.0f;
+        for (unsigned i = node.first; i < node.first + node.count; ++i) {
+            mass += sm[i];
+            x += sx[i] * sm[i];
+            y += sy[i] * sm[i];
+            z += sz[i] * sm[i];
+        }
+        float inverse = mass > 0.0f ? 1.0f / mass : 0.0f;
+        node.x = x * inverse;
+        node.y = y * inverse;
+        node.z = z * inverse;
+        node.mass = mass;
+    }
+
+    static void summarizeInner(std::vector<Node> &tree, unsigned index)
+    {
+        Node &node = tree[index];
+        float mass = 0.0f, x = 0.0f, y = 0.0f, z = 0.0f;
+        for (unsigned c = 0; c < node.childCount; ++c) {
+            const Node &child = tree[node.firstChild + c];
+            mass += child.mass;
+            x += child.x * child.mass;
+            y += child.y * child.mass;
+            z += child.z * child.mass;
+        }
+        float inverse = mass > 0.0f ? 1.0f / mass : 0.0f;
+        node.x = x * inverse;
+        node.y = y * inverse;
+        node.z = z * inverse;
+        node.mass = mass;
+    }
+
+    // the key ranges of the up to eight children of a cell at level, returns how many are not empty
+    unsigned splitCell(unsigned first, unsigned last, unsigned level, unsigned *childFirst, unsigned *childLast) const
+    {
+        unsigned shift = 3 * (MAX_LEVEL - level - 1);
+        unsigned used = 0, begin = first;
+        for (unsigned octant = 0; octant < 8 && begin < last; ++octant) {
+            unsigned end = (unsigned) (std::partition_point(keys.begin() + begin, keys.begin() + last,
+                                                            [&](uint32_t key) { return (key >> shift & 7) <= octant; })
+                                       - keys.begin());
+            if (end > begin) {
+                childFirst[used] = begin;
+                childLast[used++] = end;
+            }
+            begin = end;
+        }
+        return used;
+    }
+
+    void initNode(Node &node, unsigned first, unsigned last, unsigned level) const
+    {
+        node.first = first;
+        node.count = last - first;
+        node.size = rootSize / (float) (1u << level);
+        node.firstChild = -1;
+        node.childCount = 0;
+    }
+
+    // fills tree[slot] with the cell of sorted bodies [first, last) and builds everything below it
+    void buildNode(std::vector<Node> &tree, unsigned slot, unsigned first, unsigned last, unsigned level) const
+    {
+        initNode(tree[slot], first, last, level);
+        if (last - first <= LEAF_SIZE || level == MAX_LEVEL) {
+            summarizeLeaf(tree[slot]);
+            return;
+        }
+        unsigned childFirst[8], childLast[8];
+        unsigned used = splitCell(first, last, level, childFirst, childLast);
+        unsigned firstChild = (unsigned) tree.size();
+        tree.resize(tree.size() + used);
+        tree[slot].firstChild = (int) firstChild;
+        tree[slot].childCount = used;
+        for (unsigned c = 0; c < used; ++c)
+            buildNode(tree, firstChild + c, childFirst[c], childLast[c], level + 1);
+        summarizeInner(tree, slot);
+    }
+
+    // the levels above SPLIT_LEVEL, deeper cells become subtrees to build in parallel
+    void buildTop(unsigned slot, unsigned first, unsigned last, unsigned level)
+    {
+        initNode(nodes[slot], first, last, level);
+        if (last - first <= LEAF_SIZE || level == MAX_LEVEL) {
+            summarizeLeaf(nodes[slot]);
+            return;
+        }
+        if (level == SPLIT_LEVEL) {
+            Subtree subtree;
+            subtree.slot = slot;
+            subtree.first = first;
+            subtree.last = last;
+            subtrees.push_back(std::move(subtree));
+            return;
+        }
+        topNodes.push_back(slot);
+        unsigned childFirst[8], childLast[8];
+        unsigned used = splitCell(first, last, level, childFirst, childLast);
+        unsigned firstChild = (unsigned) nodes.size();
+        nodes.resize(nodes.size() + used);
+        nodes[slot].firstChild = (int) firstChild;
+        nodes[slot].childCount = used;
+        for (unsigned c = 0; c < used; ++c)
+            buildTop(firstChild + c, childFirst[c], childLast[c], level + 1);
+    }
+
+    void buildTree()
+    {
+        nodes.assign(1, Node());
+        topNodes.clear();
+        subtrees.clear();
+        buildTop(0, 0, size(), 0);
+
+        jobs.parallelFor((unsigned) subtrees.size(), 1, [&](unsigned begin, unsigned end) {
+            for (unsigned s = begin; s < end; ++s) {
+                Subtree &subtree = subtrees[s];
+                subtree.nodes.assign(1, Node());
+                buildNode(subtree.nodes, 0, subtree.first, subtree.last, SPLIT_LEVEL);
+            }
+        });
+
+        // the subtree roots go into their slots, the rest is appended with its child links moved along
+        for (Subtree &subtree : subtrees) {
+            int offset = (int) nodes.size() - 1;
+            for (Node &node : subtree.nodes)
+                if (node.firstChild >= 0)
+                    node.firstChild += offset;
+            nodes[subtree.slot] = subtree.nodes[0];
+            nodes.insert(nodes.end(), subtree.nodes.begin() + 1, subtree.nodes.end());
+        }
+        for (auto it = topNodes.rbegin(); it != topNodes.rend(); ++it)
+            summarizeInner(nodes, *it);
+    }
+
+    // bodies of a group share one walk of the tree, cells are opened by their distance to the group's box
+    void collectGroups(unsigned index)
+    {
+        const Node &node = nodes[index];
+        if (node.count <= GROUP_SIZE || node.firstChild < 0) {
+            groups.push_back(index);
+            return;
+        }
+        for (unsigned c = 0; c < node.childCount; ++c)
+            collectGroups((unsigned) node.firstChild + c);
+    }
+
+    void computeAccelerations()
+    {
+        sortBodies();
+        buildTree();
+        groups.clear();
+        collectGroups(0);
+
+        unsigned n = size();
+        sax.resize(n);
+        say.resize(n);
+        saz.resize(n);
+        // never zero, a body's own term would be 0 * inf
+        float theta2 = theta * theta, eps2 = std::max(softening * softening, 1e-12f);
+        jobs.parallelFor((unsigned) groups.size(), 16, [&](unsigned begin, unsigned end) {
+            std::vector<unsigned> cells, ranges;
+            std::vector<unsigned> stack;
+            for (unsigned g = begin; g < end; ++g) {
+                const Node &group = nodes[groups[g]];
+                unsigned first = group.first, last = group.first + group.count;
+                glm::vec3 lo(sx[first], sy[first], sz[first]), hi = lo;
+                for (unsigned i = first + 1; i < last; ++i) {
+                    lo = glm::min(lo, glm::vec3(sx[i], sy[i], sz[i]));
+                    hi = glm::max(hi, glm::vec3(sx[i], sy[i], sz[i]));
+                }
+
+                cells.clear();
+                ranges.clear();
+                stack.assign(1, 0);
+                while (!stack.empty()) {
+                    unsigned index = stack.back();
+                    stack.pop_back();
+                    const Node &node = nodes[index];
+                    glm::vec3 com(node.x, node.y, node.z);
+                    glm::vec3 gap = glm::max(glm::max(lo - com, com - hi), glm::vec3(0.0f));
+                    float d2 = glm::dot(gap, gap);
+                    if (node.size * node.size < theta2 * d2) {
+                        cells.push_back(index);
+                    } else if (node.firstChild < 0) {
+                        ranges.push_back(node.first);
+                        ranges.push_back(node.first + node.count);
+                    } else {
+                        for (unsigned c = 0; c < node.childCount; ++c)
+                            stack.push_back((unsigned) node.firstChild + c);
+                    }
+                }
+
+                for (unsigned i = first; i < last; ++i) {
+                    float x = sx[i], y = sy[i], z = sz[i];
+                    float fx = 0.0f, fy = 0.0f, fz = 0.0f;
+                    for (unsigned cell : cells) {
+                        const Node &node = nodes[cell];
+                        float dx = node.x - x, dy = node.y - y, dz = node.z - z;
+                        float inverse = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+                        float s = node.mass * inverse * inverse * inverse;
+                        fx += dx * s;
+                        fy += dy * s;
+                        fz += dz * s;
+                    }
+                    for (unsigned r = 0; r < ranges.size(); r += 2) {
+                        // a body's own term adds nothing, its offset is zero
+                        for (unsigned j = ranges[r]; j < ranges[r + 1]; ++j) {
+                            float dx = sx[j] - x, dy = sy[j] - y, dz = sz[j] - z;
+                            float inverse = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+                            float s = sm[j] * inverse * inverse * inverse;
+                            fx += dx * s;
+                            fy += dy * s;
+                            fz += dz * s;
+                        }
+                    }
+                    sax[i] = fx * gravity;
+                    say[i] = fy * gravity;
+                    saz[i] = fz * gravity;
+                }
+            }
+        });
+        jobs.parallelFor(n, 8192, [&](unsigned begin, unsigned end) {
+            for (unsigned i = begin; i < end; ++i) {
+                ax[order[i]] = sax[i];
+                ay[order[i]] = say[i];
+                az[order[i]] = saz[i];
+            }
+        });
+        accelerationsValid = true;
+    }
+};
+
+#endif //PROJECT_BASE_NBODY_H
@@ -0,0 +1,341 @@
+#ifndef PROJECT_BASE_OFFSETALLOCATOR_H
+#define PROJECT_BASE_OFFSETALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+
+/* Hands out ranges of a buffer that lives somewhere else, a GPU buffer say, in units of whatever the
+ * caller counts in. Free ranges are kept TLSF style (Masmano et al. 2004): binned by size class, three bits
+ * of mantissa under the exponent so a bin spans an eighth of its power of two, with a bitmap over the bins
+ * so finding a big enough range is a couple of bit scans. A free range goes into the bin rounded down from
+ * its size and a request searches from the bin rounded up, so whatever comes out fits. Freeing merges a
+ * range with free neighbours right away. Allocations are handles, so defragment() can slide every live range
+ * to the front and report the moves for the caller to copy, the handles staying valid. */
+class OffsetAllocator {
+public:
+    typedef uint32_t Handle;
+    static const Handle INVALID = 0xffffffffu;
+
+    // what a defragmentation moved, from and to in units
+    struct Move {
+        uint32_t from, to, size;
+    };
+
+    explicit OffsetAllocator(uint32_t size = 0)
+    {
+        reset(size);
+    }
+
+    // everything freed, the whole size one free range
+    void reset(uint32_t size)
+    {
+        nodes.clear();
+        unusedNodes.clear();
+        for (uint32_t &head : binHeads)
+            head = INVALID;
+        for (uint8_t &bits : binBits)
+            bits = 0;
+        groupBits = 0;
+        capacity = size;
+        used = 0;
+        allocations = 0;
+        firstNode = lastNode = INVALID;
+        if (size > 0) {
+            firstNode = lastNode = newNode(0, size);
+            insertFree(firstNode);
+        }
+    }
+
+    // INVALID when no free range is big enough
+    Handle allocate(uint32_t size)
+    {
+        if (size == 0)
+            return INVALID;
+        uint32_t bin = findBin(roundUp(size));
+        if (bin == INVALID)
+            return INVALID;
+        Handle node = binHeads[bin];
+        removeFree(node);
+        Node &n = nodes[node];
+        if (n.size > size) {
+            // the rest goes back as a free range right after it
+            Handle rest = newNode(n.offset + size, nodes[node].size - size);
+            Node &allocated = nodes[node];
+            allocated.size = size;
+            nodes[rest].prev = node;
+            nodes[rest].next = allocated.next;
+            if (allocated.next != INVALID)
+                nodes[allocated.next].prev = rest;
+            else
+                lastNode = rest;
+            allocated.next = rest;
+            insertFree(rest);
+        }
+        nodes[node].used = true;
+        used += nodes[node].size;
+        ++allocations;
+        return node;
+    }
+
+    void free(Handle handle)
+    {
+        if (handle == INVALID || handle >= nodes.size() || !nodes[handle].used)
+            return;
+        Node &n = nodes[handle];
+        n.used = false;
+        used -= n.size;
+        --allocations;
+        Handle node = handle;
+        Handle prev = nodes[node].prev;
+        if (prev != INVALID && !nodes[prev].used && !nodes[prev].unused) {
+            removeFree(prev);
+            nodes[prev].size += nodes[node].size;
+            unlink(node);
+            node = prev;
+        }
+        Handle next = nodes[node].next;
+        if (next != INVALID && !nodes[next].used && !nodes[next].unused) {
+            removeFree(next);
+            nodes[node].size += nodes[next].size;
+            unlink(next);
+        }
+        insertFree(node);
+    }
+
+    // makes the range size units long, the new part free
+    void grow(uint32_t size)
+    {
+        if (size <= capacity)
+            return;
+        uint32_t added = size - capacity;
+        if (lastNode != INVALID && !nodes[lastNode].used) {
+            removeFree(lastNode);
+            nodes[lastNode].size += added;
+            insertFree(lastNode);
+        } else {
+            Handle node = newNode(capacity, added);
+            nodes[node].prev = lastNode;
+            if (lastNode != INVALID)
+                nodes[lastNode].next = node;
+            else
+                firstNode = node;
+            lastNode = node;
+            insertFree(node);
+        }
+        capacity = size;
+    }
+
+    // slides every allocation down to the lowest offsets, keeping their order, and leaves one free range at
+    // the end. moves gets every allocation's old and new place, including the ones that stayed
+    void defragment(std::vector<Move> &moves)
+    {
+        moves.clear();
+        uint32_t cursor = 0;
+        Handle previous = INVALID;
+        Handle node = firstNode;
+        firstNode = INVALID;
+        while (node != INVALID) {
+            Handle next = nodes[node].next;
+            if (nodes[node].used) {
+                Node &n = nodes[node];
+                moves.push_back({n.offset, cursor, n.size});
+                n.offset = cursor;
+                cursor += n.size;
+                n.prev = previous;
+                n.next = INVALID;
+                if (previous != INVALID)
+                    nodes[previous].next = node;
+                else
+                    firstNode = node;
+                previous = node;
+            } else {
+                removeFree(node);
+                release(node);
+            }
+            node = next;
+        }
+        lastNode = previous;
+        if (cursor < capacity) {
+            Handle rest = newNode(cursor, capacity - cursor);
+            nodes[rest].prev = previous;
+            if (previous != INVALID)
+                nodes[previous].next = rest;
+            else
+                firstNode = rest;
+            lastNode = rest;
+            insertFree(rest);
+        }
+    }
+
+    uint32_t offset(Handle handle) const
+    {
+        return nodes[handle].offset;
+    }
+
+    uint32_t size(Handle handle) const
+    {
+        return nodes[handle].size;
+    }
+
+    uint32_t totalSize() const
+    {
+        return capacity;
+    }
+
+    uint32_t usedSize() const
+    {
+        return used;
+    }
+
+    uint32_t allocationCount() const
+    {
+        return allocations;
+    }
+
+    // free ranges, 1 or 0 when there's no fragmentation
+    uint32_t freeRanges() const
+    {
+        uint32_t count = 0;
+        for (Handle node = firstNode; node != INVALID; node = nodes[node].next)
+            count += !nodes[node].used;
+        return count;
+    }
+
+private:
+    static const uint32_t MANTISSA_BITS = 3;
+    static const uint32_t BINS_PER_GROUP = 1u << MANTISSA_BITS;
+    static const uint32_t GROUPS = 32;
+
+    struct Node {
+        uint32_t offset = 0, size = 0;
+        // neighbours by offset, and the bin's free list
+        Handle prev = INVALID, next = INVALID;
+        Handle binPrev = INVALID, binNext = INVALID;
+        bool used = false;
+        // on the unused node stack
+        bool unused = false;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Handle> unusedNodes;
+    uint32_t binHeads[GROUPS * BINS_PER_GROUP];
+    uint8_t binBits[GROUPS];
+    uint32_t groupBits = 0;
+    uint32_t capacity = 0, used = 0, allocations = 0;
+    Handle firstNode = INVALID, lastNode = INVALID;
+
+    static uint32_t highestBit(uint32_t value)
+    {
+        return 31 - (uint32_t) __builtin_clz(value);
+    }
+
+    static uint32_t lowestBit(uint32_t value)
+    {
+        return (uint32_t) __builtin_ctz(value);
+    }
+
+    // bin of sizes up to size: small sizes get a bin each, larger ones an exponent and three bits below it
+    static uint32_t roundDown(uint32_t size)
+    {
+        if (size < BINS_PER_GROUP)
+            return size;
+        uint32_t shift = highestBit(size) - MANTISSA_BITS;
+        return (shift + 1) << MANTISSA_BITS | (size >> shift & (BINS_PER_GROUP - 1));
+    }
+
+    // the first bin all of whose ranges hold size
+    static uint32_t roundUp(uint32_t size)
+    {
+        if (size < BINS_PER_GROUP)
+            return size;
+        uint32_t shift = highestBit(size) - MANTISSA_BITS;
+        uint32_t bin = roundDown(size);
+        return size & ((1u << shift) - 1) ? bin + 1 : bin;
+    }
+
+    // the first bin from bin up that has a free range
+    uint32_t findBin(uint32_t bin) const
+    {
+        uint32_t group = bin / BINS_PER_GROUP;
+        if (group >= GROUPS)
+            return INVALID;
+        uint32_t inGroup = binBits[group] & (0xffu << (bin % BINS_PER_GROUP) & 0xffu);
+        if (inGroup)
+            return group * BINS_PER_GROUP + lowestBit(inGroup);
+        uint32_t groups = group + 1 < GROUPS ? groupBits & (0xffffffffu << (group + 1)) : 0;
+        if (!groups)
+            return INVALID;
+        group = lowestBit(groups);
+        return group * BINS_PER_GROUP + lowestBit(binBits[group]);
+    }
+
+    Handle newNode(uint32_t offset, uint32_t size)
+    {
+        Handle node;
+        if (!unusedNodes.empty()) {
+            node = unusedNodes.back();
+            unusedNodes.pop_back();
+        } else {
+            node = (Handle) nodes.size();
+            nodes.emplace_back();
+        }
+        nodes[node] = Node();
+        nodes[node].offset = offset;
+        nodes[node].size = size;
+        return node;
+    }
+
+    void release(Handle node)
+    {
+        nodes[node].unused = true;
+        unusedNodes.push_back(node);
+    }
+
+    // takes a merged away node out of the offset order
+    void unlink(Handle node)
+    {
+        Node &n = nodes[node];
+        if (n.prev != INVALID)
+            nodes[n.prev].next = n.next;
+        else
+            firstNode = n.next;
+        if (n.next != INVALID)
+            nodes[n.next].prev = n.prev;
+        else
+            lastNode = n.prev;
+        release(node);
+    }
+
+    void insertFree(Handle node)
+    {
+        uint32_t bin = roundDown(nodes[node].size);
+        Node &n = nodes[node];
+        n.binPrev = INVALID;
+        n.binNext = binHeads[bin];
+        if (n.binNext != INVALID)
+            nodes[n.binNext].binPrev = node;
+        binHeads[bin] = node;
+        binBits[bin / BINS_PER_GROUP] |= (uint8_t) (1u << (bin % BINS_PER_GROUP));
+        groupBits |= 1u << (bin / BINS_PER_GROUP);
+    }
+
+    void removeFree(Handle node)
+    {
+        uint32_t bin = roundDown(nodes[node].size);
+        Node &n = nodes[node];
+        if (n.binPrev != INVALID)
+            nodes[n.binPrev].binNext = n.binNext;
+        else
+            binHeads[bin] = n.binNext;
+        if (n.binNext != INVALID)
+            nodes[n.binNext].binPrev = n.binPrev;
+        if (binHeads[bin] == INVALID) {
+            binBits[bin / BINS_PER_GROUP] &= (uint8_t) ~(1u << (bin % BINS_PER_GROUP));
+            if (!binBits[bin / BINS_PER_GROUP])
+                groupBits &= ~(1u << (bin / BINS_PER_GROUP));
+        }
+        n.binPrev = n.binNext = INVALID;
+    }
+};
+
+#endif //PROJECT_BASE_OFFSETALLOCATOR_H
@@ -0,0 +1,118 @@
+#ifndef PROJECT_BASE_SCENEGRAPH_H
+#define PROJECT_BASE_SCENEGRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+typedef unsigned SceneNode;
+const SceneNode NO_PARENT = ~0u;
+
+/* Transform hierarchy (sun -> planets -> moons -> props) kept in flat arrays.
+ * Nodes are only ever appended and a parent has to exist before its children, so the arrays are in
+ * parent before child order and update() is a single forward pass: a node's world matrix is rebuilt when
+ * its own local transform was set or its parent's world matrix changed this pass, everything else keeps
+ * last frame's matrices. Normal matrices follow their world matrix. */
+class SceneGraph {
+public:
+    SceneNode add(SceneNode parent = NO_PARENT, const glm::vec3 &position = glm::vec3(0.0f),
+                  const glm::quat &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3 &scale = glm::vec3(1.0f))
+    {
+        parents.push_back(parent);
+        positions.push_back(position);
+        rotations.push_back(rotation);
+        scales.push_back(scale);
+        worlds.push_back(glm::mat4(1.0f));
+        normals.push_back(glm::mat3(1.0f));
+        dirty.push_back(1);
+        changed.push_back(0);
+        return (SceneNode) parents.size() - 1;
+    }
+
+    void setPosition(SceneNode node, const glm::vec3 &position)
+    {
+        if (positions[node] != position) {
+            positions[node] = position;
+            dirty[node] = 1;
+        }
+    }
+
+    void setRotation(SceneNode node, const glm::quat &rotation)
+    {
+        if (rotations[node] != rotation) {
+            rotations[node] = rotation;
+            dirty[node] = 1;
+        }
+    }
+
+    // rotation by angle (radians) around axis
+    void setRotation(SceneNode node, float angle, const glm::vec3 &axis)
+    {
+        setRotation(node, glm::angleAxis(angle, axis));
+    }
+
+    void setScale(SceneNode node, const glm::vec3 &scale)
+    {
+        if (scales[node] != scale) {
+            scales[node] = scale;
+            dirty[node] = 1;
+        }
+    }
+
+    // returns how many world matrices were rebuilt
+    unsigned update()
+    {
+        unsigned rebuilt = 0;
+        for (SceneNode node = 0; node < parents.size(); ++node) {
+            SceneNode parent = parents[node];
+            bool parentChanged = parent != NO_PARENT && changed[parent];
+            if (!dirty[node] && !parentChanged) {
+                changed[node] = 0;
+                continue;
+            }
+            glm::mat4 local = glm::translate(glm::mat4(1.0f), positions[node]) * glm::mat4_cast(rotations[node]);
+            local = glm::scale(local, scales[node]);
+            worlds[node] = parent == NO_PARENT ? local : worlds[parent] * local;
+            normals[node] = glm::transpose(glm::inverse(glm::mat3(worlds[node])));
+            dirty[node] = 0;
+            changed[node] = 1;
+            ++rebuilt;
+        }
+        return rebuilt;
+    }
+
+    const glm::mat4 &world(SceneNode node) const
+    {
+        return worlds[node];
+    }
+
+    const glm::mat3 &normalMatrix(SceneNode node) const
+    {
+        return normals[node];
+    }
+
+    // whether the last update() moved the node
+    bool moved(SceneNode node) const
+    {
+        return changed[node] != 0;
+    }
+
+    unsigned size() const
+    {
+        return (unsigned) parents.size();
+    }
+
+private:
+    std::vector<SceneNode> parents;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> worlds;
+    std::vector<glm::mat3> normals;
+    std::vector<unsigned char> dirty;
+    std::vector<unsigned char> changed;
+};
+
+#endif //PROJECT_BASE_SCENEGRAPH_H
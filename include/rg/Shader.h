@@ -11,10 +11,13 @@
 #include <fstream>
 #include <sstream>
 #include <rg/Error.h>
+#include <rg/UniformTable.h>
 #include <common.h>
 #include <glm/glm.hpp>
 class Shader {
     unsigned int m_Id;
+    // active uniforms with the last uploaded values, the setters stay const for existing callers
+    mutable UniformTable uniforms;
 public:
     Shader(std::string vertexShaderPath, std::string fragmentShaderPath) {
         appendShaderFolderIfNotPresent(vertexShaderPath);
@@ -65,6 +68,7 @@ public:
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
         m_Id = shaderProgram;
+        uniforms.reflect(m_Id);
     }
 
     // activate the shader
@@ -75,61 +79,111 @@ public:
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
+    // handle of an active uniform, resolve once and pass it to the setters on hot paths
+    UniformHandle uniform(const std::string &name) const
+    {
+        return uniforms.find(name);
+    }
+    // ------------------------------------------------------------------------
+    void setBool(UniformHandle handle, bool value) const
+    {
+        setInt(handle, (int)value);
+    }
     void setBool(const std::string &name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(m_Id, name.c_str()), (int)value);
+        setInt(uniforms.find(name), (int)value);
     }
     // ------------------------------------------------------------------------
+    void setInt(UniformHandle handle, int value) const
+    {
+        if (uniforms.changed(handle, &value, sizeof(value)))
+            glUniform1i(uniforms.location(handle), value);
+    }
     void setInt(const std::string &name, int value) const
     {
-        glUniform1i(glGetUniformLocation(m_Id, name.c_str()), value);
+        setInt(uniforms.find(name), value);
     }
     // ------------------------------------------------------------------------
+    void setFloat(UniformHandle handle, float value) const
+    {
+        if (uniforms.changed(handle, &value, sizeof(value)))
+            glUniform1f(uniforms.location(handle), value);
+    }
     void setFloat(const std::string &name, float value) const
     {
-        glUniform1f(glGetUniformLocation(m_Id, name.c_str()), value);
+        setFloat(uniforms.find(name), value);
     }
     // ------------------------------------------------------------------------
+    void setVec2(UniformHandle handle, const glm::vec2 &value) const
+    {
+        if (uniforms.changed(handle, &value[0], sizeof(value)))
+            glUniform2fv(uniforms.location(handle), 1, &value[0]);
+    }
     void setVec2(const std::string &name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(m_Id, name.c_str()), 1, &value[0]);
+        setVec2(uniforms.find(name), value);
     }
     void setVec2(const std::string &name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(m_Id, name.c_str()), x, y);
+        setVec2(uniforms.find(name), glm::vec2(x, y));
     }
     // ------------------------------------------------------------------------
+    void setVec3(UniformHandle handle, const glm::vec3 &value) const
+    {
+        if (uniforms.changed(handle, &value[0], sizeof(value)))
+            glUniform3fv(uniforms.location(handle), 1, &value[0]);
+    }
     void setVec3(const std::string &name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(m_Id, name.c_str()), 1, &value[0]);
+        setVec3(uniforms.find(name), value);
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(m_Id, name.c_str()), x, y, z);
+        setVec3(uniforms.find(name), glm::vec3(x, y, z));
     }
     // ------------------------------------------------------------------------
+    void setVec4(UniformHandle handle, const glm::vec4 &value) const
+    {
+        if (uniforms.changed(handle, &value[0], sizeof(value)))
+            glUniform4fv(uniforms.location(handle), 1, &value[0]);
+    }
     void setVec4(const std::string &name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(m_Id, name.c_str()), 1, &value[0]);
+        setVec4(uniforms.find(name), value);
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w)
+    void setVec4(const std::string &name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(m_Id, name.c_str()), x, y, z, w);
+        setVec4(uniforms.find(name), glm::vec4(x, y, z, w));
     }
     // ------------------------------------------------------------------------
+    void setMat2(UniformHandle handle, const glm::mat2 &mat) const
+    {
+        if (uniforms.changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix2fv(uniforms.location(handle), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(m_Id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(uniforms.find(name), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat3(UniformHandle handle, const glm::mat3 &mat) const
+    {
+        if (uniforms.changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix3fv(uniforms.location(handle), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(m_Id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(uniforms.find(name), mat);
     }
     // ------------------------------------------------------------------------
+    void setMat4(UniformHandle handle, const glm::mat4 &mat) const
+    {
+        if (uniforms.changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix4fv(uniforms.location(handle), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(m_Id, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniforms.find(name), mat);
     }
     void deleteProgram() {
         glDeleteProgram(m_Id);
@@ -0,0 +1,188 @@
+#ifndef PROJECT_BASE_TEXTURECACHE_H
+#define PROJECT_BASE_TEXTURECACHE_H
+
+#include <rg/MappedFile.h>
+#include <rg/TextureCompressor.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Block compressed texture with its mip chain, converted from the source images the first time they are
+ * loaded and written next to the first of them. A header with the format, size, face and level counts is
+ * followed by a table of every face's levels and then the levels themselves, 16 byte aligned, so a mapped
+ * file goes to glCompressedTexImage2D level by level as it is. The key hashes the sources and the
+ * conversion options; a file with another key or version is stale and open() refuses it. */
+class TextureCache {
+public:
+    static const uint32_t MAGIC = 0x48435854; // "TXCH"
+    static const uint32_t VERSION = 1;
+
+    TextureCache() = default;
+    TextureCache(const TextureCache &) = delete;
+    TextureCache &operator=(const TextureCache &) = delete;
+
+    static std::string pathFor(const std::string &source)
+    {
+        return source + ".texcache";
+    }
+
+    // maps the cache file if it was made from sources and options with this key
+    bool open(const std::string &path, uint64_t key)
+    {
+        close();
+        if (!file.open(path) || file.size() < sizeof(Header))
+            return false;
+        base = file.data();
+        if (!valid(file.size(), key)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // lays out an empty cache, the levels are then compressed into writableLevel()
+    void create(uint64_t key, BlockFormat format, unsigned width, unsigned height, unsigned faces, unsigned levels)
+    {
+        close();
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.key = key;
+        header.format = (uint32_t) format;
+        header.width = width;
+        header.height = height;
+        header.faces = faces;
+        header.levels = levels;
+        std::vector<Range> table((size_t) faces * levels);
+        uint64_t offset = align(sizeof(Header) + table.size() * sizeof(Range));
+        for (unsigned face = 0; face < faces; ++face) {
+            for (unsigned level = 0; level < levels; ++level) {
+                Range &range = table[(size_t) face * levels + level];
+                range.offset = offset;
+                range.size = TextureCompressor::levelBytes(format, levelWidth(width, level), levelWidth(height, level));
+                offset = align(offset + range.size);
+            }
+        }
+        owned.assign((size_t) offset, 0);
+        std::memcpy(&owned[0], &header, sizeof(header));
+        std::memcpy(&owned[sizeof(Header)], table.data(), table.size() * sizeof(Range));
+        base = owned.data();
+    }
+
+    bool write(const std::string &path) const
+    {
+        return !owned.empty() && MappedFile::write(path, owned.data(), owned.size());
+    }
+
+    void close()
+    {
+        file.close();
+        owned.clear();
+        base = nullptr;
+    }
+
+    BlockFormat format() const
+    {
+        return (BlockFormat) header().format;
+    }
+
+    unsigned width(unsigned level = 0) const
+    {
+        return levelWidth(header().width, level);
+    }
+
+    unsigned height(unsigned level = 0) const
+    {
+        return levelWidth(header().height, level);
+    }
+
+    unsigned faces() const
+    {
+        return header().faces;
+    }
+
+    unsigned levels() const
+    {
+        return header().levels;
+    }
+
+    const unsigned char *level(unsigned face, unsigned level) const
+    {
+        return base + range(face, level).offset;
+    }
+
+    // only on a cache being created
+    unsigned char *writableLevel(unsigned face, unsigned level)
+    {
+        return &owned[(size_t) range(face, level).offset];
+    }
+
+    size_t levelSize(unsigned face, unsigned level) const
+    {
+        return (size_t) range(face, level).size;
+    }
+
+private:
+    struct Header {
+        uint32_t magic, version;
+        uint64_t key;
+        uint32_t format, width, height, faces, levels, reserved;
+    };
+
+    struct Range {
+        uint64_t offset, size;
+    };
+
+    std::vector<unsigned char> owned;
+    MappedFile file;
+    const unsigned char *base = nullptr;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~(uint64_t) 15;
+    }
+
+    static unsigned levelWidth(unsigned width, unsigned level)
+    {
+        return std::max(1u, width >> level);
+    }
+
+    const Header &header() const
+    {
+        return *(const Header *) base;
+    }
+
+    const Range &range(unsigned face, unsigned level) const
+    {
+        return ((const Range *) (base + sizeof(Header)))[(size_t) face * header().levels + level];
+    }
+
+    bool valid(size_t size, uint64_t key) const
+    {
+        const Header &h = header();
+        if (h.magic != MAGIC || h.version != VERSION || h.key != key)
+            return false;
+        BlockFormat format = (BlockFormat) h.format;
+        if (format != BlockFormat::BC1 && format != BlockFormat::BC3 && format != BlockFormat::BC4 && format != BlockFormat::BC5)
+            return false;
+        if ((h.faces != 1 && h.faces != 6) || h.width == 0 || h.height == 0 || h.levels == 0
+            || h.levels > TextureCompressor::levelCount(h.width, h.height))
+            return false;
+        if (sizeof(Header) + (uint64_t) h.faces * h.levels * sizeof(Range) > size)
+            return false;
+        for (unsigned face = 0; face < h.faces; ++face) {
+            for (unsigned level = 0; level < h.levels; ++level) {
+                const Range &r = range(face, level);
+                if (r.size != TextureCompressor::levelBytes(format, width(level), height(level)) || r.offset > size
+                    || r.size > size - r.offset)
+                    return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif //PROJECT_BASE_TEXTURECACHE_H
@@ -0,0 +1,286 @@
+#ifndef PROJECT_BASE_TEXTURECOMPRESSOR_H
+#define PROJECT_BASE_TEXTURECOMPRESSOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// BC1 for opaque color, BC3 for color with alpha, BC4 for one channel and BC5 for two
+enum class BlockFormat : uint32_t {
+    BC1 = 1,
+    BC3 = 3,
+    BC4 = 4,
+    BC5 = 5
+};
+
+/* Block compression and mip chains for textures converted ahead of use.
+ * Every 4x4 block is fitted on its own. Color blocks take their endpoints from the extent of the texels
+ * along the block's principal axis, pulled in by a sixteenth so the interpolated colors land on the
+ * texels more often, then every texel picks the nearest of the four palette entries. Single channel
+ * blocks (BC4, BC3's alpha and both halves of BC5) span their minimum to maximum with the eight value
+ * palette. Mip levels of color images are averaged in linear light and stored back as sRGB, so dark
+ * and bright detail don't wash out to a darker average in the distance; alpha and data images such as
+ * normals or heights average their stored values. */
+class TextureCompressor {
+public:
+    static BlockFormat chooseFormat(const unsigned char *pixels, unsigned width, unsigned height, int channels)
+    {
+        if (channels == 1)
+            return BlockFormat::BC4;
+        if (channels == 2)
+            return BlockFormat::BC5;
+        if (channels == 4)
+            for (size_t i = 3; i < (size_t) width * height * 4; i += 4)
+                if (pixels[i] != 255)
+                    return BlockFormat::BC3;
+        return BlockFormat::BC1;
+    }
+
+    static unsigned blockBytes(BlockFormat format)
+    {
+        return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+    }
+
+    static size_t levelBytes(BlockFormat format, unsigned width, unsigned height)
+    {
+        return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    // the full chain down to 1x1
+    static unsigned levelCount(unsigned width, unsigned height)
+    {
+        unsigned levels = 1;
+        while (width > 1 || height > 1) {
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+            ++levels;
+        }
+        return levels;
+    }
+
+    // the next mip level, every texel the average of the up to four below it
+    static std::vector<unsigned char> downsample(const unsigned char *pixels, unsigned width, unsigned height,
+                                                 int channels, bool color)
+    {
+        unsigned w = std::max(1u, width / 2), h = std::max(1u, height / 2);
+        // alpha and two channel images are never color
+        int colorChannels = color && channels >= 3 ? 3 : 0;
+        const float *linear = srgbToLinear();
+        std::vector<unsigned char> result((size_t) w * h * channels);
+        for (unsigned y = 0; y < h; ++y) {
+            unsigned y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (unsigned x = 0; x < w; ++x) {
+                unsigned x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                const unsigned char *texels[4] = {
+                        pixels + ((size_t) y0 * width + x0) * channels, pixels + ((size_t) y0 * width + x1) * channels,
+                        pixels + ((size_t) y1 * width + x0) * channels, pixels + ((size_t) y1 * width + x1) * channels
+                };
+                unsigned char *out = &result[((size_t) y * w + x) * channels];
+                for (int c = 0; c < channels; ++c) {
+                    if (c < colorChannels) {
+                        float sum = 0.0f;
+                        for (const unsigned char *texel : texels)
+                            sum += linear[texel[c]];
+                        out[c] = linearToSrgb(0.25f * sum);
+                    } else {
+                        unsigned sum = 0;
+                        for (const unsigned char *texel : texels)
+                            sum += texel[c];
+                        out[c] = (unsigned char) ((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    // compresses the block rows [firstRow, lastRow) of an image into level, which holds all of its blocks
+    static void compress(const unsigned char *pixels, unsigned width, unsigned height, int channels, BlockFormat format,
+                         unsigned firstRow, unsigned lastRow, unsigned char *level)
+    {
+        unsigned blocksX = (width + 3) / 4;
+        unsigned bytes = blockBytes(format);
+        unsigned char texels[16][4];
+        for (unsigned row = firstRow; row < lastRow; ++row) {
+            for (unsigned column = 0; column < blocksX; ++column) {
+                fetchBlock(pixels, width, height, channels, column * 4, row * 4, texels);
+                unsigned char *out = level + ((size_t) row * blocksX + column) * bytes;
+                switch (format) {
+                    case BlockFormat::BC1:
+                        encodeColor(texels, out);
+                        break;
+                    case BlockFormat::BC3:
+                        encodeChannel(texels, 3, out);
+                        encodeColor(texels, out + 8);
+                        break;
+                    case BlockFormat::BC4:
+                        encodeChannel(texels, 0, out);
+                        break;
+                    case BlockFormat::BC5:
+                        encodeChannel(texels, 0, out);
+                        encodeChannel(texels, 1, out + 8);
+                        break;
+                }
+            }
+        }
+    }
+
+private:
+    static const float *srgbToLinear()
+    {
+        struct Table {
+            float values[256];
+
+            Table()
+            {
+                for (int i = 0; i < 256; ++i) {
+                    float v = i / 255.0f;
+                    values[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+                }
+            }
+        };
+        static const Table table;
+        return table.values;
+    }
+
+    static unsigned char linearToSrgb(float v)
+    {
+        float s = v <= 0.0031308f ? 12.92f * v : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+        return (unsigned char) std::min(255.0f, std::max(0.0f, s * 255.0f + 0.5f));
+    }
+
+    // the block at x, y as RGBA, edge texels repeated where the image ends inside it
+    static void fetchBlock(const unsigned char *pixels, unsigned width, unsigned height, int channels, unsigned x,
+                           unsigned y, unsigned char texels[16][4])
+    {
+        for (unsigned i = 0; i < 16; ++i) {
+            unsigned tx = std::min(x + i % 4, width - 1), ty = std::min(y + i / 4, height - 1);
+            const unsigned char *texel = pixels + ((size_t) ty * width + tx) * channels;
+            for (int c = 0; c < 4; ++c)
+                texels[i][c] = c < channels ? texel[c] : c == 3 ? 255 : 0;
+        }
+    }
+
+    static uint16_t pack565(const float color[3])
+    {
+        int r = (int) std::lround(std::min(255.0f, std::max(0.0f, color[0])) * 31.0f / 255.0f);
+        int g = (int) std::lround(std::min(255.0f, std::max(0.0f, color[1])) * 63.0f / 255.0f);
+        int b = (int) std::lround(std::min(255.0f, std::max(0.0f, color[2])) * 31.0f / 255.0f);
+        return (uint16_t) (r << 11 | g << 5 | b);
+    }
+
+    static void unpack565(uint16_t packed, int color[3])
+    {
+        int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+        color[0] = r << 3 | r >> 2;
+        color[1] = g << 2 | g >> 4;
+        color[2] = b << 3 | b >> 2;
+    }
+
+    static void encodeColor(const unsigned char texels[16][4], unsigned char *out)
+    {
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        for (unsigned i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                mean[c] += texels[i][c] / 16.0f;
+        // covariance xx, xy, xz, yy, yz, zz
+        float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        for (unsigned i = 0; i < 16; ++i) {
+            float d[3] = {texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2]};
+            cov[0] += d[0] * d[0];
+            cov[1] += d[0] * d[1];
+            cov[2] += d[0] * d[2];
+            cov[3] += d[1] * d[1];
+            cov[4] += d[1] * d[2];
+            cov[5] += d[2] * d[2];
+        }
+        // a few power iterations find the principal axis well enough
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            float next[3] = {
+                    cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                    cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                    cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+            };
+            float length = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+            if (length == 0.0f)
+                break;
+            for (int c = 0; c < 3; ++c)
+                axis[c] = next[c] / length;
+        }
+        float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        float low = 0.0f, high = 0.0f;
+        for (unsigned i = 0; i < 16; ++i) {
+            float t = ((texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1]
+                       + (texels[i][2] - mean[2]) * axis[2]) / axisLength2;
+            low = std::min(low, t);
+            high = std::max(high, t);
+        }
+        float inset = (high - low) / 16.0f;
+        low += inset;
+        high -= inset;
+        float end0[3], end1[3];
+        for (int c = 0; c < 3; ++c) {
+            end0[c] = mean[c] + axis[c] * high;
+            end1[c] = mean[c] + axis[c] * low;
+        }
+        uint16_t color0 = pack565(end0), color1 = pack565(end1);
+        // color0 > color1 selects the four color palette, which BC3 assumes anyway
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            int palette[4][3];
+            unpack565(color0, palette[0]);
+            unpack565(color1, palette[1]);
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (unsigned i = 0; i < 16; ++i) {
+                int best = 0, bestDistance = 1 << 30;
+                for (int p = 0; p < 4; ++p) {
+                    int dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1], db = texels[i][2] - palette[p][2];
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= (uint32_t) best << (2 * i);
+            }
+        }
+        out[0] = (unsigned char) (color0 & 0xff);
+        out[1] = (unsigned char) (color0 >> 8);
+        out[2] = (unsigned char) (color1 & 0xff);
+        out[3] = (unsigned char) (color1 >> 8);
+        for (int b = 0; b < 4; ++b)
+            out[4 + b] = (unsigned char) (indices >> (8 * b));
+    }
+
+    static void encodeChannel(const unsigned char texels[16][4], int channel, unsigned char *out)
+    {
+        int low = 255, high = 0;
+        for (unsigned i = 0; i < 16; ++i) {
+            low = std::min(low, (int) texels[i][channel]);
+            high = std::max(high, (int) texels[i][channel]);
+        }
+        // high > low selects the eight value palette; high to low in seven steps is 0, 2, 3, ..., 7, 1
+        uint64_t indices = 0;
+        if (high > low) {
+            for (unsigned i = 0; i < 16; ++i) {
+                int step = (int) ((float) (high - texels[i][channel]) * 7.0f / (high - low) + 0.5f);
+                uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+                indices |= index << (3 * i);
+            }
+        }
+        out[0] = (unsigned char) high;
+        out[1] = (unsigned char) low;
+        for (int b = 0; b < 6; ++b)
+            out[2 + b] = (unsigned char) (indices >> (8 * b));
+    }
+};
+
+#endif //PROJECT_BASE_TEXTURECOMPRESSOR_H
@@ -0,0 +1,118 @@
+#ifndef PROJECT_BASE_UNIFORMBUFFERS_H
+#define PROJECT_BASE_UNIFORMBUFFERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+
+/* Data shared by every program through std140 uniform blocks, declared on the GLSL side in
+ * resources/shaders/common/. Each block has a fixed binding point that programs are hooked up to right
+ * after linking, so the buffers are uploaded once per frame no matter how many shaders read them.
+ * The structs below mirror the std140 layout field by field: vec3s are paired with a float so nothing
+ * needs hidden padding, and mat4s are 64 bytes. */
+enum UniformBlockBinding {
+    FRAME_CONSTANTS_BINDING = 0,
+    LIGHTS_BINDING = 1
+};
+
+struct FrameConstants {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 viewPosition;
+    float time;
+    glm::vec3 viewDirection;
+    float padding;
+};
+static_assert(sizeof(FrameConstants) == 160, "FrameConstants must match the std140 block");
+
+struct PointLightBlock {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 ambient;
+    float linear;
+    glm::vec3 diffuse;
+    float quadratic;
+    glm::vec3 specular;
+    float padding;
+};
+
+struct SpotLightBlock {
+    glm::vec3 position;
+    float cutOff;
+    glm::vec3 direction;
+    float outerCutOff;
+    glm::vec3 diffuse;
+    float constant;
+    glm::vec3 specular;
+    float linear;
+    float quadratic;
+    int spotToggle;
+    float padding[2];
+};
+
+struct Lights {
+    PointLightBlock pointLight;
+    SpotLightBlock spotLight;
+};
+static_assert(sizeof(PointLightBlock) == 64 && sizeof(SpotLightBlock) == 80, "light structs must match std140");
+
+// hooks the blocks a program declares up to their binding points, blocks it doesn't use are skipped
+inline void bindUniformBlocks(unsigned program)
+{
+    static const struct {
+        const char *name;
+        UniformBlockBinding binding;
+    } blocks[] = {
+            { "FrameConstants", FRAME_CONSTANTS_BINDING },
+            { "Lights", LIGHTS_BINDING },
+    };
+    for (const auto &block : blocks) {
+        unsigned index = glGetUniformBlockIndex(program, block.name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, block.binding);
+    }
+}
+
+/* One uniform buffer holding a T at a fixed binding point.
+ * update() keeps a copy of the last upload and skips the transfer when nothing changed. */
+template<typename T>
+class UniformBuffer {
+public:
+    void create(UniformBlockBinding blockBinding)
+    {
+        binding = blockBinding;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_UNIFORM_BUFFER, id);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, id);
+        uploaded = false;
+    }
+
+    void destroy()
+    {
+        glDeleteBuffers(1, &id);
+        id = 0;
+    }
+
+    void update(const T &value)
+    {
+        if (!uploaded || std::memcmp(&shadow, &value, sizeof(T)) != 0) {
+            glBindBuffer(GL_UNIFORM_BUFFER, id);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &value);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            shadow = value;
+            uploaded = true;
+        }
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, id);
+    }
+
+private:
+    unsigned id = 0;
+    UniformBlockBinding binding = FRAME_CONSTANTS_BINDING;
+    T shadow;
+    bool uploaded = false;
+};
+
+#endif //PROJECT_BASE_UNIFORMBUFFERS_H
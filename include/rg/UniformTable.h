@@ -0,0 +1,127 @@
+#ifndef PROJECT_BASE_UNIFORMTABLE_H
+#define PROJECT_BASE_UNIFORMTABLE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* index into a program's UniformTable, -1 for names the program doesn't have (setting those does nothing,
+ * same as GL location -1) */
+typedef int UniformHandle;
+const UniformHandle INVALID_UNIFORM = -1;
+
+/* The active uniforms of a linked program, reflected once into a flat table sorted by name.
+ * Every entry keeps the resolved location and a shadow copy of the last value uploaded through it, so
+ * setting a value that didn't change skips the GL call. Array uniforms get an entry per element
+ * ("lights[2]") and their bare name maps to the first element. The shadow is only right as long as all
+ * uploads for the program go through the table. */
+class UniformTable {
+public:
+    static const unsigned MAX_VALUE_BYTES = 16 * sizeof(float);
+
+    void reflect(unsigned program)
+    {
+        entries.clear();
+        shadows.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> buffer(maxLength + 1);
+
+        for (GLint i = 0; i < count; ++i) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program, (GLuint) i, (GLsizei) buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+
+            // uniform block members have no location and are set through their buffer
+            if (glGetUniformLocation(program, name.c_str()) < 0)
+                continue;
+
+            std::string base = name;
+            if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+                base.resize(base.size() - 3);
+            unsigned first = addShadow();
+            add(base, glGetUniformLocation(program, name.c_str()), first);
+            if (size > 1) {
+                for (GLint element = 0; element < size; ++element) {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    add(elementName, glGetUniformLocation(program, elementName.c_str()),
+                        element == 0 ? first : addShadow());
+                }
+            }
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.name < b.name; });
+    }
+
+    UniformHandle find(const std::string &name) const
+    {
+        auto it = std::lower_bound(entries.begin(), entries.end(), name,
+                                   [](const Entry &entry, const std::string &key) { return entry.name < key; });
+        if (it == entries.end() || it->name != name)
+            return INVALID_UNIFORM;
+        return (UniformHandle) (it - entries.begin());
+    }
+
+    GLint location(UniformHandle handle) const
+    {
+        return entries[handle].location;
+    }
+
+    // true (and the shadow updated) when the value differs from the last one uploaded through this handle
+    bool changed(UniformHandle handle, const void *value, unsigned bytes)
+    {
+        if (handle < 0)
+            return false;
+        Shadow &shadow = shadows[entries[handle].shadow];
+        if (shadow.valid && std::memcmp(shadow.bytes, value, bytes) == 0)
+            return false;
+        std::memcpy(shadow.bytes, value, bytes);
+        shadow.valid = true;
+        return true;
+    }
+
+    unsigned size() const
+    {
+        return (unsigned) entries.size();
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        GLint location;
+        unsigned shadow;
+    };
+
+    // an array's bare name and its first element share one
+    struct Shadow {
+        bool valid;
+        unsigned char bytes[MAX_VALUE_BYTES];
+    };
+
+    std::vector<Entry> entries;
+    std::vector<Shadow> shadows;
+
+    void add(const std::string &name, GLint location, unsigned shadow)
+    {
+        Entry entry;
+        entry.name = name;
+        entry.location = location;
+        entry.shadow = shadow;
+        entries.push_back(entry);
+    }
+
+    unsigned addShadow()
+    {
+        Shadow shadow;
+        shadow.valid = false;
+        shadows.push_back(shadow);
+        return (unsigned) shadows.size() - 1;
+    }
+};
+
+#endif //PROJECT_BASE_UNIFORMTABLE_H
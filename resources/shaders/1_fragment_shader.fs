@@ -3,63 +3,55 @@
 in vec3 normals;
 in vec2 coordinates;
 in vec3 fragPosition;
+in vec4 tint;
 
 uniform sampler2D materDiffuse;
 uniform sampler2D materSpecular;
 uniform float materShininess;
-uniform vec3 lightDiffuse;
-uniform vec3 lightAmbient;
-uniform vec3 lightSpecular;
-uniform vec3 lightPosition;
-uniform float lightConstant;
-uniform float lightLinear;
-uniform float lightQuadratic;
-uniform vec3 viewPosition;
-uniform vec3 viewDirection;
-uniform bool spotToggle;
-uniform float spotCutOff;
-uniform float spotOuterCutOff;
+
+#include "common/frame_constants.glsl"
+#include "common/lights.glsl"
 
 layout (location=0) out vec4 fragColor;
 layout (location=1) out vec4 brightColor;
 
 void main() {
     /* ambient */
-    vec3 ambient = lightAmbient * vec3(texture(materDiffuse, coordinates));
+    vec3 ambient = pointLight.ambient * vec3(texture(materDiffuse, coordinates));
 
     /* diffuse */
     vec3 norm = normalize(normals);
-    vec3 lightDirection = normalize(lightPosition - fragPosition);
+    vec3 lightDirection = normalize(pointLight.position - fragPosition);
     float diff = max(dot(norm, lightDirection), 0.0);
-    vec3 diffuse = lightDiffuse * diff * vec3(texture(materDiffuse, coordinates));
+    vec3 diffuse = pointLight.diffuse * diff * vec3(texture(materDiffuse, coordinates));
 
     /* specular */
     vec3 fragDirection = normalize(viewPosition - fragPosition);
     vec3 reflectDirection = reflect(-lightDirection, norm);
     float spec = pow(max(dot(fragDirection, reflectDirection), 0.0), materShininess);
-    vec3 specular = lightSpecular * spec * vec3(texture(materSpecular, coordinates).rrr);
+    vec3 specular = pointLight.specular * spec * vec3(texture(materSpecular, coordinates).rrr);
 
     /* spot light */
     vec3 spotDiffuse = vec3(0.0);
     vec3 spotSpecular = vec3(0.0);
-    if (spotToggle) {
+    if (spotLight.spotToggle) {
         diff = max(dot(norm, fragDirection), 0.0);
-        spotDiffuse = lightSpecular * diff * vec3(texture(materDiffuse, coordinates));
+        spotDiffuse = spotLight.diffuse * diff * vec3(texture(materDiffuse, coordinates));
 
         reflectDirection = reflect(-fragDirection, norm);
         spec = pow(max(dot(fragDirection, reflectDirection), 0.0), materShininess);
-        spotSpecular = lightSpecular * spec * vec3(texture(materSpecular, coordinates).rrr);
+        spotSpecular = spotLight.specular * spec * vec3(texture(materSpecular, coordinates).rrr);
 
-        float theta = dot(fragDirection, normalize(-viewDirection));
-        float epsilon = spotCutOff - spotOuterCutOff;
-        float intensity = clamp((theta - spotOuterCutOff) / epsilon, 0.0, 1.0);
+        float theta = dot(fragDirection, normalize(-spotLight.direction));
+        float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+        float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
         spotDiffuse *= intensity;
         spotSpecular *= intensity;
     }
 
     /* attenuation */
-    float sourceDistance = length(lightPosition - fragPosition);
-    float attenuation = 1.0 / (lightConstant + sourceDistance * lightLinear + pow(sourceDistance, 2) * lightQuadratic);
+    float sourceDistance = length(pointLight.position - fragPosition);
+    float attenuation = 1.0 / (pointLight.constant + sourceDistance * pointLight.linear + pow(sourceDistance, 2) * pointLight.quadratic);
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -67,7 +59,7 @@ void main() {
     spotSpecular *= attenuation;
 
     /* output */
-    fragColor = vec4(ambient + diffuse + specular + spotDiffuse + spotSpecular, 1.0);
+    fragColor = vec4((ambient + diffuse + specular + spotDiffuse + spotSpecular) * tint.rgb, 1.0);
 
     /* highlights */
     float brightness = dot(fragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
@@ -0,0 +1,28 @@
+#version 330 core
+
+layout (location=0) in vec3 aPos;
+layout (location=1) in vec3 aNor;
+layout (location=2) in vec2 aCoo;
+/* per instance, from an InstanceBuffer */
+layout (location=5) in mat4 instanceModel;
+layout (location=9) in vec4 instanceTint;
+
+out vec3 normals;
+out vec2 coordinates;
+out vec3 fragPosition;
+out vec4 tint;
+
+/* applied on top of every instance, identity for instances placed in world space */
+uniform mat4 model;
+#include "common/frame_constants.glsl"
+
+void main() {
+    mat4 world = model * instanceModel;
+    /* instances are rotated, unlike the single draws, so the normals have to follow */
+    normals = mat3(world) * aNor;
+    coordinates = aCoo;
+    tint = instanceTint;
+    fragPosition = vec3(world * vec4(aPos, 1.0));
+
+    gl_Position = projection * view * vec4(fragPosition, 1.0);
+}
@@ -7,14 +7,15 @@ layout (location=2) in vec2 aCoo;
 out vec3 normals;
 out vec2 coordinates;
 out vec3 fragPosition;
+out vec4 tint;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "common/frame_constants.glsl"
 
 void main() {
     normals = aNor;
     coordinates = aCoo;
+    tint = vec4(1.0);
     fragPosition = vec3(model * vec4(aPos, 1.0));
 
     gl_Position = projection * view * model * vec4(aPos, 1.0);
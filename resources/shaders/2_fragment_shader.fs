@@ -7,7 +7,10 @@ in vec2 coordinates;
 
 uniform sampler2D texture_diffuse1;
 
+#include "common/lod_fade.glsl"
+
 void main() {
+    lodFadeDiscard();
     fragColor = texture(texture_diffuse1, coordinates);
 
     float brightness = dot(fragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
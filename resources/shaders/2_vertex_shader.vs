@@ -6,8 +6,7 @@ layout (location = 2) in vec2 aTexCoords;
 out vec2 coordinates;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "common/frame_constants.glsl"
 
 void main() {
     coordinates = aTexCoords;
@@ -2,33 +2,6 @@
 layout (location=0) out vec4 FragColor;
 layout (location=1) out vec4 BrightColor;
 
-struct PointLight {
-    vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 diffuse;
-    vec3 specular;
-    bool spotToggle;
-};
-
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
@@ -38,12 +11,14 @@ struct Material {
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
+in vec4 Tint;
 
-uniform vec3 viewPosition;
-uniform PointLight pointLight;
-uniform SpotLight spotLight;
 uniform Material material;
 
+#include "common/frame_constants.glsl"
+#include "common/lights.glsl"
+#include "common/lod_fade.glsl"
+
 // calculates the color when using a point light.
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     vec3 lightDir = normalize(light.position - fragPos);
@@ -93,12 +68,13 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
 } // as seen in learnopengl
 
 void main() {
+    lodFadeDiscard();
     vec3 normal = normalize(Normal);
     vec3 viewDir = normalize(viewPosition - FragPos);
     vec3 result = vec3(0.0);
     result += CalcPointLight(pointLight, normal, FragPos, viewDir);
     result += CalcSpotLight(spotLight, normal, FragPos, viewDir);
-    FragColor = vec4(result, 1.0);
+    FragColor = vec4(result * Tint.rgb, 1.0);
     float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
     if (0.8 < brightness)
         BrightColor = FragColor;
@@ -0,0 +1,26 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per instance, from an InstanceBuffer
+layout (location = 5) in mat4 instanceModel;
+layout (location = 9) in vec4 instanceTint;
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 FragPos;
+out vec4 Tint;
+
+// applied on top of every instance, identity for instances placed in world space
+uniform mat4 model;
+#include "common/frame_constants.glsl"
+
+void main() {
+    mat4 world = model * instanceModel;
+    FragPos = vec3(world * vec4(aPos, 1.0));
+    // instances are only scaled uniformly, so the upper 3x3 is enough to carry the normals
+    Normal = mat3(world) * aNormal;
+    TexCoords = aTexCoords;
+    Tint = instanceTint;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
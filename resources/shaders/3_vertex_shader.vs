@@ -6,15 +6,16 @@ layout (location = 2) in vec2 aTexCoords;
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
+out vec4 Tint;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "common/frame_constants.glsl"
 uniform mat4 normRotation;
 
 void main() {
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = vec3(normRotation * vec4(aNormal, 1.0));
-    TexCoords = aTexCoords;    
+    TexCoords = aTexCoords;
+    Tint = vec4(1.0);
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
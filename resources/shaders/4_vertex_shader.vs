@@ -4,10 +4,10 @@ layout (location=0) in vec3 aPos;
 
 out vec3 coordinates;
 
-uniform mat4 view;
-uniform mat4 projection;
+#include "common/frame_constants.glsl"
 
 void main() {
     coordinates = aPos;
-    gl_Position = (projection * view * vec4(aPos, 1.0)).xyww;
+    /* rotation only, the sky stays at infinity */
+    gl_Position = (projection * mat4(mat3(view)) * vec4(aPos, 1.0)).xyww;
 }
\ No newline at end of file
@@ -5,7 +5,9 @@ layout (location = 1) in vec2 aCoo;
 
 out vec2 coordinates;
 
+uniform vec2 uvScale;
+
 void main() {
-    coordinates = aCoo;
+    coordinates = aCoo * uvScale;
     gl_Position = vec4(aPos, 0.0, 1.0);
 }
\ No newline at end of file
@@ -4,14 +4,18 @@ in vec2 coordinates;
 
 uniform sampler2D baseImage;
 uniform sampler2D highlights;
+uniform float bloomStrength;
+uniform vec2 uvScale;
 
 out vec4 fragColor;
 
 void main() {
     const float gamma = 1.4;
-    vec3 screen = texture(baseImage, coordinates).rgb;
+    /* the scene may cover only part of its target, keep bilinear taps inside the rendered region */
+    vec2 halfTexel = 0.5 / textureSize(baseImage, 0);
+    vec3 screen = texture(baseImage, min(coordinates * uvScale, uvScale - halfTexel)).rgb;
     vec3 bloom = texture(highlights, coordinates).rgb;
-    vec3 outputImage = screen + bloom;
+    vec3 outputImage = screen + bloom * bloomStrength;
     outputImage = vec3(1.0) - exp(-outputImage * 0.9);
     outputImage = pow(outputImage, vec3(1.0 / gamma));
     fragColor = vec4(outputImage, 1.0);
@@ -0,0 +1,61 @@
+#version 330 core
+
+in vec2 coordinates;
+
+uniform sampler2D image;
+uniform bool karisAverage;
+
+out vec4 fragColor;
+
+float karisWeight(vec3 color) {
+    float luma = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    return 1.0 / (1.0 + luma);
+}
+
+void main() {
+    /* 13 tap downsample: a 36 texel footprint read through bilinear fetches */
+    vec2 texel = 1.0 / textureSize(image, 0);
+    float x = texel.x;
+    float y = texel.y;
+
+    vec3 a = texture(image, coordinates + vec2(-2.0 * x,  2.0 * y)).rgb;
+    vec3 b = texture(image, coordinates + vec2( 0.0,      2.0 * y)).rgb;
+    vec3 c = texture(image, coordinates + vec2( 2.0 * x,  2.0 * y)).rgb;
+
+    vec3 d = texture(image, coordinates + vec2(-2.0 * x,  0.0)).rgb;
+    vec3 e = texture(image, coordinates).rgb;
+    vec3 f = texture(image, coordinates + vec2( 2.0 * x,  0.0)).rgb;
+
+    vec3 g = texture(image, coordinates + vec2(-2.0 * x, -2.0 * y)).rgb;
+    vec3 h = texture(image, coordinates + vec2( 0.0,     -2.0 * y)).rgb;
+    vec3 i = texture(image, coordinates + vec2( 2.0 * x, -2.0 * y)).rgb;
+
+    vec3 j = texture(image, coordinates + vec2(-x,  y)).rgb;
+    vec3 k = texture(image, coordinates + vec2( x,  y)).rgb;
+    vec3 l = texture(image, coordinates + vec2(-x, -y)).rgb;
+    vec3 m = texture(image, coordinates + vec2( x, -y)).rgb;
+
+    vec3 result;
+    if (karisAverage) {
+        /* first level only: weight each 2x2 box by its inverse luma so single hot texels don't flicker */
+        vec3 box0 = (a + b + d + e) * 0.25;
+        vec3 box1 = (b + c + e + f) * 0.25;
+        vec3 box2 = (d + e + g + h) * 0.25;
+        vec3 box3 = (e + f + h + i) * 0.25;
+        vec3 box4 = (j + k + l + m) * 0.25;
+        float w0 = karisWeight(box0) * 0.125;
+        float w1 = karisWeight(box1) * 0.125;
+        float w2 = karisWeight(box2) * 0.125;
+        float w3 = karisWeight(box3) * 0.125;
+        float w4 = karisWeight(box4) * 0.5;
+        result = (box0 * w0 + box1 * w1 + box2 * w2 + box3 * w3 + box4 * w4) / (w0 + w1 + w2 + w3 + w4);
+    }
+    else {
+        result = e * 0.125;
+        result += (a + c + g + i) * 0.03125;
+        result += (b + d + f + h) * 0.0625;
+        result += (j + k + l + m) * 0.125;
+    }
+
+    fragColor = vec4(max(result, 0.0001), 1.0);
+}
@@ -0,0 +1,34 @@
+#version 330 core
+
+in vec2 coordinates;
+
+uniform sampler2D image;
+uniform float filterRadius;
+
+out vec4 fragColor;
+
+void main() {
+    /* 3x3 tent filter, radius given in uv units of the smaller mip */
+    vec2 size = textureSize(image, 0);
+    float x = filterRadius;
+    float y = filterRadius * size.x / size.y;
+
+    vec3 a = texture(image, coordinates + vec2(-x,  y)).rgb;
+    vec3 b = texture(image, coordinates + vec2( 0.0, y)).rgb;
+    vec3 c = texture(image, coordinates + vec2( x,  y)).rgb;
+
+    vec3 d = texture(image, coordinates + vec2(-x,  0.0)).rgb;
+    vec3 e = texture(image, coordinates).rgb;
+    vec3 f = texture(image, coordinates + vec2( x,  0.0)).rgb;
+
+    vec3 g = texture(image, coordinates + vec2(-x, -y)).rgb;
+    vec3 h = texture(image, coordinates + vec2( 0.0, -y)).rgb;
+    vec3 i = texture(image, coordinates + vec2( x, -y)).rgb;
+
+    vec3 result = e * 4.0;
+    result += (b + d + f + h) * 2.0;
+    result += (a + c + g + i);
+    result *= 1.0 / 16.0;
+
+    fragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,8 @@
+#version 330 core
+
+/* the culling pass runs with the rasterizer off, this only exists to complete the program */
+out vec4 fragColor;
+
+void main() {
+    fragColor = vec4(0.0);
+}
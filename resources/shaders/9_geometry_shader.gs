@@ -0,0 +1,21 @@
+#version 330 core
+
+/* passes the surviving instances on to transform feedback, in the InstanceData layout */
+layout (points) in;
+layout (points, max_vertices=1) out;
+
+in mat4 vModel[];
+in vec4 vTint[];
+flat in int vVisible[];
+
+out mat4 cullModel;
+out vec4 cullTint;
+
+void main() {
+    if (vVisible[0] != 0) {
+        cullModel = vModel[0];
+        cullTint = vTint[0];
+        EmitVertex();
+        EndPrimitive();
+    }
+}
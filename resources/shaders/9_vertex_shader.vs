@@ -0,0 +1,41 @@
+#version 330 core
+
+/* instance culling: one vertex per instance of an InstanceBuffer, attached with divisor 0 */
+layout (location=5) in mat4 instanceModel;
+layout (location=9) in vec4 instanceTint;
+
+out mat4 vModel;
+out vec4 vTint;
+flat out int vVisible;
+
+/* the group transform the instances are drawn with */
+uniform mat4 model;
+/* bounding sphere of the mesh in object space, xyz center and w radius */
+uniform vec4 boundingSphere;
+/* world space planes pointing inwards, normalized */
+uniform vec4 frustumPlanes[6];
+uniform float frustumMargin;
+/* pixels per world unit at distance 1, a zero minimum turns the size test off */
+uniform float projectionScale;
+uniform float minPixelRadius;
+
+#include "common/frame_constants.glsl"
+
+void main() {
+    mat4 world = model * instanceModel;
+    vec3 center = vec3(world * vec4(boundingSphere.xyz, 1.0));
+    float scale = max(length(world[0].xyz), max(length(world[1].xyz), length(world[2].xyz)));
+    float radius = boundingSphere.w * scale;
+
+    bool visible = true;
+    for (int i = 0; i < 6; ++i)
+        visible = visible && dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w > -(radius + frustumMargin);
+
+    /* projected radius, too small to cover a pixel means it can go */
+    float distance = max(length(center - viewPosition), 0.001);
+    visible = visible && radius * projectionScale / distance >= minPixelRadius;
+
+    vModel = instanceModel;
+    vTint = instanceTint;
+    vVisible = visible ? 1 : 0;
+}
@@ -0,0 +1,8 @@
+/* per frame camera data, filled once per frame into the buffer at binding 0 (FrameConstants in rg/UniformBuffers.h) */
+layout (std140) uniform FrameConstants {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+    float time;
+    vec3 viewDirection;
+};
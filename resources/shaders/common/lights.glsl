@@ -0,0 +1,29 @@
+/* the sun and the camera spot light, in the buffer at binding 1 (Lights in rg/UniformBuffers.h).
+ * vec3s are paired with a float to keep the std140 layout free of hidden padding. */
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 diffuse;
+    float constant;
+    vec3 specular;
+    float linear;
+    float quadratic;
+    bool spotToggle;
+};
+
+layout (std140) uniform Lights {
+    PointLight pointLight;
+    SpotLight spotLight;
+};
@@ -0,0 +1,14 @@
+/* dithered crossfade between two detail levels of a model (Model::Draw). The level fading in is drawn with
+ * lodFade rising from 0 to 1 and keeps the pixels whose threshold is below it, the level fading out is drawn
+ * with -lodFade and keeps the others, so together they cover every pixel once. 0 draws everything */
+uniform float lodFade;
+
+void lodFadeDiscard() {
+    if (lodFade == 0.0)
+        return;
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    float threshold = (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+    if (lodFade > 0.0 ? threshold >= lodFade : threshold < -lodFade)
+        discard;
+}
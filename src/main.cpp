@@ -14,7 +14,32 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
 
+#include <rg/AssetLoader.h>
+#include <rg/AsteroidBelt.h>
+#include <rg/Benchmark.h>
+#include <rg/Bloom.h>
+#include <rg/BodyStore.h>
+#include <rg/Bvh.h>
+#include <rg/CommandBucket.h>
+#include <rg/CpuProfiler.h>
+#include <rg/DynamicResolution.h>
+#include <rg/FrameGraph.h>
+#include <rg/GlCallCounter.h>
+#include <rg/GlStateCache.h>
+#include <rg/GpuProfiler.h>
+#include <rg/InstanceBuffer.h>
+#include <rg/InstanceCuller.h>
+#include <rg/JobSystem.h>
+#include <rg/Kepler.h>
+#include <rg/NBody.h>
+#include <rg/SceneGraph.h>
+#include <rg/UniformBuffers.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
 #include <iostream>
+#include <string>
 
 #define CHECK(retval, msg) do { \
         if(!retval) {           \
@@ -69,6 +94,38 @@ struct ProgramState {
     Camera camera;
     bool CameraMouseMovementUpdateEnabled = true;
     PointLight pointLight;
+    /* bloom: mip chain by default, the old 15 pass ping-pong blur kept for A/B comparison */
+    bool mipChainBloom = true;
+    int bloomMipCount = 6;
+    float bloomFilterRadius = 0.005f;
+    float bloomIntensity = 1.0f;
+    /* window framebuffer size, the offscreen targets follow it */
+    int framebufferWidth = SCR_WIDTH;
+    int framebufferHeight = SCR_HEIGHT;
+    DynamicResolution resolution;
+    FrameGraph::Stats frameGraphStats;
+    GpuProfiler gpuProfiler;
+    /* F9 writes the last traceSeconds of CPU zones as a Chrome trace, shift+F9 everything still buffered */
+    bool cpuProfilerEnabled = true;
+    float traceSeconds = 10.0f;
+    /* instanced rocks around the sun, regenerated when the count changes */
+    int asteroidCount = 100000;
+    bool animateAsteroids = true;
+    /* orbits run on a clock this many times faster than real time */
+    float timeWarp = 1.0f;
+    /* the belt and mercury fall around the sun in an n-body simulation instead of following fixed orbits */
+    bool gravitySimulation = false;
+    unsigned gravitySteps = 0;
+    /* frustum and pixel size culling of the belt on the GPU */
+    bool instanceCulling = true;
+    float cullMinPixelRadius = 0.5f;
+    unsigned visibleAsteroids = 0;
+    /* objects left after frustum culling the scene BVH */
+    unsigned visibleObjects = 0, sceneObjects = 0;
+    unsigned loadingAssets = 0;
+    /* models switch to a coarser detail level once its error projects to at most this many pixels */
+    float lodPixelError = 1.0f;
+    unsigned sunLod = 0, mercuryLod = 0;
     ProgramState() : camera(glm::vec3(0.0f, 0.0f, 5.7f)) {}
 };
 
@@ -76,10 +133,36 @@ ProgramState *programState;
 
 void DrawImGui(ProgramState *programState);
 
-int main() {
+void seedGravity(NBody &gravity, const BodyStore &belt, const glm::vec3 &mercuryPosition);
+
+int main(int argc, char **argv) {
+    CpuProfiler::setThreadName("main");
+    uint64_t startupBegin = CpuProfiler::now();
+
+    BenchmarkSettings benchmark;
+    if (!benchmark.parse(argc, argv))
+        return -1;
+    if (benchmark.bvhObjects)
+        return runBvhBenchmark(benchmark);
+    if (benchmark.nbodyBodies)
+        return runNBodyBenchmark(benchmark);
+    if (benchmark.jobCount)
+        return runJobBenchmark(benchmark);
+    JobSystem jobs(benchmark.threads);
+
     // glfw: initialize and configure
     // ------------------------------
-    glfwInit();
+    if (benchmark.headless) {
+        /* no display: the null platform with an EGL surfaceless or OSMesa context, both work on Mesa's
+         * software rasterizer */
+#ifdef GLFW_PLATFORM_NULL
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+        std::cerr << "Urk! Headless mode needs GLFW 3.4 or newer!" << std::endl;
+        return -1;
+#endif
+    }
+    CHECK(glfwInit(), "Failed to initialize GLFW!");
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -90,7 +173,18 @@ int main() {
 
     // glfw window creation
     // --------------------
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "5th-stargate-element", NULL, NULL);
+    GLFWwindow *window;
+    if (benchmark.headless) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+        window = glfwCreateWindow(benchmark.width, benchmark.height, "5th-stargate-element", NULL, NULL);
+        if (window == NULL) {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+            window = glfwCreateWindow(benchmark.width, benchmark.height, "5th-stargate-element", NULL, NULL);
+        }
+    } else {
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "5th-stargate-element", NULL, NULL);
+    }
     if (window == NULL) {
         std::cout << "Urk! Failed to create GLFW window!" << std::endl;
         glfwTerminate();
@@ -115,6 +209,17 @@ int main() {
     stbi_set_flip_vertically_on_load(true);
 
     programState = new ProgramState;
+    programState->gpuProfiler.init((GpuProfiler::ProcLoader) glfwGetProcAddress);
+    glfwGetFramebufferSize(window, &programState->framebufferWidth, &programState->framebufferHeight);
+    if (benchmark.headless) {
+        /* fixed resolution and no overlay, so runs are comparable */
+        programState->framebufferWidth = benchmark.width;
+        programState->framebufferHeight = benchmark.height;
+        programState->ImGuiEnabled = false;
+        programState->resolution.enabled = false;
+        GlCallCounter::install();
+        std::cout << "Benchmarking on " << glGetString(GL_RENDERER) << std::endl;
+    }
     if (programState->ImGuiEnabled) {
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
     }
@@ -127,6 +232,10 @@ int main() {
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 330 core");
 
+    /* models and textures load in the background and show placeholders until they are in */
+    AssetLoader assets(jobs);
+    assets.create();
+
     /* ambient specular light color and other light values */
     float constant = 1.0,
             linear = 0.022,
@@ -134,34 +243,33 @@ int main() {
     glm::vec3 ambientColor = glm::vec3(0.158116f, 0.168f, 0.168f);
     glm::vec3 specularColor = glm::vec3(0.941176f, 1.0f, 1.0f);
 
-    /* sun model vertices, matrices, textures, shaders */
-    Model sunModel("resources/objects/sun_v3/sun_model.obj");
+    /* sun model vertices, matrices, textures, shaders; the meshes keep only the attributes the shaders read */
     Shader sunShader("resources/shaders/2_vertex_shader.vs", "resources/shaders/2_fragment_shader.fs");
-    glm::mat4 sunModelMatrix;
+    Model sunModel("resources/objects/sun_v3/sun_model.obj", assets, 1.0f, VertexFormat(sunShader.vertexAttributes(), true));
     glm::vec3 sunPosition = glm::vec3(0.0f, 0.0f, 0.0f);
     glm::vec3 sunColor = glm::vec3(1.0f, 1.0f, 0.22f);
 
     /* mercury model vertices, matrices, textures, shaders */
-    Model mercuryModel("resources/objects/mercury_v1/mercury_model.obj");
     Shader mercuryShader("resources/shaders/3_vertex_shader.vs", "resources/shaders/3_fragment_shader.fs");
+    /* the belt's bigger rocks are instanced mercuries */
+    Shader rockShader("resources/shaders/3_instanced_vertex_shader.vs", "resources/shaders/3_fragment_shader.fs");
+    Model mercuryModel("resources/objects/mercury_v1/mercury_model.obj", assets, 0.24f,
+                       VertexFormat(mercuryShader.vertexAttributes() | rockShader.vertexAttributes(), true));
     mercuryModel.SetShaderTextureNamePrefix("material.");
-    glm::mat4 mercuryModelMatrix, mercuryNormalMatrix;
     mercuryShader.use();
     mercuryShader.setFloat("material.shininess", 128.0f);
-    mercuryShader.setVec3("pointLight.position", sunPosition);
-    mercuryShader.setVec3("pointLight.ambient", ambientColor);
-    mercuryShader.setVec3("pointLight.diffuse", sunColor);
-    mercuryShader.setVec3("pointLight.specular", specularColor);
-    mercuryShader.setFloat("pointLight.constant", constant);
-    mercuryShader.setFloat("pointLight.linear", linear);
-    mercuryShader.setFloat("pointLight.quadratic", quadratic);
-    mercuryShader.setFloat("spotLight.cutOff", cutOff);
-    mercuryShader.setFloat("spotLight.outerCutOff", outerCutOff);
-    mercuryShader.setFloat("spotLight.constant", constant);
-    mercuryShader.setFloat("spotLight.linear", linear);
-    mercuryShader.setFloat("spotLight.quadratic", quadratic);
-    mercuryShader.setVec3("spotLight.diffuse", specularColor);
-    mercuryShader.setVec3("spotLight.specular", specularColor);
+    rockShader.use();
+    rockShader.setFloat("material.shininess", 16.0f);
+
+    /* the sun lights everything, ImGui edits its attenuation; the lights reach the shaders through the
+     * Lights uniform block */
+    programState->pointLight.position = sunPosition;
+    programState->pointLight.ambient = ambientColor;
+    programState->pointLight.diffuse = sunColor;
+    programState->pointLight.specular = specularColor;
+    programState->pointLight.constant = constant;
+    programState->pointLight.linear = linear;
+    programState->pointLight.quadratic = quadratic;
 
     /* tetrahedron vertices, matrices, textures, shaders */
     float tetrahedron[] = {
@@ -201,57 +309,87 @@ int main() {
     glEnableVertexAttribArray(2);
     glBindVertexArray(0);
 
-    glm::mat4 tetraModelMatrix1 = glm::mat4(1.0);
-    tetraModelMatrix1 = glm::translate(tetraModelMatrix1, glm::vec3(-9.0f, 0.0f, -7.794229f));
-    tetraModelMatrix1 = glm::scale(tetraModelMatrix1, glm::vec3(1.4f, 1.4f, 1.4f));
-    glm::mat4 tetraModelMatrix2 = glm::mat4(1.0);
-    tetraModelMatrix2 = glm::translate(tetraModelMatrix2, glm::vec3(9.0f, 0.0f, -7.794229f));
-    tetraModelMatrix2 = glm::scale(tetraModelMatrix2, glm::vec3(1.4f, 1.4f, 1.4f));
-    glm::mat4 tetraModelMatrix3 = glm::mat4(1.0);
-    tetraModelMatrix3 = glm::translate(tetraModelMatrix3, glm::vec3(0.0f, 0.0f, 7.794229f));
-    tetraModelMatrix3 = glm::scale(tetraModelMatrix3, glm::vec3(1.4f, 1.4f, 1.4f));
-
-    Shader tetraShader("resources/shaders/1_vertex_shader.vs", "resources/shaders/1_fragment_shader.fs");
-
-    unsigned tetraTex[2];
-    unsigned char *data;
-    int width, height, nChannels;
-    glGenTextures(2, tetraTex);
-    glBindTexture(GL_TEXTURE_2D, tetraTex[0]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    data = stbi_load("resources/textures/Marble009_1K_Color.png", &width, &height, &nChannels, 0);
-    CHECK(data, "Fatal error! Specular map marble failed to load! Terminating...");
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    stbi_image_free(data);
-
-    data = stbi_load("resources/textures/Marble009_1K_Displacement.png", &width, &height, &nChannels, 0);
-    glBindTexture(GL_TEXTURE_2D, tetraTex[1]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    CHECK(data, "Fatal error! Specular map marble failed to load! Terminating...");
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    stbi_image_free(data);
+    /* scene hierarchy: mercury is placed on its orbit every frame, the belt's rocks move on their own
+     * inside the belt's node */
+    SceneGraph scene;
+    const glm::vec3 yAxis(0.0f, 1.0f, 0.0f);
+    SceneNode sunNode = scene.add();
+    SceneNode mercuryNode = scene.add(NO_PARENT, glm::vec3(5.0f, 0.0f, 0.0f));
+    SceneNode beltNode = scene.add();
+    glm::vec3 tetraPositions[3] = {
+            glm::vec3(-9.0f, 0.0f, -7.794229f), glm::vec3(9.0f, 0.0f, -7.794229f), glm::vec3(0.0f, 0.0f, 7.794229f)
+    };
+    SceneNode tetraNodes[3];
+    for (unsigned i = 0; i < 3; ++i)
+        tetraNodes[i] = scene.add(NO_PARENT, tetraPositions[i], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.4f));
+    scene.update();
+
+    /* the three tetrahedra are one instanced draw */
+    InstanceData tetraInstances[3];
+    for (unsigned i = 0; i < 3; ++i)
+        tetraInstances[i].model = scene.world(tetraNodes[i]);
+    InstanceBuffer tetraInstanceBuffer;
+    tetraInstanceBuffer.create();
+    tetraInstanceBuffer.upload(tetraInstances, 3);
+    tetraInstanceBuffer.attach(tetraVAO);
+    unsigned tetraVisibleMask = 7;
+    Aabb tetraBounds;
+    for (unsigned i = 0; i < sizeof(tetrahedron) / sizeof(float); i += 8)
+        tetraBounds.add(glm::vec3(tetrahedron[i], tetrahedron[i + 1], tetrahedron[i + 2]));
+
+    /* asteroid belt shards share the tetrahedron's vertices, their own VAO carries the belt's instances */
+    unsigned shardVAO;
+    glGenVertexArrays(1, &shardVAO);
+    glBindVertexArray(shardVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, tetraVBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tetraEBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void *) 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void *) (3*sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8*sizeof(float), (void *) (6*sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+    /* planets on their real shapes and tilts, scaled to the scene; mercury keeps its old radius and a lap
+     * every 6 pi seconds. It is the only planet with a model, the others would go in the same way */
+    const Planet &mercuryPlanet = Planet::get(Planet::MERCURY);
+    KeplerOrbits planetOrbits;
+    unsigned mercuryOrbit = planetOrbits.add(mercuryPlanet.elements(5.0f / (float) mercuryPlanet.semiMajorAxis,
+                                                                     18.849556f / (float) mercuryPlanet.period));
+
+    AsteroidBelt belt;
+    int beltCount = -1;
+    BodyStore beltBodies;
+    KeplerOrbits beltOrbits;
+    std::vector<InstanceData> beltDrawLists[BELT_MESH_COUNT];
+    NBody gravity(jobs);
+    InstanceBuffer shardInstanceBuffer, rockInstanceBuffer;
+    shardInstanceBuffer.create(GL_STREAM_DRAW);
+    rockInstanceBuffer.create(GL_STREAM_DRAW);
+    unsigned shardVAOInstances = 0;
+    InstanceCuller instanceCuller("resources/shaders/9_vertex_shader.vs", "resources/shaders/9_geometry_shader.gs",
+                                  "resources/shaders/9_fragment_shader.fs");
+    CulledInstances shardCulling, rockCulling;
+    shardCulling.create();
+    rockCulling.create();
+    /* the scene's draws, sorted by state each frame */
+    CommandBucket sceneDraws;
+
+    Shader tetraShader("resources/shaders/1_instanced_vertex_shader.vs", "resources/shaders/1_fragment_shader.fs");
+
+    TextureDesc marbleColor;
+    marbleColor.paths.push_back("resources/textures/Marble009_1K_Color.png");
+    marbleColor.wrapS = GL_MIRRORED_REPEAT;
+    marbleColor.magFilter = GL_NEAREST;
+    TextureDesc marbleDisplacement;
+    marbleDisplacement.paths.push_back("resources/textures/Marble009_1K_Displacement.png");
+    marbleDisplacement.wrapS = GL_MIRRORED_REPEAT;
+    marbleDisplacement.color = false;
 
     tetraShader.use();
     tetraShader.setInt("materDiffuse", 0);
     tetraShader.setInt("materSpecular", 1);
     tetraShader.setFloat("materShininess", 38.4f);
-    tetraShader.setVec3("lightDiffuse", sunColor);
-    tetraShader.setVec3("lightAmbient", ambientColor);
-    tetraShader.setVec3("lightSpecular", specularColor);
-    tetraShader.setVec3("lightPosition", sunPosition);
-    tetraShader.setFloat("lightConstant", constant);
-    tetraShader.setFloat("lightLinear", linear);
-    tetraShader.setFloat("lightQuadratic", quadratic);
-    tetraShader.setFloat("spotCutOff", cutOff);
-    tetraShader.setFloat("spotOuterCutOff", outerCutOff);
 
     /* skybox nebula */
     float nebula[] = {
@@ -311,38 +449,26 @@ int main() {
 
     Shader nebulaShader("resources/shaders/4_vertex_shader.vs", "resources/shaders/4_fragment_shader.fs");
 
-    unsigned nebulaTex;
-    glGenTextures(1, &nebulaTex);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, nebulaTex);
-    data = stbi_load("resources/textures/skybox_right.png", &width, &height, &nChannels, 0);
-    CHECK(data, "Fatal error! Failed to load skybox_right! Terminating...");
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    stbi_image_free(data);
-    data = stbi_load("resources/textures/skybox_left.png", &width, &height, &nChannels, 0);
-    CHECK(data, "Fatal error! Failed to load skybox_left! Terminating...");
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    stbi_image_free(data);
-    data = stbi_load("resources/textures/skybox_bottom.png", &width, &height, &nChannels, 0);
-    CHECK(data, "Fatal error! Failed to load skybox_top! Terminating...");
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    stbi_image_free(data);
-    data = stbi_load("resources/textures/skybox_top.png", &width, &height, &nChannels, 0);
-    CHECK(data, "Fatal error! Failed to load skybox_bottom! Terminating...");
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    stbi_image_free(data);
-    data = stbi_load("resources/textures/skybox_front.png", &width, &height, &nChannels, 0);
-    CHECK(data, "Fatal error! Failed to load skybox_back! Terminating...");
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    stbi_image_free(data);
-    data = stbi_load("resources/textures/skybox_back.png", &width, &height, &nChannels, 0);
-    CHECK(data, "Fatal error! Failed to load skybox_front! Terminating...");
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    stbi_image_free(data);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    /* the bottom and top faces are swapped to match the flipped images */
+    const char *nebulaFaces[] = { "right", "left", "bottom", "top", "front", "back" };
+    TextureDesc nebulaImages;
+    nebulaImages.target = GL_TEXTURE_CUBE_MAP;
+    for (const char *face : nebulaFaces)
+        nebulaImages.paths.push_back(std::string("resources/textures/skybox_") + face + ".png");
+    nebulaImages.wrapS = nebulaImages.wrapT = nebulaImages.wrapR = GL_CLAMP_TO_EDGE;
+    nebulaImages.minFilter = GL_NEAREST;
+    nebulaImages.mipmaps = false;
+    unsigned char space[4] = {0, 0, 0, 255};
+    std::copy(space, space + 4, nebulaImages.placeholder);
+
+    /* the scene's textures decode as one batch, all images at once */
+    unsigned tetraTex[2], nebulaTex;
+    std::vector<unsigned> sceneTextures = assets.loadTextures(
+            {marbleColor, marbleDisplacement, nebulaImages},
+            [&tetraTex, &nebulaTex](unsigned index, unsigned texture) { (index < 2 ? tetraTex[index] : nebulaTex) = texture; });
+    tetraTex[0] = sceneTextures[0];
+    tetraTex[1] = sceneTextures[1];
+    nebulaTex = sceneTextures[2];
 
     nebulaShader.use();
     nebulaShader.setInt("skyBox", 0);
@@ -371,219 +497,500 @@ int main() {
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float),  (void *) (2*sizeof(float)));
     glBindVertexArray(0);
 
-    unsigned bloomFBO;
-    glGenFramebuffers(1, &bloomFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, bloomFBO);
-
-    unsigned bloomColorBuffer[2];
-    glGenTextures(2, bloomColorBuffer);
-    glBindTexture(GL_TEXTURE_2D, bloomColorBuffer[0]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bloomColorBuffer[0], 0);
-
-    glBindTexture(GL_TEXTURE_2D, bloomColorBuffer[1]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, bloomColorBuffer[1], 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    unsigned attachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, attachments);
-
-    unsigned bloomRenderBuffer;
-    glGenRenderbuffers(1, &bloomRenderBuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, bloomRenderBuffer);
-    glad_glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, bloomRenderBuffer);
-
-    CHECK((glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE), "Fatal error! Framebuffer incomplete! Terminating...");
-
-    unsigned blurFBO[2];
-    glGenFramebuffers(2, blurFBO);
-    unsigned blurColorBuffer[2];
-    glGenTextures(2, blurColorBuffer);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, blurFBO[0]);
-    glBindTexture(GL_TEXTURE_2D, blurColorBuffer[0]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurColorBuffer[0], 0);
-    CHECK((glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE), "Fatal error! Framebuffer incomplete! Terminating...");
-
-    glBindFramebuffer(GL_FRAMEBUFFER, blurFBO[1]);
-    glBindTexture(GL_TEXTURE_2D, blurColorBuffer[1]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurColorBuffer[1], 0);
-    CHECK((glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE), "Fatal error! Framebuffer incomplete! Terminating...");
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    /* offscreen targets are transient frame graph textures sized by the render extent */
+    FrameGraph frameGraph;
+    RenderExtent extent;
+    GpuProfiler &gpuProfiler = programState->gpuProfiler;
+
+    /* without a display there is no default framebuffer to present to, the output goes to this one */
+    unsigned offscreenFBO = 0, offscreenColor = 0;
+    if (benchmark.headless) {
+        glGenRenderbuffers(1, &offscreenColor);
+        glBindRenderbuffer(GL_RENDERBUFFER, offscreenColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, benchmark.width, benchmark.height);
+        glGenFramebuffers(1, &offscreenFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, offscreenFBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColor);
+        CHECK((glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE), "Offscreen framebuffer is incomplete!");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    CameraPath cameraPath;
+    BenchmarkReport report;
+    unsigned benchmarkFrame = 0;
 
     Shader blurShader("resources/shaders/5_vertex_shader.vs", "resources/shaders/5_fragment_shader.fs");
     blurShader.use();
     blurShader.setInt("image", 0);
+    blurShader.setVec2("uvScale", 1.0f, 1.0f);
 
     Shader outputShader("resources/shaders/6_vertex_shader.vs", "resources/shaders/6_fragment_shader.fs");
     outputShader.use();
     outputShader.setInt("baseImage", 0);
     outputShader.setInt("highlights", 1);
 
+    MipChainBloom mipBloom("resources/shaders/5_vertex_shader.vs", "resources/shaders/7_fragment_shader.fs",
+                           "resources/shaders/8_fragment_shader.fs");
+
     // draw in wireframe
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    /* camera and light data shared by all scene shaders, one buffer update per frame each */
+    UniformBuffer<FrameConstants> frameConstantsBuffer;
+    frameConstantsBuffer.create(FRAME_CONSTANTS_BINDING);
+    UniformBuffer<Lights> lightsBuffer;
+    lightsBuffer.create(LIGHTS_BINDING);
+    FrameConstants frameConstants = {};
+    Lights lights = {};
+
+    /* per object uniforms set every frame, resolved once so the render loop does no name lookups */
+    const UniformHandle tetraModelUniform = tetraShader.uniform("model");
+    const UniformHandle sunModelUniform = sunShader.uniform("model");
+    const UniformHandle mercuryModelUniform = mercuryShader.uniform("model");
+    const UniformHandle mercuryNormRotationUniform = mercuryShader.uniform("normRotation");
+    const UniformHandle rockModelUniform = rockShader.uniform("model");
+    const UniformHandle blurToggleUniform = blurShader.uniform("blurToggle");
+    const UniformHandle blurUvScaleUniform = blurShader.uniform("uvScale");
+    const UniformHandle outputBloomStrengthUniform = outputShader.uniform("bloomStrength");
+    const UniformHandle outputUvScaleUniform = outputShader.uniform("uvScale");
+
+    /* what the scene draws need besides their matrices, the command bucket hands it back to the draw
+     * functions below. The rocks' instance buffer is set every frame, the culling ring moves it on */
+    struct SceneDraw {
+        Shader *shader;
+        UniformHandle model, normRotation;
+        Model *mesh;
+        const InstanceBuffer *instances;
+    };
+    SceneDraw tetraDraw = {&tetraShader, tetraModelUniform, INVALID_UNIFORM, nullptr, nullptr};
+    SceneDraw rockDraw = {&rockShader, rockModelUniform, INVALID_UNIFORM, &mercuryModel, nullptr};
+    SceneDraw sunDraw = {&sunShader, sunModelUniform, INVALID_UNIFORM, &sunModel, nullptr};
+    SceneDraw mercuryDraw = {&mercuryShader, mercuryModelUniform, mercuryNormRotationUniform, &mercuryModel, nullptr};
+    CommandBucket::DrawFunction drawTetras = [](const void *object, const glm::mat4 *transforms, unsigned count) {
+        const SceneDraw &draw = *(const SceneDraw *) object;
+        draw.shader->setMat4(draw.model, transforms[0]);
+        glDrawElementsInstanced(GL_TRIANGLES, 12, GL_UNSIGNED_INT, 0, count);
+    };
+    CommandBucket::DrawFunction drawInstancedModel = [](const void *object, const glm::mat4 *transforms, unsigned) {
+        const SceneDraw &draw = *(const SceneDraw *) object;
+        draw.shader->setMat4(draw.model, transforms[0]);
+        draw.mesh->DrawInstanced(*draw.shader, *draw.instances);
+    };
+    CommandBucket::DrawFunction drawModel = [](const void *object, const glm::mat4 *transforms, unsigned) {
+        const SceneDraw &draw = *(const SceneDraw *) object;
+        draw.shader->setMat4(draw.model, transforms[0]);
+        draw.mesh->Draw(*draw.shader);
+    };
+    // the model matrix, then the normal matrix
+    CommandBucket::DrawFunction drawLitModel = [](const void *object, const glm::mat4 *transforms, unsigned) {
+        const SceneDraw &draw = *(const SceneDraw *) object;
+        draw.shader->setMat4(draw.model, transforms[0]);
+        draw.shader->setMat4(draw.normRotation, transforms[1]);
+        draw.mesh->Draw(*draw.shader);
+    };
+    CommandBucket::DrawFunction drawNebula = [](const void *, const glm::mat4 *, unsigned) {
+        glDepthFunc(GL_LEQUAL);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glDepthFunc(GL_LESS);
+    };
+
+    /* the single objects are frustum culled on the CPU through a BVH, the belt is culled on the GPU */
+    Bvh sceneBvh;
+    unsigned tetraObjects[3];
+    for (unsigned i = 0; i < 3; ++i)
+        tetraObjects[i] = sceneBvh.add(tetraBounds.transformed(tetraInstances[i].model));
+    unsigned sunObject = sceneBvh.add(sunModel.bounds);
+    unsigned mercuryObject = sceneBvh.add(mercuryModel.bounds);
+    sceneBvh.build();
+    std::vector<unsigned> visibleObjects;
+    std::vector<unsigned char> objectVisible(sceneBvh.size());
+    programState->sceneObjects = sceneBvh.size();
+
     /* loop variables */
-    float currentFrame, t;
-    unsigned blurSwitch;
+    float currentFrame;
+    double orbitTime = 0.0;
+    float bloomStrength;
     glm::mat4 projection, view;
+    FrameGraphResource backbuffer, sceneColor, highlights, bloom;
+
+    /* a benchmark measures frames, not loading */
+    if (benchmark.headless) {
+        assets.finish();
+        GeometryPools::defragment();
+    }
+    programState->loadingAssets = assets.pending();
+
+    if (CpuProfiler::enabled())
+        CpuProfiler::record("startup", nullptr, startupBegin, CpuProfiler::now());
 
     /* render loop */
     while (!glfwWindowShouldClose(window)) {
-        /* per-frame time logic */
-        currentFrame = (float) glfwGetTime();
+        PROFILE_SCOPE("frame");
+        std::chrono::steady_clock::time_point frameBegin = std::chrono::steady_clock::now();
+
+        /* per-frame time logic, a benchmark steps a fixed dt along the camera path */
+        if (benchmark.headless) {
+            currentFrame = benchmarkFrame * benchmark.dt;
+            cameraPath.apply(programState->camera, currentFrame);
+            GlCallCounter::reset();
+        } else {
+            currentFrame = (float) glfwGetTime();
+        }
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
-         t = currentFrame / 3;
+        orbitTime += (double) deltaTime * programState->timeWarp;
+
+        /* render extent and internal resolution */
+        extent.resize(programState->framebufferWidth, programState->framebufferHeight);
+        extent.setScale(programState->resolution.update(gpuProfiler.frameMs()));
+        gpuProfiler.beginFrame();
+
+        /* a slice of the pending uploads, whatever is done shows this frame */
+        {
+            PROFILE_SCOPE("asset uploads");
+            unsigned wasLoading = programState->loadingAssets;
+            assets.update(2.0);
+            programState->loadingAssets = assets.pending();
+            /* the placeholders' geometry left holes at the front of the pools, close them once loading is done */
+            if (wasLoading && !programState->loadingAssets)
+                GeometryPools::defragment();
+        }
+
+        /* asteroid belt bodies, moved along their orbits and turned into instances */
+        bool beltGenerated = programState->asteroidCount != beltCount;
+        if (beltGenerated) {
+            PROFILE_SCOPE("asteroid belt");
+            beltCount = programState->asteroidCount;
+            belt.generate((unsigned) beltCount, beltBodies, beltOrbits);
+            resizeDrawLists(beltBodies, beltDrawLists, BELT_MESH_COUNT);
+        }
+        bool gravityOn = programState->gravitySimulation;
+        if (!gravityOn && gravity.size() > 0)
+            gravity.clear();
+        if (gravityOn && (beltGenerated || gravity.size() == 0)) {
+            PROFILE_SCOPE("gravity seed");
+            beltOrbits.propagate(orbitTime, jobs, beltBodies.positionX.data(), beltBodies.positionY.data(),
+                                 beltBodies.positionZ.data());
+            seedGravity(gravity, beltBodies, glm::vec3(scene.world(mercuryNode)[3]));
+        }
+        if (gravityOn) {
+            PROFILE_SCOPE("gravity");
+            programState->gravitySteps = gravity.advance(deltaTime, 4);
+            /* bodies 0 and 1 are the sun and mercury, the belt follows in order */
+            std::copy(gravity.positionsX() + 2, gravity.positionsX() + gravity.size(), beltBodies.positionX.begin());
+            std::copy(gravity.positionsY() + 2, gravity.positionsY() + gravity.size(), beltBodies.positionY.begin());
+            std::copy(gravity.positionsZ() + 2, gravity.positionsZ() + gravity.size(), beltBodies.positionZ.begin());
+        }
 
         /* view projection transformations */
         projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                      (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
+                                      (float) extent.width / (float) extent.height, 0.1f, 100.0f);
         view = programState->camera.GetViewMatrix();
 
-        /* bloom framebuffer setup */
-        glBindFramebuffer(GL_FRAMEBUFFER, bloomFBO);
-        glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
-
-        /* tetrahedron render */
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, tetraTex[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, tetraTex[1]);
-        glBindVertexArray(tetraVAO);
-        tetraShader.use();
-        tetraShader.setVec3("viewPosition", programState->camera.Position);
-        tetraShader.setVec3("viewDirection", programState->camera.Front);
-        tetraShader.setBool("spotToggle", spotSwitch);
-        tetraShader.setMat4("view", view);
-        tetraShader.setMat4("projection", projection);
-        tetraShader.setMat4("model", tetraModelMatrix1);
-        glDrawArrays(GL_TRIANGLES, 0, 12);
-        tetraShader.setMat4("model", tetraModelMatrix2);
-        glDrawElements(GL_TRIANGLES, 12, GL_UNSIGNED_INT, 0);
-        tetraShader.setMat4("model", tetraModelMatrix3);
-        glDrawArrays(GL_TRIANGLES, 0, 12);
-        glBindVertexArray(0);
-
-        /* sun render */
-        sunShader.use();
-        sunShader.setMat4("projection", projection);
-        sunShader.setMat4("view", view);
-        sunModelMatrix = glm::mat4(1.0f);
-        sunModelMatrix = glm::rotate(sunModelMatrix, -currentFrame, glm::vec3(0.0f, 1.0f, 0.0f));
-        sunShader.setMat4("model", sunModelMatrix);
-        sunModel.Draw(sunShader);
-
-        /* mercury render */
-        mercuryShader.use();
-        mercuryShader.setVec3("spotLight.position", programState->camera.Position);
-        mercuryShader.setVec3("spotLight.direction", programState->camera.Front);
-        mercuryShader.setBool("spotLight.spotToggle", spotSwitch);
-        mercuryShader.setVec3("viewPosition", programState->camera.Position);
-        mercuryShader.setMat4("projection", projection);
-        mercuryShader.setMat4("view", view);
-        mercuryModelMatrix = glm::mat4(1.0f);
-        mercuryModelMatrix = glm::translate(mercuryModelMatrix, glm::vec3((float) 5*cos(t), 0.0f, (float) 5*sin(t)));
-        mercuryModelMatrix = glm::rotate(mercuryModelMatrix, currentFrame, glm::vec3(0.0, 1.0, 0.0));
-        mercuryNormalMatrix = glm::mat4(1.0f);
-        mercuryNormalMatrix =  glm::rotate(mercuryNormalMatrix, currentFrame, glm::vec3(0.0, 1.0, 0.0));
-        mercuryShader.setMat4("model", mercuryModelMatrix);
-        mercuryShader.setMat4("normRotation", mercuryNormalMatrix);
-        mercuryModel.Draw(mercuryShader);
-
-        /* nebula render */
-        glDepthFunc(GL_LEQUAL);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, nebulaTex);
-        glBindVertexArray(nebulaVAO);
-        nebulaShader.use();
-        nebulaShader.setMat4("projection", projection);
-        nebulaShader.setMat4("view", glm::mat4(glm::mat3(view)));
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glDepthFunc(GL_LESS);
-        glBindVertexArray(0);
+        /* the rest of the frame's simulation runs as jobs: belt orbits and spins side by side, the belt's
+         * draw lists once both are done, and the scene graph with the BVH next to all of them. This thread
+         * helps out while it waits for each result right before handing it to GL. */
+        JobCounter beltMoved, beltReady, sceneReady;
+        bool beltAnimated = programState->animateAsteroids || beltGenerated || gravityOn;
+        if (beltAnimated) {
+            if (!gravityOn)
+                beltOrbits.propagate(orbitTime, jobs, beltBodies.positionX.data(), beltBodies.positionY.data(),
+                                     beltBodies.positionZ.data(), beltMoved);
+            jobs.parallelFor(beltBodies.size(), 8192, [&beltBodies, currentFrame](unsigned begin, unsigned end) {
+                updateSpins(beltBodies, currentFrame, begin, end);
+            }, beltMoved);
+            jobs.runAfter(beltMoved, [&] {
+                PROFILE_SCOPE("belt draw lists");
+                buildDrawLists(beltBodies, beltDrawLists, 0, beltBodies.size());
+            }, beltReady);
+        }
+
+        /* moving objects and frustum culling */
+        bool tetrasMoved = false;
+        unsigned tetraMask = 0;
+        jobs.run([&] {
+            PROFILE_SCOPE("scene culling");
+            scene.setRotation(sunNode, -currentFrame, yAxis);
+            scene.setPosition(mercuryNode, gravityOn ? gravity.position(1) : planetOrbits.position(mercuryOrbit, orbitTime));
+            scene.setRotation(mercuryNode, currentFrame, yAxis);
+            scene.update();
+
+            if (scene.moved(sunNode))
+                sceneBvh.update(sunObject, sunModel.bounds.transformed(scene.world(sunNode)));
+            if (scene.moved(mercuryNode))
+                sceneBvh.update(mercuryObject, mercuryModel.bounds.transformed(scene.world(mercuryNode)));
+            for (unsigned i = 0; i < 3; ++i) {
+                if (scene.moved(tetraNodes[i])) {
+                    tetraInstances[i].model = scene.world(tetraNodes[i]);
+                    sceneBvh.update(tetraObjects[i], tetraBounds.transformed(tetraInstances[i].model));
+                    tetrasMoved = true;
+                }
+            }
+            sceneBvh.refit();
+            sceneBvh.cull(Frustum(projection * view), visibleObjects);
+            std::fill(objectVisible.begin(), objectVisible.end(), 0);
+            for (unsigned object : visibleObjects)
+                objectVisible[object] = 1;
+            programState->visibleObjects = (unsigned) visibleObjects.size();
+            for (unsigned i = 0; i < 3; ++i)
+                tetraMask |= objectVisible[tetraObjects[i]] << i;
+        }, sceneReady);
+
+        /* the tetrahedra only get re-uploaded when one of them comes, goes or moves */
+        jobs.wait(sceneReady);
+
+        /* detail levels by projected error, crossfading over a quarter second */
+        sunModel.SelectLod(programState->camera, scene.world(sunNode), (float) extent.height,
+                           programState->lodPixelError, deltaTime);
+        mercuryModel.SelectLod(programState->camera, scene.world(mercuryNode), (float) extent.height,
+                               programState->lodPixelError, deltaTime);
+        programState->sunLod = sunModel.lod;
+        programState->mercuryLod = mercuryModel.lod;
+        if (tetraMask != tetraVisibleMask || tetrasMoved) {
+            InstanceData visibleTetras[3];
+            unsigned count = 0;
+            for (unsigned i = 0; i < 3; ++i)
+                if (tetraMask >> i & 1)
+                    visibleTetras[count++] = tetraInstances[i];
+            tetraInstanceBuffer.upload(visibleTetras, count);
+            tetraVisibleMask = tetraMask;
+        }
+        if (beltAnimated) {
+            jobs.wait(beltReady);
+            shardInstanceBuffer.upload(beltDrawLists[SHARD_MESH]);
+            rockInstanceBuffer.upload(beltDrawLists[ROCK_MESH]);
+        }
+
+        /* shared uniform blocks, the lights only get uploaded when something changed */
+        frameConstants.view = view;
+        frameConstants.projection = projection;
+        frameConstants.viewPosition = programState->camera.Position;
+        frameConstants.time = currentFrame;
+        frameConstants.viewDirection = programState->camera.Front;
+        frameConstantsBuffer.update(frameConstants);
+
+        const PointLight &sun = programState->pointLight;
+        lights.pointLight.position = sun.position;
+        lights.pointLight.ambient = sun.ambient;
+        lights.pointLight.diffuse = sun.diffuse;
+        lights.pointLight.specular = sun.specular;
+        lights.pointLight.constant = sun.constant;
+        lights.pointLight.linear = sun.linear;
+        lights.pointLight.quadratic = sun.quadratic;
+        lights.spotLight.position = programState->camera.Position;
+        lights.spotLight.direction = programState->camera.Front;
+        lights.spotLight.cutOff = cutOff;
+        lights.spotLight.outerCutOff = outerCutOff;
+        lights.spotLight.diffuse = sun.specular;
+        lights.spotLight.specular = sun.specular;
+        lights.spotLight.constant = sun.constant;
+        lights.spotLight.linear = sun.linear;
+        lights.spotLight.quadratic = sun.quadratic;
+        lights.spotLight.spotToggle = spotSwitch;
+        lightsBuffer.update(lights);
+
+        /* declare this frame's passes */
+        frameGraph.reset();
+        FrameGraphTextureDesc hdrDesc(extent.width, extent.height, GL_RGBA16F);
+        glm::vec2 uvScale(extent.uvScaleX(), extent.uvScaleY());
+        backbuffer = frameGraph.importRenderTarget("backbuffer", offscreenFBO, programState->framebufferWidth,
+                                                   programState->framebufferHeight);
+
+        frameGraph.addPass("scene", [&](FrameGraph::Builder &builder) {
+            sceneColor = builder.write(builder.create("scene color", hdrDesc));
+            highlights = builder.write(builder.create("highlights", hdrDesc));
+            builder.write(builder.create("scene depth", FrameGraphTextureDesc(extent.width, extent.height, GL_DEPTH24_STENCIL8)));
+        }, [&](const FrameGraph::Resources &) {
+            glViewport(0, 0, extent.internalWidth, extent.internalHeight);
+            glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glEnable(GL_DEPTH_TEST);
+
+            /* asteroid belt culling, before the draws since it binds GL itself */
+            const glm::mat4 &beltModelMatrix = scene.world(beltNode);
+            gpuProfiler.push("asteroid culling");
+            instanceCuller.enabled = programState->instanceCulling;
+            instanceCuller.minPixelRadius = programState->cullMinPixelRadius;
+            instanceCuller.setView(projection, view, extent.internalHeight);
+            /* bounding spheres around the origin: the tetrahedron's corners and mercury's radius */
+            instanceCuller.cull(shardCulling, shardInstanceBuffer, beltModelMatrix, glm::vec3(0.0f), 1.56f);
+            instanceCuller.cull(rockCulling, rockInstanceBuffer, beltModelMatrix, glm::vec3(0.0f), 0.25f);
+            const InstanceBuffer &shards = shardCulling.instances(shardInstanceBuffer);
+            const InstanceBuffer &rocks = rockCulling.instances(rockInstanceBuffer);
+            if (shards.name() != shardVAOInstances) {
+                shards.attach(shardVAO);
+                shardVAOInstances = shards.name();
+            }
+            programState->visibleAsteroids = shards.count() + rocks.count();
+            gpuProfiler.pop();
+
+            /* record the draws in any order: the opaque ones in pass 0, sorted by state within coarse depth
+             * buckets, the nebula in pass 1 behind all of them. Binds repeated between neighbours are skipped */
+            auto depth = [&](const glm::mat4 &model) {
+                return CommandBucket::depthBucket(glm::length(glm::vec3(model[3]) - programState->camera.Position),
+                                                  0.1f, 100.0f);
+            };
+            sceneDraws.clear();
+            unsigned identityTransform = sceneDraws.transform(glm::mat4(1.0f));
+            unsigned beltTransform = sceneDraws.transform(beltModelMatrix);
+            sceneDraws.add(CommandBucket::key(0, depth(glm::mat4(1.0f)), tetraShader.ID, tetraTex[0], tetraVAO),
+                           tetraShader.ID, tetraVAO, drawTetras, &tetraDraw, identityTransform, tetraInstanceBuffer.count())
+                    .texture(GL_TEXTURE_2D, tetraTex[0]).texture(GL_TEXTURE_2D, tetraTex[1]);
+            sceneDraws.add(CommandBucket::key(0, depth(beltModelMatrix), tetraShader.ID, tetraTex[0], shardVAO),
+                           tetraShader.ID, shardVAO, drawTetras, &tetraDraw, beltTransform, shards.count())
+                    .texture(GL_TEXTURE_2D, tetraTex[0]).texture(GL_TEXTURE_2D, tetraTex[1]);
+            rockDraw.instances = &rocks;
+            sceneDraws.add(CommandBucket::key(0, depth(beltModelMatrix), rockShader.ID, mercuryModel.Material(),
+                                              mercuryModel.VertexArray()), rockShader.ID, 0, drawInstancedModel,
+                           &rockDraw, beltTransform);
+            if (objectVisible[sunObject]) {
+                glm::mat4 sunModelMatrix = scene.world(sunNode);
+                sceneDraws.add(CommandBucket::key(0, depth(sunModelMatrix), sunShader.ID, sunModel.Material(),
+                                                  sunModel.VertexArray()), sunShader.ID, 0, drawModel, &sunDraw,
+                               sceneDraws.transform(sunModelMatrix));
+            }
+            if (objectVisible[mercuryObject]) {
+                glm::mat4 mercuryModelMatrix = scene.world(mercuryNode);
+                unsigned mercuryTransform = sceneDraws.transform(mercuryModelMatrix);
+                sceneDraws.transform(glm::mat4(scene.normalMatrix(mercuryNode)));
+                sceneDraws.add(CommandBucket::key(0, depth(mercuryModelMatrix), mercuryShader.ID, mercuryModel.Material(),
+                                                  mercuryModel.VertexArray()), mercuryShader.ID, 0, drawLitModel,
+                               &mercuryDraw, mercuryTransform);
+            }
+            sceneDraws.add(CommandBucket::key(1, 0, nebulaShader.ID, nebulaTex, nebulaVAO), nebulaShader.ID, nebulaVAO,
+                           drawNebula).texture(GL_TEXTURE_CUBE_MAP, nebulaTex);
+
+            gpuProfiler.push("scene draws");
+            sceneDraws.sort();
+            GlStateCache::resetStats();
+            sceneDraws.submit();
+            glDisable(GL_DEPTH_TEST);
+            gpuProfiler.pop();
+        });
 
         /* blur the highlights */
-        glBindFramebuffer(GL_FRAMEBUFFER, blurFBO[1]);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glDisable(GL_DEPTH_TEST);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, bloomColorBuffer[1]);
-        glBindVertexArray(bloomVAO);
-        blurShader.use();
-        blurShader.setBool("blurToggle", true);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        blurSwitch = false;
-        for (unsigned i = 0; i < 15; ++i) {
-            glBindFramebuffer(GL_FRAMEBUFFER, blurFBO[blurSwitch]);
+        if (programState->mipChainBloom) {
+            bloom = mipBloom.addPasses(frameGraph, highlights, extent.width, extent.height,
+                                       programState->bloomMipCount, bloomVAO, programState->bloomFilterRadius, uvScale);
+            /* every level is added on the way up, so normalize by the chain length */
+            bloomStrength = programState->bloomIntensity / (float) mipBloom.mipCount();
+        } else {
+            /* the first pass reads the scaled scene region and stretches it over the whole blur target,
+             * the graph ping-pongs the 16 passes between two physical textures */
+            bloom = highlights;
+            for (unsigned i = 0; i < 16; ++i) {
+                FrameGraphResource source = bloom;
+                bool horizontal = i % 2 == 0;
+                glm::vec2 sourceUvScale = i == 0 ? uvScale : glm::vec2(1.0f, 1.0f);
+                frameGraph.addPass("blur", [&](FrameGraph::Builder &builder) {
+                    builder.read(source);
+                    bloom = builder.write(builder.create("blurred highlights", hdrDesc));
+                }, [&blurShader, &bloomVAO, blurToggleUniform, blurUvScaleUniform, source, horizontal, sourceUvScale](const FrameGraph::Resources &resources) {
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, resources.texture(source));
+                    glBindVertexArray(bloomVAO);
+                    blurShader.use();
+                    blurShader.setBool(blurToggleUniform, horizontal);
+                    blurShader.setVec2(blurUvScaleUniform, sourceUvScale);
+                    glDrawArrays(GL_TRIANGLES, 0, 6);
+                    glBindVertexArray(0);
+                });
+            }
+            bloomStrength = programState->bloomIntensity;
+        }
+
+        /* screen output, without bloom the whole highlights chain is culled */
+        frameGraph.addPass("output", [&](FrameGraph::Builder &builder) {
+            builder.read(sceneColor);
+            if (bloomStrength > 0.0f)
+                builder.read(bloom);
+            backbuffer = builder.write(backbuffer);
+        }, [&](const FrameGraph::Resources &resources) {
             glClear(GL_COLOR_BUFFER_BIT);
-            glBindTexture(GL_TEXTURE_2D, blurColorBuffer[!blurSwitch]);
-            blurShader.setBool("blurToggle", blurSwitch);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, resources.texture(sceneColor));
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, bloomStrength > 0.0f ? resources.texture(bloom) : 0);
+            glBindVertexArray(bloomVAO);
+            outputShader.use();
+            outputShader.setFloat(outputBloomStrengthUniform, bloomStrength);
+            outputShader.setVec2(outputUvScaleUniform, uvScale);
             glDrawArrays(GL_TRIANGLES, 0, 6);
-            blurSwitch = !blurSwitch;
-        }
-        glBindVertexArray(0);
+            glBindVertexArray(0);
+            glActiveTexture(GL_TEXTURE0);
+        });
 
-        /* screen output */
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, bloomColorBuffer[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, blurColorBuffer[!blurSwitch]);
-        glBindVertexArray(bloomVAO);
-        outputShader.use();
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
+        {
+            PROFILE_SCOPE("frame graph compile");
+            frameGraph.compile();
+        }
+        {
+            PROFILE_SCOPE("frame graph execute");
+            frameGraph.execute(&gpuProfiler);
+        }
+        programState->frameGraphStats = frameGraph.stats();
 
         /* imgui thing */
-        if (programState->ImGuiEnabled)
+        if (programState->ImGuiEnabled) {
+            PROFILE_SCOPE("imgui");
+            GpuScope imguiScope(gpuProfiler, "imgui");
             DrawImGui(programState);
+        }
+        gpuProfiler.endFrame();
+
+        if (benchmark.headless) {
+            glFinish();
+            float frameMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameBegin).count();
+            if (++benchmarkFrame == benchmark.warmupFrames)
+                gpuProfiler.resetRunStats();
+            if (benchmarkFrame > benchmark.warmupFrames)
+                report.addFrame(frameMs);
+            if (benchmarkFrame == benchmark.warmupFrames + benchmark.frames)
+                break;
+        }
 
         /* swap buffers and poll events */
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-        processInput(window);
+        {
+            PROFILE_SCOPE("swap buffers");
+            glfwSwapBuffers(window);
+        }
+        {
+            PROFILE_SCOPE("poll events");
+            glfwPollEvents();
+            processInput(window);
+        }
     }
 
     /* free memory and terminate */
     glDeleteVertexArrays(1, &tetraVAO);
     glDeleteBuffers(1, &tetraVBO);
     glDeleteTextures(2, tetraTex);
+    glDeleteVertexArrays(1, &shardVAO);
+    tetraInstanceBuffer.destroy();
+    shardInstanceBuffer.destroy();
+    rockInstanceBuffer.destroy();
+    shardCulling.destroy();
+    rockCulling.destroy();
     glDeleteVertexArrays(1, &nebulaVAO);
     glDeleteBuffers(1, &nebulaVBO);
     glDeleteTextures(1, &nebulaTex);
     glDeleteVertexArrays(1, &bloomVAO);
     glDeleteBuffers(1, &bloomVBO);
-    glDeleteTextures(2, bloomColorBuffer);
-    glDeleteRenderbuffers(1, &bloomRenderBuffer);
-    glDeleteFramebuffers(1, &bloomFBO);
-    glDeleteTextures(2, blurColorBuffer);
-    glDeleteFramebuffers(2, blurFBO);
+    frameGraph.destroy();
+    frameConstantsBuffer.destroy();
+    lightsBuffer.destroy();
+    if (benchmark.headless) {
+        glDeleteFramebuffers(1, &offscreenFBO);
+        glDeleteRenderbuffers(1, &offscreenColor);
+        GlCallCounter::uninstall();
+        gpuProfiler.finish();
+        if (report.write(benchmark, (const char *) glGetString(GL_RENDERER), gpuProfiler))
+            std::cout << "Benchmark report written to " << benchmark.reportPath << std::endl;
+        else
+            std::cerr << "Urk! Failed to write the benchmark report to " << benchmark.reportPath << "!" << std::endl;
+    }
+    gpuProfiler.destroy();
+    assets.destroy();
+    GeometryPools::destroy();
     delete programState;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -613,7 +1020,10 @@ void processInput(GLFWwindow *window) {
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
+    // the offscreen targets are resized at the start of the next frame.
     glViewport(0, 0, width, height);
+    programState->framebufferWidth = width;
+    programState->framebufferHeight = height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -641,6 +1051,24 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     programState->camera.ProcessMouseScroll(yoffset);
 }
 
+/* The sun, mercury and the belt as gravitating bodies, each started on a circular orbit around the sun
+ * from where it is now. The sun's mass gives mercury the speed of its scripted orbit; the rocks are light
+ * enough to barely disturb each other. */
+void seedGravity(NBody &gravity, const BodyStore &belt, const glm::vec3 &mercuryPosition) {
+    const float sunMass = 13.9f;
+    gravity.clear();
+    gravity.add(glm::vec3(0.0f), glm::vec3(0.0f), sunMass);
+    unsigned count = belt.size();
+    for (unsigned i = 0; i < count + 1; ++i) {
+        glm::vec3 position = i == 0 ? mercuryPosition
+                                    : glm::vec3(belt.positionX[i - 1], belt.positionY[i - 1], belt.positionZ[i - 1]);
+        float radius = std::max(glm::length(glm::vec3(position.x, 0.0f, position.z)), 1e-3f);
+        glm::vec3 along = glm::vec3(-position.z, 0.0f, position.x) / radius;
+        float mass = i == 0 ? 1e-3f : 1e-3f / (float) std::max(count, 1u);
+        gravity.add(position, along * std::sqrt(sunMass / radius), mass);
+    }
+}
+
 void DrawImGui(ProgramState *programState) {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -657,6 +1085,48 @@ void DrawImGui(ProgramState *programState) {
         ImGui::DragFloat("pointLight.constant", &programState->pointLight.constant, 0.05, 0.0, 1.0);
         ImGui::DragFloat("pointLight.linear", &programState->pointLight.linear, 0.05, 0.0, 1.0);
         ImGui::DragFloat("pointLight.quadratic", &programState->pointLight.quadratic, 0.05, 0.0, 1.0);
+
+        ImGui::Checkbox("Mip chain bloom (B)", &programState->mipChainBloom);
+        ImGui::SliderInt("Bloom mips", &programState->bloomMipCount, 1, (int) MipChainBloom::MAX_MIPS);
+        ImGui::SliderFloat("Bloom radius", &programState->bloomFilterRadius, 0.001f, 0.02f);
+        ImGui::SliderFloat("Bloom intensity", &programState->bloomIntensity, 0.0f, 4.0f);
+
+        ImGui::SliderInt("Asteroids", &programState->asteroidCount, 0, 250000);
+        ImGui::Checkbox("Animate asteroids", &programState->animateAsteroids);
+        ImGui::SliderFloat("Time warp", &programState->timeWarp, 1.0f, 1e6f, "%.0fx", ImGuiSliderFlags_Logarithmic);
+        ImGui::Checkbox("N-body gravity", &programState->gravitySimulation);
+        if (programState->gravitySimulation)
+            ImGui::Text("%u gravity steps this frame", programState->gravitySteps);
+        ImGui::Checkbox("GPU instance culling", &programState->instanceCulling);
+        ImGui::SliderFloat("Cull below (px)", &programState->cullMinPixelRadius, 0.0f, 4.0f);
+        ImGui::Text("%u asteroids drawn", programState->visibleAsteroids);
+        ImGui::Text("%u of %u scene objects visible", programState->visibleObjects, programState->sceneObjects);
+        ImGui::SliderFloat("LOD error (px)", &programState->lodPixelError, 0.25f, 8.0f);
+        ImGui::Text("Sun LOD %u, mercury LOD %u", programState->sunLod, programState->mercuryLod);
+        if (programState->loadingAssets)
+            ImGui::Text("%u assets loading", programState->loadingAssets);
+        ImGui::Text("Geometry: %.2f of %.2f MB in %u pools", GeometryPools::usedBytes() / 1048576.0,
+                    GeometryPools::totalBytes() / 1048576.0, GeometryPools::count());
+        /* what the scene's sorted draws bound last frame, and what the state cache found already bound */
+        const GlStateCache::Stats &bindStats = GlStateCache::stats();
+        for (unsigned binding = 0; binding < GlStateCache::BINDING_COUNT; ++binding)
+            ImGui::Text("%s binds: %llu issued, %llu skipped", GlStateCache::name((GlStateCache::Binding) binding),
+                        bindStats.issued[binding], bindStats.skipped[binding]);
+
+        DynamicResolution &resolution = programState->resolution;
+        ImGui::Checkbox("Dynamic resolution", &resolution.enabled);
+        ImGui::SliderFloat("Target frame (ms)", &resolution.targetFrameMs, 4.0f, 33.3f);
+        ImGui::SliderFloat("Min scale", &resolution.minScale, 0.25f, 1.0f);
+        ImGui::Text("GPU frame %.2f ms, scale %.2f", resolution.smoothedFrameMs(), resolution.currentScale());
+
+        if (ImGui::Checkbox("CPU profiler", &programState->cpuProfilerEnabled))
+            CpuProfiler::setEnabled(programState->cpuProfilerEnabled);
+        ImGui::SliderFloat("Trace seconds (F9)", &programState->traceSeconds, 1.0f, 60.0f);
+
+        const FrameGraph::Stats &graph = programState->frameGraphStats;
+        ImGui::Text("Frame graph: %u passes (%u culled)", graph.passes, graph.culledPasses);
+        ImGui::Text("%u transient textures in %u physical, %.1f MB", graph.transientTextures,
+                    graph.physicalTextures, graph.physicalBytes / (1024.0 * 1024.0));
         ImGui::End();
     }
 
@@ -670,6 +1140,36 @@ void DrawImGui(ProgramState *programState) {
         ImGui::End();
     }
 
+    {
+        /* rolling window of the last GpuProfiler::HISTORY resolved frames */
+        ImGui::Begin("GPU timings");
+        if (ImGui::BeginTable("passes", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_ColumnsWidthFixed)) {
+            ImGui::TableSetupColumn("Pass");
+            ImGui::TableSetupColumn("avg ms");
+            ImGui::TableSetupColumn("p50");
+            ImGui::TableSetupColumn("p95");
+            ImGui::TableSetupColumn("p99");
+            ImGui::TableHeadersRow();
+            for (const GpuProfiler::ScopeStats &scope : programState->gpuProfiler.stats()) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%*s%s", (int) scope.depth * 2, "", scope.name.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.averageMs);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.p50Ms);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.p95Ms);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.p99Ms);
+            }
+            ImGui::EndTable();
+        }
+        if (!programState->gpuProfiler.debugGroupsAvailable())
+            ImGui::TextDisabled("KHR_debug not available, no debug groups");
+        ImGui::End();
+    }
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
@@ -685,6 +1185,18 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         }
     }
 
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS) {
+        std::string path = "trace_" + std::to_string((long long) std::time(nullptr)) + ".json";
+        double seconds = (mods & GLFW_MOD_SHIFT) ? 0.0 : programState->traceSeconds;
+        if (CpuProfiler::writeChromeTrace(path, seconds))
+            std::cout << "CPU trace written to " << path << std::endl;
+        else
+            std::cerr << "Urk! Failed to write CPU trace to " << path << "!" << std::endl;
+    }
+
+    if (key == GLFW_KEY_B && action == GLFW_PRESS)
+        programState->mipChainBloom = !programState->mipChainBloom;
+
     if (key == GLFW_KEY_F && action == GLFW_PRESS)
         spotSwitch = true;
     if (key == GLFW_KEY_F && action == GLFW_RELEASE)
@@ -0,0 +1,112 @@
+#include <rg/Bvh.h>
+
+#include <Check.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// the ids a brute force test of every box against the frustum finds
+static std::vector<unsigned> bruteForce(const std::vector<Aabb> &boxes, const Frustum &frustum)
+{
+    std::vector<unsigned> visible;
+    for (unsigned i = 0; i < boxes.size(); ++i)
+        if (frustum.intersects(boxes[i]))
+            visible.push_back(i);
+    return visible;
+}
+
+static void checkCull(const Bvh &bvh, const std::vector<Aabb> &boxes, const Frustum &frustum)
+{
+    std::vector<unsigned> visible;
+    bvh.cull(frustum, visible);
+    std::sort(visible.begin(), visible.end());
+    CHECK(std::adjacent_find(visible.begin(), visible.end()) == visible.end());
+    CHECK(visible == bruteForce(boxes, frustum));
+}
+
+// a camera at eye looking along angle around the y axis, a bit up or down
+static Frustum camera(const glm::vec3 &eye, float angle, float far)
+{
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, far);
+    glm::vec3 direction(std::cos(angle), 0.3f * std::sin(2.0f * angle), std::sin(angle));
+    return Frustum(projection * glm::lookAt(eye, eye + direction, glm::vec3(0.0f, 1.0f, 0.0f)));
+}
+
+static void scene()
+{
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> position(-60.0f, 60.0f), size(0.05f, 3.0f), unit(-1.0f, 1.0f);
+    std::vector<Aabb> boxes(5000);
+    Bvh bvh;
+    for (Aabb &box : boxes) {
+        float x = position(random), y = position(random), z = position(random);
+        float extent = size(random);
+        box.add(glm::vec3(x, y, z) - glm::vec3(extent));
+        box.add(glm::vec3(x, y, z) + glm::vec3(extent));
+        bvh.add(box);
+    }
+    bvh.build();
+
+    std::vector<Frustum> frustums;
+    for (unsigned i = 0; i < 16; ++i) {
+        float angle = (float) i * 0.4f;
+        frustums.push_back(camera(glm::vec3(0.0f), angle, 150.0f));
+        // short far planes and cameras outside the scene cut through it differently
+        frustums.push_back(camera(glm::vec3(20.0f * std::sin(angle), 5.0f, -30.0f), angle, 25.0f));
+        frustums.push_back(camera(glm::vec3(-90.0f, 0.0f, 0.0f), 0.1f * angle, 100.0f));
+    }
+    for (const Frustum &frustum : frustums)
+        checkCull(bvh, boxes, frustum);
+
+    // move a tenth of the boxes a few times and refit, including some far out of the way and back
+    for (unsigned round = 0; round < 8; ++round) {
+        for (unsigned i = 0; i < boxes.size() / 10; ++i) {
+            unsigned object = random() % boxes.size();
+            float x = unit(random), y = unit(random), z = unit(random);
+            glm::vec3 step = glm::vec3(x, y, z) * (round % 4 == 3 ? 40.0f : 2.0f);
+            boxes[object].min += step;
+            boxes[object].max += step;
+            bvh.update(object, boxes[object]);
+        }
+        bvh.refit();
+        for (const Frustum &frustum : frustums)
+            checkCull(bvh, boxes, frustum);
+    }
+}
+
+static void small()
+{
+    Bvh empty;
+    empty.build();
+    std::vector<unsigned> visible(1, 7);
+    empty.cull(camera(glm::vec3(0.0f), 0.0f, 100.0f), visible);
+    CHECK(visible.empty());
+
+    // one box in front of the camera, then moved behind it
+    std::vector<Aabb> boxes(1);
+    boxes[0].add(glm::vec3(9.0f, -1.0f, -1.0f));
+    boxes[0].add(glm::vec3(11.0f, 1.0f, 1.0f));
+    Bvh one;
+    one.add(boxes[0]);
+    one.build();
+    Frustum frustum = camera(glm::vec3(0.0f), 0.0f, 100.0f);
+    checkCull(one, boxes, frustum);
+    boxes[0].min.x -= 20.0f;
+    boxes[0].max.x -= 20.0f;
+    one.update(0, boxes[0]);
+    one.refit();
+    checkCull(one, boxes, frustum);
+    one.cull(frustum, visible);
+    CHECK(visible.empty());
+}
+
+int main()
+{
+    small();
+    scene();
+    return checkFailures();
+}
@@ -0,0 +1,17 @@
+#ifndef PROJECT_BASE_CHECK_H
+#define PROJECT_BASE_CHECK_H
+
+#include <iostream>
+
+/* Just enough of a test framework: CHECK logs a failed condition and carries on, the test's main
+ * returns checkFailures() so ctest sees any of them. */
+inline int &checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(x) do { if (!(x)) { std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #x ") failed\n"; \
+    ++checkFailures(); } } while (0)
+
+#endif //PROJECT_BASE_CHECK_H
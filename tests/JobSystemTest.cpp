@@ -0,0 +1,122 @@
+#include <rg/JobSystem.h>
+
+#include <Check.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// runAfter jobs see every job of their dependency finished, down a chain of counters
+static void dependencies(JobSystem &jobs)
+{
+    const unsigned width = 64;
+    for (unsigned round = 0; round < 200; ++round) {
+        std::atomic<unsigned> first{0}, second{0}, third{0};
+        std::atomic<unsigned> early{0};
+        JobCounter a, b, c;
+        for (unsigned i = 0; i < width; ++i)
+            jobs.run([&] { ++first; }, a);
+        for (unsigned i = 0; i < width; ++i)
+            jobs.runAfter(a, [&] {
+                if (first.load() != width)
+                    ++early;
+                ++second;
+            }, b);
+        // b's jobs are counted on b from runAfter() on, even the ones still parked on a
+        for (unsigned i = 0; i < width; ++i)
+            jobs.runAfter(b, [&] {
+                if (first.load() != width || second.load() != width)
+                    ++early;
+                ++third;
+            }, c);
+        jobs.wait(c);
+        CHECK(early.load() == 0);
+        CHECK(third.load() == width);
+        CHECK(a.done() && b.done());
+    }
+
+    // a finished dependency runs the job straight away
+    JobCounter done, after;
+    std::atomic<bool> ran{false};
+    jobs.runAfter(done, [&] { ran = true; }, after);
+    jobs.wait(after);
+    CHECK(ran.load());
+}
+
+// lots of tiny jobs, some spawning more on the same counter, each runs exactly once and the counter ends at zero
+static void contention(JobSystem &jobs)
+{
+    const unsigned roots = 20000, children = 3;
+    std::unique_ptr<std::atomic<unsigned>[]> runs(new std::atomic<unsigned>[roots * (children + 1)]);
+    for (unsigned i = 0; i < roots * (children + 1); ++i)
+        runs[i] = 0;
+    JobCounter counter;
+    for (unsigned i = 0; i < roots; ++i)
+        jobs.run([&jobs, &runs, &counter, i] {
+            ++runs[i];
+            for (unsigned child = 0; child < children; ++child) {
+                unsigned index = roots + i * children + child;
+                jobs.run([&runs, index] { ++runs[index]; }, counter);
+            }
+        }, counter);
+    jobs.wait(counter);
+    CHECK(counter.done());
+    unsigned wrong = 0;
+    for (unsigned i = 0; i < roots * (children + 1); ++i)
+        wrong += runs[i].load() != 1;
+    CHECK(wrong == 0);
+}
+
+// every index exactly once, blocking or not, and a job can wait on its own loop
+static void loops(JobSystem &jobs)
+{
+    const unsigned count = 100003;
+    std::vector<std::atomic<unsigned>> hits(count);
+    auto clear = [&] {
+        for (std::atomic<unsigned> &hit : hits)
+            hit = 0;
+    };
+    auto once = [&] {
+        unsigned wrong = 0;
+        for (std::atomic<unsigned> &hit : hits)
+            wrong += hit.load() != 1;
+        return wrong == 0;
+    };
+    auto body = [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; ++i)
+            ++hits[i];
+    };
+
+    clear();
+    jobs.parallelFor(count, 97, body);
+    CHECK(once());
+
+    clear();
+    JobCounter counter;
+    jobs.parallelFor(count, 1000, body, counter);
+    jobs.wait(counter);
+    CHECK(once());
+
+    clear();
+    JobCounter outer;
+    for (unsigned part = 0; part < 4; ++part)
+        jobs.run([&, part] {
+            unsigned begin = part * (count / 4), end = part == 3 ? count : begin + count / 4;
+            jobs.parallelFor(end - begin, 500, [&, begin](unsigned b, unsigned e) { body(begin + b, begin + e); });
+        }, outer);
+    jobs.wait(outer);
+    CHECK(once());
+}
+
+int main()
+{
+    JobSystem jobs(4);
+    for (unsigned threads : {4u, 1u, 2u, 8u}) {
+        jobs.resize(threads);
+        CHECK(jobs.size() == threads);
+        dependencies(jobs);
+        contention(jobs);
+        loops(jobs);
+    }
+    return checkFailures();
+}
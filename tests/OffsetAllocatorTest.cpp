@@ -0,0 +1,126 @@
+#include <rg/OffsetAllocator.h>
+
+#include <Check.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+struct Range {
+    uint32_t offset, size;
+};
+
+// every live handle where the reference has it, none overlapping, all inside the allocator
+static void checkAgainst(const OffsetAllocator &allocator, const std::map<OffsetAllocator::Handle, Range> &live)
+{
+    std::map<uint32_t, uint32_t> byOffset;
+    uint32_t used = 0;
+    for (const auto &allocation : live) {
+        CHECK(allocator.offset(allocation.first) == allocation.second.offset);
+        CHECK(allocator.size(allocation.first) == allocation.second.size);
+        byOffset[allocation.second.offset] = allocation.second.size;
+        used += allocation.second.size;
+    }
+    uint32_t end = 0;
+    for (const auto &range : byOffset) {
+        CHECK(range.first >= end);
+        end = range.first + range.second;
+    }
+    CHECK(end <= allocator.totalSize());
+    CHECK(used == allocator.usedSize());
+    CHECK(live.size() == allocator.allocationCount());
+}
+
+// random allocations, frees, growth and defragmentation against a map of what should be live
+static void stress()
+{
+    OffsetAllocator allocator(1 << 20);
+    std::map<OffsetAllocator::Handle, Range> live;
+    // the same handles in a vector, to pick one to free at random
+    std::vector<OffsetAllocator::Handle> handles;
+    std::mt19937 random(3);
+    for (unsigned step = 0; step < 200000; ++step) {
+        if (live.empty() || random() % 100 < 55) {
+            // one in ten is large
+            bool large = random() % 10 == 0;
+            uint32_t size = 1 + random() % (large ? 50000 : 300);
+            OffsetAllocator::Handle handle = allocator.allocate(size);
+            if (handle == OffsetAllocator::INVALID) {
+                if (random() % 4 == 0)
+                    allocator.grow(allocator.totalSize() * 2);
+                continue;
+            }
+            CHECK(live.count(handle) == 0);
+            live[handle] = {allocator.offset(handle), size};
+            handles.push_back(handle);
+        } else {
+            size_t index = random() % handles.size();
+            allocator.free(handles[index]);
+            live.erase(handles[index]);
+            handles[index] = handles.back();
+            handles.pop_back();
+        }
+        if (step % 5000 == 0)
+            checkAgainst(allocator, live);
+        if (step % 20000 == 19999) {
+            std::vector<OffsetAllocator::Move> moves;
+            allocator.defragment(moves);
+            // packed to the front in the old order, every allocation reported
+            uint32_t end = 0;
+            for (const OffsetAllocator::Move &move : moves) {
+                CHECK(move.to == end);
+                end += move.size;
+            }
+            CHECK(moves.size() == live.size());
+            CHECK(allocator.freeRanges() <= 1);
+            for (auto &allocation : live)
+                allocation.second.offset = allocator.offset(allocation.first);
+            checkAgainst(allocator, live);
+        }
+    }
+    checkAgainst(allocator, live);
+
+    // freeing everything merges back into one range the whole size
+    for (const auto &allocation : live)
+        allocator.free(allocation.first);
+    CHECK(allocator.usedSize() == 0);
+    CHECK(allocator.freeRanges() == 1);
+    CHECK(allocator.allocate(allocator.totalSize()) != OffsetAllocator::INVALID);
+}
+
+static void edges()
+{
+    OffsetAllocator allocator(100);
+    CHECK(allocator.allocate(0) == OffsetAllocator::INVALID);
+    CHECK(allocator.allocate(101) == OffsetAllocator::INVALID);
+    OffsetAllocator::Handle a = allocator.allocate(40);
+    OffsetAllocator::Handle b = allocator.allocate(60);
+    CHECK(a != OffsetAllocator::INVALID && b != OffsetAllocator::INVALID);
+    CHECK(allocator.allocate(1) == OffsetAllocator::INVALID);
+
+    // growing appends free space the next allocation can use
+    allocator.grow(164);
+    OffsetAllocator::Handle c = allocator.allocate(64);
+    CHECK(c != OffsetAllocator::INVALID && allocator.offset(c) == 100);
+
+    // a hole in the middle, then defragmentation closes it and keeps the handles
+    allocator.free(b);
+    CHECK(allocator.freeRanges() == 1);
+    std::vector<OffsetAllocator::Move> moves;
+    allocator.defragment(moves);
+    CHECK(allocator.offset(a) == 0 && allocator.offset(c) == 40);
+    CHECK(allocator.freeRanges() == 1 && allocator.usedSize() == 104);
+
+    // freeing twice or an invalid handle changes nothing
+    allocator.free(a);
+    allocator.free(a);
+    allocator.free(OffsetAllocator::INVALID);
+    CHECK(allocator.usedSize() == 64 && allocator.allocationCount() == 1);
+}
+
+int main()
+{
+    edges();
+    stress();
+    return checkFailures();
+}